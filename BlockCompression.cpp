@@ -0,0 +1,381 @@
+//===--- BlockCompression.cpp - Block compressed containers ---------------===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the block compressed container format.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BlockCompression.hpp"
+#include "MathExtras.hpp"
+#include "MemoryBuffer.hpp"
+#include "OwningPtr.hpp"
+#include "Parallel.hpp"
+#include "StreamableMemoryObject.hpp"
+#include "lz4.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <vector>
+
+using namespace akj;
+
+namespace {
+
+/// BlockCompressedMemoryObject - Random access to a block container through
+/// a small cache of decompressed blocks.
+class BlockCompressedMemoryObject : public StreamableMemoryObject {
+public:
+  BlockCompressedMemoryObject(const blocks::ContainerIndex &Index,
+                              unsigned NumCachedBlocks)
+    : Index(Index), Cache(NumCachedBlocks ? NumCachedBlocks : 1), UseCount(0) {
+  }
+
+  virtual uint64_t getBase() const AKJ_OVERRIDE { return 0; }
+  virtual uint64_t getExtent() const AKJ_OVERRIDE {
+    return Index.getUncompressedSize();
+  }
+  virtual int readByte(uint64_t address, uint8_t *ptr) const AKJ_OVERRIDE {
+    return readBytes(address, 1, ptr);
+  }
+  virtual int readBytes(uint64_t address,
+                        uint64_t size,
+                        uint8_t *buf) const AKJ_OVERRIDE;
+  virtual const uint8_t *getPointer(uint64_t address,
+                                    uint64_t size) const AKJ_OVERRIDE;
+  virtual bool isValidAddress(uint64_t address) const AKJ_OVERRIDE {
+    return address < Index.getUncompressedSize();
+  }
+  virtual bool isObjectEnd(uint64_t address) const AKJ_OVERRIDE {
+    return address == Index.getUncompressedSize();
+  }
+
+private:
+  struct CachedBlock {
+    OwningArrayPtr<uint8_t> Data;
+    size_t Capacity;
+    size_t Block;
+    uint64_t LastUse;
+    CachedBlock() : Capacity(0), Block(0), LastUse(0) {}
+  };
+
+  blocks::ContainerIndex Index;
+  // The caches are tiny, so a linear scan beats anything fancier.
+  mutable std::vector<CachedBlock> Cache;
+  mutable uint64_t UseCount;
+  // Holds getPointer results that straddle blocks.
+  mutable std::vector<uint8_t> Scratch;
+
+  /// getBlock - Return the uncompressed data of Block, decompressing it into
+  /// the least recently used cache entry if needed. Returns null if the block
+  /// is corrupt or there is no memory for it.
+  const uint8_t *getBlock(size_t Block) const;
+
+  bool validRange(uint64_t address, uint64_t size) const {
+    return size <= Index.getUncompressedSize() &&
+           address <= Index.getUncompressedSize() - size;
+  }
+
+  BlockCompressedMemoryObject(const BlockCompressedMemoryObject&)
+    AKJ_DELETED_FUNCTION;
+  void operator=(const BlockCompressedMemoryObject&) AKJ_DELETED_FUNCTION;
+};
+
+const uint8_t *BlockCompressedMemoryObject::getBlock(size_t Block) const {
+  CachedBlock *Victim = &Cache[0];
+  for (size_t I = 0, E = Cache.size(); I != E; ++I) {
+    CachedBlock &Entry = Cache[I];
+    if (Entry.Data && Entry.Block == Block) {
+      Entry.LastUse = ++UseCount;
+      return Entry.Data.get();
+    }
+    if (!Entry.Data || (Victim->Data && Entry.LastUse < Victim->LastUse))
+      Victim = &Entry;
+  }
+
+  // Entries only grow to the blocks they have held, rather than to the block
+  // size the header claims.
+  size_t Size = Index.getUncompressedBlockSize(Block);
+  if (!Victim->Data || Victim->Capacity < Size) {
+    Victim->Data.reset(new (std::nothrow) uint8_t[Size ? Size : 1]);
+    Victim->Capacity = Victim->Data ? Size : 0;
+    if (!Victim->Data)
+      return 0;
+  }
+  if (blocks::uncompressBlock(Index.getCodec(), Index.getCompressedBlock(Block),
+                              reinterpret_cast<char *>(Victim->Data.get()),
+                              Size) != zlib::StatusOK) {
+    Victim->Data.reset();
+    Victim->Capacity = 0;
+    return 0;
+  }
+  Victim->Block = Block;
+  Victim->LastUse = ++UseCount;
+  return Victim->Data.get();
+}
+
+int BlockCompressedMemoryObject::readBytes(uint64_t address,
+                                           uint64_t size,
+                                           uint8_t *buf) const {
+  if (!validRange(address, size)) return -1;
+  const uint64_t BlockSize = Index.getBlockSize();
+  while (size) {
+    size_t Block = size_t(address / BlockSize);
+    size_t Offset = size_t(address % BlockSize);
+    size_t BlockBytes = Index.getUncompressedBlockSize(Block);
+    size_t Chunk = size_t(std::min<uint64_t>(size, BlockBytes - Offset));
+    if (Offset == 0 && Chunk == BlockBytes) {
+      // A whole block: skip the cache, which it would only push others out
+      // of.
+      if (blocks::uncompressBlock(Index.getCodec(),
+                                  Index.getCompressedBlock(Block),
+                                  reinterpret_cast<char *>(buf), BlockBytes) !=
+          zlib::StatusOK)
+        return -1;
+    } else {
+      const uint8_t *Data = getBlock(Block);
+      if (!Data) return -1;
+      memcpy(buf, Data + Offset, Chunk);
+    }
+    address += Chunk;
+    size -= Chunk;
+    buf += Chunk;
+  }
+  return 0;
+}
+
+const uint8_t *BlockCompressedMemoryObject::getPointer(uint64_t address,
+                                                       uint64_t size) const {
+  if (!validRange(address, size)) return 0;
+  const uint64_t BlockSize = Index.getBlockSize();
+  if (size && address % BlockSize + size <= BlockSize) {
+    const uint8_t *Data = getBlock(size_t(address / BlockSize));
+    return Data ? Data + address % BlockSize : 0;
+  }
+  // One spare byte keeps &Scratch[0] valid for empty ranges.
+  Scratch.resize(size_t(size) + 1);
+  if (readBytes(address, size, &Scratch[0]))
+    return 0;
+  return &Scratch[0];
+}
+
+} // anonymous namespace
+
+zlib::Status blocks::ContainerIndex::init(cStringRef Container) {
+  Data = Container;
+  Header = 0;
+  Offsets = 0;
+  if (Container.size() < sizeof(ContainerHeader))
+    return zlib::StatusInvalidData;
+
+  const ContainerHeader *H =
+      reinterpret_cast<const ContainerHeader *>(Container.data());
+  size_t NumBlocks = H->NumBlocks;
+  uint64_t BlockSize = H->BlockSize;
+  if (H->Magic != ContainerMagic || H->Version != ContainerVersion ||
+      H->Codec > CodecZlib || BlockSize == 0)
+    return zlib::StatusInvalidData;
+  // compress() never writes a block size beyond the input size, and a larger
+  // one would only make readers allocate for nothing.
+  uint64_t UncompressedSize = H->UncompressedSize;
+  if (BlockSize > UncompressedSize &&
+      BlockSize > NextPowerOf2(UncompressedSize))
+    return zlib::StatusInvalidData;
+  // Written so that it can't overflow for any UncompressedSize.
+  if (UncompressedSize / BlockSize + (UncompressedSize % BlockSize != 0) !=
+      NumBlocks)
+    return zlib::StatusInvalidData;
+  if ((Container.size() - sizeof(ContainerHeader)) / sizeof(uint64_t) <=
+      NumBlocks)
+    return zlib::StatusInvalidData;
+
+  const support::ulittle64_t *O =
+      reinterpret_cast<const support::ulittle64_t *>(H + 1);
+  if (O[0] != getContainerHeaderSize(NumBlocks) ||
+      O[NumBlocks] > Container.size())
+    return zlib::StatusInvalidData;
+  // Every block must lie inside the container, after the previous one, and
+  // be no larger stored than uncompressed; together the blocks must account
+  // for exactly UncompressedSize bytes.
+  uint64_t Left = UncompressedSize;
+  for (size_t I = 0; I != NumBlocks; ++I) {
+    uint64_t Expanded = Left < BlockSize ? Left : BlockSize;
+    if (O[I + 1] < O[I] || O[I + 1] > Container.size() ||
+        O[I + 1] - O[I] > Expanded)
+      return zlib::StatusInvalidData;
+    Left -= Expanded;
+  }
+  if (Left != 0)
+    return zlib::StatusInvalidData;
+
+  Header = H;
+  Offsets = O;
+  return zlib::StatusOK;
+}
+
+size_t blocks::compressBlock(Codec C, zlib::CompressionLevel Level,
+                             cStringRef Input, char *Dest) {
+  // Anything that doesn't fit in one byte less than the input is stored.
+  if (Input.size() <= 1)
+    return 0;
+  cMutableArrayRef<char> Output(Dest, Input.size() - 1);
+  switch (C) {
+    case CodecStore:
+      return 0;
+    case CodecLZ4: {
+      int Size = lz4::compress(Input, Output);
+      return Size > 0 ? size_t(Size) : 0;
+    }
+    case CodecZlib: {
+      size_t Size;
+      if (zlib::compress(Input, Output, Size, Level) != zlib::StatusOK)
+        return 0;
+      return Size;
+    }
+  }
+  return 0;
+}
+
+zlib::Status blocks::uncompressBlock(Codec C, cStringRef Block, char *Dest,
+                                     size_t DestSize) {
+  if (Block.size() == DestSize) {
+    memcpy(Dest, Block.data(), DestSize);
+    return zlib::StatusOK;
+  }
+  cMutableArrayRef<char> Output(Dest, DestSize);
+  switch (C) {
+    case CodecStore:
+      break;
+    case CodecLZ4: {
+      int Size = lz4::uncompress(Block, Output);
+      if (Size >= 0 && size_t(Size) == DestSize)
+        return zlib::StatusOK;
+      break;
+    }
+    case CodecZlib: {
+      size_t Size;
+      zlib::Status Res = zlib::uncompress(Block, Output, Size);
+      if (Res == zlib::StatusOutOfMemory)
+        return Res;
+      if (Res == zlib::StatusOK && Size == DestSize)
+        return zlib::StatusOK;
+      break;
+    }
+  }
+  return zlib::StatusInvalidData;
+}
+
+zlib::Status blocks::compress(cStringRef InputBuffer,
+                              OwningPtr<MemoryBuffer> &CompressedBuffer,
+                              Codec C, zlib::CompressionLevel Level,
+                              size_t BlockSize, unsigned NumThreads) {
+  if (BlockSize == 0 || BlockSize > LZ4_MAX_INPUT_SIZE || C > CodecZlib)
+    return zlib::StatusInvalidArg;
+  // A single block needs no more room than the input.
+  if (BlockSize > InputBuffer.size())
+    BlockSize = std::max<size_t>(InputBuffer.size(), 1);
+  uint64_t NumBlocks64 = (uint64_t(InputBuffer.size()) + BlockSize - 1) /
+                         BlockSize;
+  if (NumBlocks64 > UINT32_MAX)
+    return zlib::StatusInvalidArg;
+  size_t NumBlocks = size_t(NumBlocks64);
+
+  // Each block is compressed into a scratch buffer and then copied into an
+  // exactly sized one, so that peak memory stays close to the output size.
+  // Stored blocks are copied straight from the input later on.
+  std::vector<OwningArrayPtr<char> > Blocks(NumBlocks);
+  std::vector<size_t> Sizes(NumBlocks);
+  parallel_for(NumBlocks, [&](size_t I) {
+    cStringRef Block = InputBuffer.substr(I * BlockSize, BlockSize);
+    OwningArrayPtr<char> Scratch(new char[Block.size()]);
+    size_t Size = compressBlock(C, Level, Block, Scratch.get());
+    if (Size) {
+      Blocks[I].reset(new char[Size]);
+      memcpy(Blocks[I].get(), Scratch.get(), Size);
+    } else {
+      Size = Block.size();
+    }
+    Sizes[I] = Size;
+  }, NumThreads);
+
+  std::vector<uint64_t> Offsets(NumBlocks + 1);
+  Offsets[0] = getContainerHeaderSize(NumBlocks);
+  for (size_t I = 0; I != NumBlocks; ++I)
+    Offsets[I + 1] = Offsets[I] + Sizes[I];
+
+  MemoryBuffer *Buf =
+      MemoryBuffer::getNewUninitMemBuffer(size_t(Offsets[NumBlocks]));
+  if (!Buf)
+    return zlib::StatusOutOfMemory;
+  char *Out = const_cast<char *>(Buf->getBufferStart());
+
+  ContainerHeader *Header = reinterpret_cast<ContainerHeader *>(Out);
+  Header->Magic = ContainerMagic;
+  Header->Version = ContainerVersion;
+  Header->Codec = uint8_t(C);
+  Header->Level = uint8_t(Level);
+  Header->Reserved = 0;
+  Header->BlockSize = uint32_t(BlockSize);
+  Header->NumBlocks = uint32_t(NumBlocks);
+  Header->UncompressedSize = InputBuffer.size();
+  support::ulittle64_t *Index =
+      reinterpret_cast<support::ulittle64_t *>(Header + 1);
+  for (size_t I = 0; I <= NumBlocks; ++I)
+    Index[I] = Offsets[I];
+
+  parallel_for(NumBlocks, [&](size_t I) {
+    const char *Src = Blocks[I].get();
+    if (!Src)
+      Src = InputBuffer.data() + I * BlockSize;
+    memcpy(Out + Offsets[I], Src, Sizes[I]);
+  }, NumThreads);
+
+  CompressedBuffer.reset(Buf);
+  return zlib::StatusOK;
+}
+
+zlib::Status blocks::uncompress(cStringRef InputBuffer,
+                                OwningPtr<MemoryBuffer> &UncompressedBuffer,
+                                unsigned NumThreads, cStringRef BufferName) {
+  ContainerIndex Index;
+  zlib::Status Res = Index.init(InputBuffer);
+  if (Res != zlib::StatusOK)
+    return Res;
+
+  uint64_t Size = Index.getUncompressedSize();
+  if (Size != size_t(Size))
+    return zlib::StatusOutOfMemory;
+  OwningPtr<MemoryBuffer> Buf(
+      MemoryBuffer::getNewUninitMemBuffer(size_t(Size), BufferName));
+  if (!Buf)
+    return zlib::StatusOutOfMemory;
+  char *Out = const_cast<char *>(Buf->getBufferStart());
+
+  std::atomic<int> Result(zlib::StatusOK);
+  parallel_for(Index.getNumBlocks(), [&](size_t I) {
+    zlib::Status S = uncompressBlock(Index.getCodec(),
+                                     Index.getCompressedBlock(I),
+                                     Out + I * Index.getBlockSize(),
+                                     Index.getUncompressedBlockSize(I));
+    if (S != zlib::StatusOK)
+      Result = S;
+  }, NumThreads);
+
+  if (Result != zlib::StatusOK)
+    return zlib::Status(int(Result));
+  UncompressedBuffer.swap(Buf);
+  return zlib::StatusOK;
+}
+
+StreamableMemoryObject *blocks::getMemoryObject(cStringRef Container,
+                                                unsigned NumCachedBlocks) {
+  ContainerIndex Index;
+  if (Index.init(Container) != zlib::StatusOK)
+    return 0;
+  return new BlockCompressedMemoryObject(Index, NumCachedBlocks);
+}
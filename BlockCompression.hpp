@@ -0,0 +1,144 @@
+//===-- akjBlockCompression.hpp - Block compressed containers ----*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a simple container format that splits its input into
+// fixed size blocks and compresses each one independently. An index of block
+// offsets follows the header, so blocks can be compressed and uncompressed in
+// parallel, or individually.
+//
+// Layout (all fields little endian):
+//   ContainerHeader
+//   uint64_t Offsets[NumBlocks + 1]   - from the start of the container
+//   compressed blocks
+//
+// A block whose compressed size equals its uncompressed size is stored as is.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "Compression.hpp"
+#include "Endian.hpp"
+#include "StringRef.hpp"
+#include <stdint.h>
+
+namespace akj {
+
+class MemoryBuffer;
+template<typename T> class OwningPtr;
+class StreamableMemoryObject;
+
+namespace blocks {
+
+enum Codec {
+  CodecStore,
+  CodecLZ4,
+  CodecZlib
+};
+
+/// ContainerMagic - "AKJZ" read as a little endian integer.
+const uint32_t ContainerMagic = 0x5A4A4B41;
+const uint8_t ContainerVersion = 1;
+
+/// DefaultBlockSize - Large enough to keep per-block overhead negligible,
+/// small enough to give every core of a big machine something to do.
+const size_t DefaultBlockSize = 1024 * 1024;
+
+/// ContainerHeader - The header that starts every container.
+struct ContainerHeader {
+  support::ulittle32_t Magic;
+  support::ulittle8_t Version;
+  support::ulittle8_t Codec;
+  support::ulittle8_t Level;
+  support::ulittle8_t Reserved;
+  support::ulittle32_t BlockSize;
+  support::ulittle32_t NumBlocks;
+  support::ulittle64_t UncompressedSize;
+};
+
+/// getContainerHeaderSize - Return the size of the header and block index of
+/// a container with NumBlocks blocks, which is where the first block starts.
+inline size_t getContainerHeaderSize(size_t NumBlocks) {
+  return sizeof(ContainerHeader) + (NumBlocks + 1) * sizeof(uint64_t);
+}
+
+/// ContainerIndex - A validated, read-only view of a container in memory.
+class ContainerIndex {
+  cStringRef Data;
+  const ContainerHeader *Header;
+  const support::ulittle64_t *Offsets;
+
+public:
+  ContainerIndex() : Header(0), Offsets(0) {}
+
+  /// init - Check that Container is a well formed container and point this
+  /// index at it. The memory must outlive the index.
+  zlib::Status init(cStringRef Container);
+
+  Codec getCodec() const { return Codec(uint8_t(Header->Codec)); }
+  uint64_t getUncompressedSize() const { return Header->UncompressedSize; }
+  size_t getBlockSize() const { return Header->BlockSize; }
+  size_t getNumBlocks() const { return Header->NumBlocks; }
+
+  /// getUncompressedBlockSize - Every block is getBlockSize() bytes except
+  /// possibly the last one.
+  size_t getUncompressedBlockSize(size_t Block) const {
+    uint64_t Start = uint64_t(Block) * getBlockSize();
+    uint64_t Left = getUncompressedSize() - Start;
+    return Left < getBlockSize() ? size_t(Left) : getBlockSize();
+  }
+
+  cStringRef getCompressedBlock(size_t Block) const {
+    return Data.slice(size_t(Offsets[Block]), size_t(Offsets[Block + 1]));
+  }
+};
+
+/// compressBlock - Compress one block into Dest, which must have room for
+/// Input.size() bytes. Return the compressed size, or 0 if the block doesn't
+/// shrink and should be stored as is.
+size_t compressBlock(Codec C, zlib::CompressionLevel Level, cStringRef Input,
+                     char *Dest);
+
+/// uncompressBlock - Uncompress one block that expands to exactly DestSize
+/// bytes into Dest.
+zlib::Status uncompressBlock(Codec C, cStringRef Block, char *Dest,
+                             size_t DestSize);
+
+/// compress - Compress InputBuffer into a block container, compressing the
+/// blocks on up to NumThreads threads (all hardware threads if 0).
+zlib::Status compress(cStringRef InputBuffer,
+                      OwningPtr<MemoryBuffer> &CompressedBuffer,
+                      Codec C = CodecLZ4,
+                      zlib::CompressionLevel Level = zlib::DefaultCompression,
+                      size_t BlockSize = DefaultBlockSize,
+                      unsigned NumThreads = 0);
+
+/// uncompress - Uncompress a block container, decoding the blocks straight
+/// into the result on up to NumThreads threads (all hardware threads if 0).
+/// The new buffer is called BufferName.
+zlib::Status uncompress(cStringRef InputBuffer,
+                        OwningPtr<MemoryBuffer> &UncompressedBuffer,
+                        unsigned NumThreads = 0,
+                        cStringRef BufferName = "");
+
+/// getMemoryObject - Return a StreamableMemoryObject for random access to
+/// the uncompressed contents of Container, or null if it isn't a well formed
+/// container. Each read decompresses only the blocks it touches, and the
+/// NumCachedBlocks most recently used blocks are kept decompressed. Blocks a
+/// read covers completely are decoded straight into the caller's buffer
+/// without going through the cache. Use a block size well below the default
+/// when compressing data that will mostly be read at random.
+///
+/// Container must outlive the object. A pointer from getPointer stays valid
+/// until the next call on the object.
+StreamableMemoryObject *getMemoryObject(cStringRef Container,
+                                        unsigned NumCachedBlocks = 8);
+
+}  // End of namespace blocks
+
+} // End of namespace akj
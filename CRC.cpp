@@ -0,0 +1,375 @@
+//===-- CRC.cpp - CRC32 and CRC32C checksums ------------------------------===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// The CRCs are kept in their usual bit reflected form, so the lowest bit of
+// the register holds the coefficient of x^31. The hardware CRC32 follows
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+// (Gopal et al., Intel, 2009); combining follows zlib's crc32_combine.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CRC.hpp"
+#include "Endian.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+# define AKJ_CRC_X86 1
+# if defined(_MSC_VER)
+#  include <intrin.h>
+#  define AKJ_CRC_TARGET(x)
+# else
+#  include <cpuid.h>
+#  define AKJ_CRC_TARGET(x) __attribute__((target(x)))
+# endif
+# include <nmmintrin.h>
+# include <wmmintrin.h>
+#else
+# define AKJ_CRC_X86 0
+#endif
+
+namespace akj {
+
+namespace {
+
+const uint32_t CRC32Poly = 0xEDB88320;
+const uint32_t CRC32CPoly = 0x82F63B78;
+
+/// ParallelChunkSize - Big enough that combining is free and every thread
+/// streams through memory for a while, small enough to balance the load.
+const size_t ParallelChunkSize = 4 * 1024 * 1024;
+
+/// CRCTables - Everything the portable code needs for one polynomial.
+struct CRCTables {
+  uint32_t Poly;
+
+  /// Slice[K][I] - The CRC of byte I followed by K zero bytes.
+  uint32_t Slice[8][256];
+
+  /// PowerOf2[N] - x^(2^N) modulo the polynomial, used to append zeros.
+  uint32_t PowerOf2[32];
+
+  explicit CRCTables(uint32_t P);
+
+  /// multiply - Return A * B modulo the polynomial.
+  uint32_t multiply(uint32_t A, uint32_t B) const {
+    uint32_t M = 1u << 31, Product = 0;
+    for (;;) {
+      if (A & M) {
+        Product ^= B;
+        if ((A & (M - 1)) == 0)
+          break;
+      }
+      M >>= 1;
+      B = B & 1 ? (B >> 1) ^ Poly : B >> 1;
+    }
+    return Product;
+  }
+
+  /// getZerosOperator - Return x^(8 * NumBytes) modulo the polynomial. A
+  /// CRC register multiplied by it has had NumBytes zero bytes appended.
+  uint32_t getZerosOperator(uint64_t NumBytes) const {
+    uint32_t Result = 1u << 31;
+    for (unsigned K = 3; NumBytes; NumBytes >>= 1, ++K)
+      if (NumBytes & 1)
+        Result = multiply(PowerOf2[K & 31], Result);
+    return Result;
+  }
+
+  /// update - Run the register Reg over Size bytes at P, eight at a time.
+  uint32_t update(const uint8_t *P, size_t Size, uint32_t Reg) const {
+    using namespace support;
+    for (; Size >= 8; P += 8, Size -= 8) {
+      uint32_t Lo = endian::read<uint32_t, little, unaligned>(P) ^ Reg;
+      uint32_t Hi = endian::read<uint32_t, little, unaligned>(P + 4);
+      Reg = Slice[7][Lo & 0xff] ^ Slice[6][(Lo >> 8) & 0xff] ^
+            Slice[5][(Lo >> 16) & 0xff] ^ Slice[4][Lo >> 24] ^
+            Slice[3][Hi & 0xff] ^ Slice[2][(Hi >> 8) & 0xff] ^
+            Slice[1][(Hi >> 16) & 0xff] ^ Slice[0][Hi >> 24];
+    }
+    for (; Size; ++P, --Size)
+      Reg = Slice[0][(Reg ^ *P) & 0xff] ^ (Reg >> 8);
+    return Reg;
+  }
+
+  uint32_t combine(uint32_t CRC1, uint32_t CRC2, uint64_t Len2) const {
+    return multiply(getZerosOperator(Len2), CRC1) ^ CRC2;
+  }
+};
+
+CRCTables::CRCTables(uint32_t P) : Poly(P) {
+  for (unsigned I = 0; I != 256; ++I) {
+    uint32_t Reg = I;
+    for (unsigned Bit = 0; Bit != 8; ++Bit)
+      Reg = Reg & 1 ? (Reg >> 1) ^ Poly : Reg >> 1;
+    Slice[0][I] = Reg;
+  }
+  for (unsigned I = 0; I != 256; ++I)
+    for (unsigned K = 1; K != 8; ++K)
+      Slice[K][I] = (Slice[K - 1][I] >> 8) ^ Slice[0][Slice[K - 1][I] & 0xff];
+
+  PowerOf2[0] = 1u << 30;  // x^1
+  for (unsigned N = 1; N != 32; ++N)
+    PowerOf2[N] = multiply(PowerOf2[N - 1], PowerOf2[N - 1]);
+}
+
+const CRCTables &getCRC32Tables() {
+  static const CRCTables Tables(CRC32Poly);
+  return Tables;
+}
+
+const CRCTables &getCRC32CTables() {
+  static const CRCTables Tables(CRC32CPoly);
+  return Tables;
+}
+
+#if AKJ_CRC_X86
+
+struct CRCCPUFeatures {
+  bool SSE42;
+  bool PCLMUL;
+
+  CRCCPUFeatures() : SSE42(false), PCLMUL(false) {
+#if defined(_MSC_VER)
+    int Regs[4];
+    __cpuid(Regs, 1);
+    unsigned ECX = unsigned(Regs[2]);
+#else
+    unsigned EAX, EBX, ECX = 0, EDX;
+    if (!__get_cpuid(1, &EAX, &EBX, &ECX, &EDX))
+      return;
+#endif
+    SSE42 = (ECX >> 20) & 1;
+    PCLMUL = SSE42 && ((ECX >> 1) & 1);
+  }
+};
+
+const CRCCPUFeatures &getCRCCPUFeatures() {
+  static const CRCCPUFeatures Features;
+  return Features;
+}
+
+/// CRC32CStride - The length of each of the three streams that the SSE4.2
+/// loop checksums side by side to hide the latency of the crc32 instruction.
+const size_t CRC32CStride = 4096;
+
+AKJ_CRC_TARGET("sse4.2")
+uint32_t crc32cStream(const uint8_t *P, size_t Size, uint32_t Reg) {
+  using namespace support;
+#if defined(__x86_64__) || defined(_M_X64)
+  uint64_t Reg64 = Reg;
+  for (; Size >= 8; P += 8, Size -= 8)
+    Reg64 = _mm_crc32_u64(Reg64, endian::read<uint64_t, little, unaligned>(P));
+  Reg = uint32_t(Reg64);
+#else
+  for (; Size >= 4; P += 4, Size -= 4)
+    Reg = _mm_crc32_u32(Reg, endian::read<uint32_t, little, unaligned>(P));
+#endif
+  for (; Size; ++P, --Size)
+    Reg = _mm_crc32_u8(Reg, *P);
+  return Reg;
+}
+
+AKJ_CRC_TARGET("sse4.2")
+uint32_t crc32cHardware(const uint8_t *P, size_t Size, uint32_t Reg) {
+  using namespace support;
+  if (Size >= 3 * CRC32CStride) {
+    const CRCTables &Tables = getCRC32CTables();
+    static const uint32_t Shift = Tables.getZerosOperator(CRC32CStride);
+    for (; Size >= 3 * CRC32CStride;
+         P += 3 * CRC32CStride, Size -= 3 * CRC32CStride) {
+      uint64_t A = Reg, B = 0, C = 0;
+      for (size_t I = 0; I != CRC32CStride; I += 8) {
+#if defined(__x86_64__) || defined(_M_X64)
+        A = _mm_crc32_u64(A, endian::read<uint64_t, little, unaligned>(P + I));
+        B = _mm_crc32_u64(B, endian::read<uint64_t, little, unaligned>(
+                                 P + CRC32CStride + I));
+        C = _mm_crc32_u64(C, endian::read<uint64_t, little, unaligned>(
+                                 P + 2 * CRC32CStride + I));
+#else
+        for (size_t J = I; J != I + 8; J += 4) {
+          A = _mm_crc32_u32(uint32_t(A),
+                            endian::read<uint32_t, little, unaligned>(P + J));
+          B = _mm_crc32_u32(uint32_t(B), endian::read<uint32_t, little,
+                            unaligned>(P + CRC32CStride + J));
+          C = _mm_crc32_u32(uint32_t(C), endian::read<uint32_t, little,
+                            unaligned>(P + 2 * CRC32CStride + J));
+        }
+#endif
+      }
+      // Appending a stream to a register is shifting the register past the
+      // stream and xoring in the stream's CRC from a zero register.
+      Reg = Tables.multiply(Shift, uint32_t(A)) ^ uint32_t(B);
+      Reg = Tables.multiply(Shift, Reg) ^ uint32_t(C);
+    }
+  }
+  return crc32cStream(P, Size, Reg);
+}
+
+/// crc32Fold - Fold Size bytes at P into Reg with carry-less multiplies.
+/// Size must be a multiple of 16 and at least 64.
+AKJ_CRC_TARGET("sse4.2,pclmul")
+uint32_t crc32Fold(const uint8_t *P, size_t Size, uint32_t Reg) {
+  // The bit reflected constants x^(4*128+32), x^(4*128-32), x^(128+32),
+  // x^(128-32) and x^64 modulo P(x), followed by P(x) and the Barrett
+  // constant floor(x^64 / P(x)).
+  const __m128i K1K2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i K3K4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i K5K0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i Poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i Low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  const __m128i *V = reinterpret_cast<const __m128i *>(P);
+
+  __m128i X1 = _mm_xor_si128(_mm_loadu_si128(V), _mm_cvtsi32_si128(int(Reg)));
+  __m128i X2 = _mm_loadu_si128(V + 1);
+  __m128i X3 = _mm_loadu_si128(V + 2);
+  __m128i X4 = _mm_loadu_si128(V + 3);
+  V += 4;
+  Size -= 64;
+
+  // Fold four lanes at a time.
+  for (; Size >= 64; V += 4, Size -= 64) {
+    __m128i X5 = _mm_clmulepi64_si128(X1, K1K2, 0x00);
+    __m128i X6 = _mm_clmulepi64_si128(X2, K1K2, 0x00);
+    __m128i X7 = _mm_clmulepi64_si128(X3, K1K2, 0x00);
+    __m128i X8 = _mm_clmulepi64_si128(X4, K1K2, 0x00);
+    X1 = _mm_clmulepi64_si128(X1, K1K2, 0x11);
+    X2 = _mm_clmulepi64_si128(X2, K1K2, 0x11);
+    X3 = _mm_clmulepi64_si128(X3, K1K2, 0x11);
+    X4 = _mm_clmulepi64_si128(X4, K1K2, 0x11);
+    X1 = _mm_xor_si128(_mm_xor_si128(X1, X5), _mm_loadu_si128(V));
+    X2 = _mm_xor_si128(_mm_xor_si128(X2, X6), _mm_loadu_si128(V + 1));
+    X3 = _mm_xor_si128(_mm_xor_si128(X3, X7), _mm_loadu_si128(V + 2));
+    X4 = _mm_xor_si128(_mm_xor_si128(X4, X8), _mm_loadu_si128(V + 3));
+  }
+
+  // Fold the four lanes into one, then fold in what is left 16 bytes at a
+  // time.
+  __m128i Lanes[3] = { X2, X3, X4 };
+  for (unsigned I = 0; I != 3; ++I) {
+    __m128i X5 = _mm_clmulepi64_si128(X1, K3K4, 0x00);
+    X1 = _mm_clmulepi64_si128(X1, K3K4, 0x11);
+    X1 = _mm_xor_si128(_mm_xor_si128(X1, Lanes[I]), X5);
+  }
+  for (; Size >= 16; ++V, Size -= 16) {
+    __m128i X5 = _mm_clmulepi64_si128(X1, K3K4, 0x00);
+    X1 = _mm_clmulepi64_si128(X1, K3K4, 0x11);
+    X1 = _mm_xor_si128(_mm_xor_si128(X1, _mm_loadu_si128(V)), X5);
+  }
+
+  // Reduce 128 bits to 64, then Barrett reduce to 32.
+  X2 = _mm_clmulepi64_si128(X1, K3K4, 0x10);
+  X1 = _mm_xor_si128(_mm_srli_si128(X1, 8), X2);
+  X2 = _mm_srli_si128(X1, 4);
+  X1 = _mm_and_si128(X1, Low32);
+  X1 = _mm_xor_si128(_mm_clmulepi64_si128(X1, K5K0, 0x00), X2);
+
+  X2 = _mm_and_si128(X1, Low32);
+  X2 = _mm_clmulepi64_si128(X2, Poly, 0x10);
+  X2 = _mm_and_si128(X2, Low32);
+  X2 = _mm_clmulepi64_si128(X2, Poly, 0x00);
+  X1 = _mm_xor_si128(X1, X2);
+  return uint32_t(_mm_extract_epi32(X1, 1));
+}
+
+#endif // AKJ_CRC_X86
+
+/// updateCRC32 - Run the CRC32 register Reg over Size bytes at P.
+uint32_t updateCRC32(const uint8_t *P, size_t Size, uint32_t Reg) {
+#if AKJ_CRC_X86
+  if (Size >= 64 && getCRCCPUFeatures().PCLMUL) {
+    size_t Folded = Size & ~size_t(15);
+    Reg = crc32Fold(P, Folded, Reg);
+    P += Folded;
+    Size -= Folded;
+  }
+#endif
+  return getCRC32Tables().update(P, Size, Reg);
+}
+
+/// updateCRC32C - Run the CRC32C register Reg over Size bytes at P.
+uint32_t updateCRC32C(const uint8_t *P, size_t Size, uint32_t Reg) {
+#if AKJ_CRC_X86
+  if (getCRCCPUFeatures().SSE42)
+    return crc32cHardware(P, Size, Reg);
+#endif
+  return getCRC32CTables().update(P, Size, Reg);
+}
+
+/// parallelCRC - Checksum Data in chunks on up to NumThreads threads with
+/// Update and stitch the chunk CRCs together.
+uint32_t parallelCRC(cStringRef Data, unsigned NumThreads,
+                     uint32_t (*Update)(const uint8_t *, size_t, uint32_t),
+                     const CRCTables &Tables) {
+  const uint8_t *Bytes = reinterpret_cast<const uint8_t *>(Data.data());
+  size_t NumChunks = (Data.size() + ParallelChunkSize - 1) / ParallelChunkSize;
+  if (NumChunks <= 1 || NumThreads == 1)
+    return ~Update(Bytes, Data.size(), ~0u);
+
+  std::vector<uint32_t> ChunkCRCs(NumChunks);
+  parallel_for(NumChunks, [&](size_t I) {
+    size_t Start = I * ParallelChunkSize;
+    size_t Size = std::min(ParallelChunkSize, Data.size() - Start);
+    ChunkCRCs[I] = ~Update(Bytes + Start, Size, ~0u);
+  }, NumThreads);
+
+  uint32_t CRC = ChunkCRCs[0];
+  for (size_t I = 1; I != NumChunks; ++I)
+    CRC = Tables.combine(CRC, ChunkCRCs[I],
+                         std::min(ParallelChunkSize,
+                                  Data.size() - I * ParallelChunkSize));
+  return CRC;
+}
+
+} // End of anonymous namespace
+
+uint32_t crc::crc32(cStringRef Data, uint32_t CRC) {
+  return ~updateCRC32(reinterpret_cast<const uint8_t *>(Data.data()),
+                      Data.size(), ~CRC);
+}
+
+uint32_t crc::crc32c(cStringRef Data, uint32_t CRC) {
+  return ~updateCRC32C(reinterpret_cast<const uint8_t *>(Data.data()),
+                       Data.size(), ~CRC);
+}
+
+uint32_t crc::crc32_combine(uint32_t CRC1, uint32_t CRC2, uint64_t Len2) {
+  return getCRC32Tables().combine(CRC1, CRC2, Len2);
+}
+
+uint32_t crc::crc32c_combine(uint32_t CRC1, uint32_t CRC2, uint64_t Len2) {
+  return getCRC32CTables().combine(CRC1, CRC2, Len2);
+}
+
+uint32_t crc::crc32_parallel(cStringRef Data, unsigned NumThreads) {
+  return parallelCRC(Data, NumThreads, updateCRC32, getCRC32Tables());
+}
+
+uint32_t crc::crc32c_parallel(cStringRef Data, unsigned NumThreads) {
+  return parallelCRC(Data, NumThreads, updateCRC32C, getCRC32CTables());
+}
+
+bool crc::hasHardwareCRC32() {
+#if AKJ_CRC_X86
+  return getCRCCPUFeatures().PCLMUL;
+#else
+  return false;
+#endif
+}
+
+bool crc::hasHardwareCRC32C() {
+#if AKJ_CRC_X86
+  return getCRCCPUFeatures().SSE42;
+#else
+  return false;
+#endif
+}
+
+} // End of namespace akj
@@ -0,0 +1,57 @@
+//===-- akjCRC.hpp - CRC32 and CRC32C checksums ------------------*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares CRC32 (the zlib/gzip/PNG checksum) and CRC32C (the
+// Castagnoli checksum used by iSCSI, ext4 and SSE4.2). On x86 processors with
+// SSE4.2 and PCLMULQDQ both are computed with hardware instructions, which
+// is several times faster than zlib's tables. The instruction set is picked
+// at run time, and other machines get a portable slicing-by-8 version.
+//
+// Every function takes the CRC of the data so far and returns the CRC with
+// Data appended, starting from 0, so the results match zlib's crc32().
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "StringRef.hpp"
+#include <stdint.h>
+
+namespace akj {
+namespace crc {
+
+/// crc32 - Return the CRC32 of Data appended to data whose CRC32 is CRC.
+uint32_t crc32(cStringRef Data, uint32_t CRC = 0);
+
+/// crc32c - Return the CRC32C of Data appended to data whose CRC32C is CRC.
+uint32_t crc32c(cStringRef Data, uint32_t CRC = 0);
+
+/// crc32_combine - Given the CRC32s of two pieces of data, CRC1 and CRC2,
+/// return the CRC32 of the two pieces one after the other. Len2 is the length
+/// of the second piece. Takes O(log(Len2)) time.
+uint32_t crc32_combine(uint32_t CRC1, uint32_t CRC2, uint64_t Len2);
+
+/// crc32c_combine - The crc32_combine of CRC32C.
+uint32_t crc32c_combine(uint32_t CRC1, uint32_t CRC2, uint64_t Len2);
+
+/// crc32_parallel - Return the CRC32 of Data, checksumming chunks of it on up
+/// to NumThreads threads (all hardware threads if 0) and combining the
+/// results. Meant for large inputs such as mapped files.
+uint32_t crc32_parallel(cStringRef Data, unsigned NumThreads = 0);
+
+/// crc32c_parallel - The crc32_parallel of CRC32C.
+uint32_t crc32c_parallel(cStringRef Data, unsigned NumThreads = 0);
+
+/// hasHardwareCRC32 - Return true if crc32 uses carry-less multiplication.
+bool hasHardwareCRC32();
+
+/// hasHardwareCRC32C - Return true if crc32c uses the SSE4.2 instruction.
+bool hasHardwareCRC32C();
+
+}  // End of namespace crc
+} // End of namespace akj
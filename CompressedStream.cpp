@@ -0,0 +1,624 @@
+//===--- CompressedStream.cpp - Streaming compression ---------------------===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the streaming compression adaptors.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CompressedStream.hpp"
+#include "BlockCompression.hpp"
+#include "Endian.hpp"
+#include "FatalError.hpp"
+#include "FileSystem.hpp"
+#include "MemoryBuffer.hpp"
+#include "lz4.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+
+using namespace akj;
+
+namespace {
+
+const size_t kLZ4HistorySize = 64 * 1024;
+
+// Room for sixteen 64 KB blocks after the history window, so that the window
+// only has to be slid back once per MB of input.
+const size_t kLZ4InputBufferSize = kLZ4HistorySize + 16 * lz4::FrameBlockSize;
+
+// Frame descriptor bits, see the LZ4 frame format description.
+const uint8_t kLZ4FlagVersion = 0x40;
+const uint8_t kLZ4FlagVersionMask = 0xC0;
+const uint8_t kLZ4FlagIndependentBlocks = 0x20;
+const uint8_t kLZ4FlagBlockChecksum = 0x10;
+const uint8_t kLZ4FlagContentSize = 0x08;
+const uint8_t kLZ4FlagContentChecksum = 0x04;
+const uint8_t kLZ4FlagDictID = 0x01;
+const uint32_t kLZ4BlockUncompressed = 0x80000000U;
+const uint32_t kLZ4SkippableMagic = 0x184D2A50;
+const uint32_t kLZ4SkippableMagicMask = 0xFFFFFFF0;
+
+const size_t kZlibBufferSize = 64 * 1024;
+
+/// xxh32Short - The xxHash32 of a buffer shorter than 16 bytes, which is all
+/// the frame format needs for its header checksum.
+uint32_t xxh32Short(const uint8_t *P, size_t Len, uint32_t Seed) {
+  const uint32_t Prime1 = 2654435761U, Prime2 = 2246822519U,
+                 Prime3 = 3266489917U, Prime4 = 668265263U,
+                 Prime5 = 374761393U;
+  assert(Len < 16 && "only the short input path is implemented");
+  uint32_t H = Seed + Prime5 + uint32_t(Len);
+  const uint8_t *End = P + Len;
+  for (; P + 4 <= End; P += 4) {
+    H += support::endian::read<uint32_t, support::little, support::unaligned>(
+        P) * Prime3;
+    H = ((H << 17) | (H >> 15)) * Prime4;
+  }
+  for (; P < End; ++P) {
+    H += *P * Prime5;
+    H = ((H << 11) | (H >> 21)) * Prime1;
+  }
+  H ^= H >> 15;
+  H *= Prime2;
+  H ^= H >> 13;
+  H *= Prime3;
+  H ^= H >> 16;
+  return H;
+}
+
+/// lz4HeaderChecksum - The HC byte that ends an LZ4 frame descriptor.
+uint8_t lz4HeaderChecksum(const uint8_t *Descriptor, size_t Len) {
+  return uint8_t(xxh32Short(Descriptor, Len, 0) >> 8);
+}
+
+void writeLE32(raw_ostream &OS, uint32_t Value) {
+  char Buf[4];
+  support::endian::write<uint32_t, support::little, support::unaligned>(
+      Buf, Value);
+  OS.write(Buf, 4);
+}
+
+uint32_t readLE32(const char *Buf) {
+  return support::endian::read<uint32_t, support::little, support::unaligned>(
+      Buf);
+}
+
+/// readExactly - Decode the output of Streamer straight into a new buffer of
+/// Size bytes. Returns StatusBufferTooShort if the output has another size,
+/// or StatusInvalidData if it is shorter and AtLeastSize says it can't be.
+template<typename StreamerT>
+zlib::Status readExactly(StreamerT &Streamer, size_t Size, bool AtLeastSize,
+                         cStringRef BufferName,
+                         OwningPtr<MemoryBuffer> &Result) {
+  OwningPtr<MemoryBuffer> Buf(
+      MemoryBuffer::getNewUninitMemBuffer(Size, BufferName));
+  if (!Buf)
+    return zlib::StatusOutOfMemory;
+  unsigned char *Out = reinterpret_cast<unsigned char *>(
+      const_cast<char *>(Buf->getBufferStart()));
+  unsigned char Extra;
+  size_t Read = Streamer.GetBytes(Out, Size);
+  bool SizeMatches = Read == Size && Streamer.GetBytes(&Extra, 1) == 0;
+  if (Streamer.has_error() || (Read < Size && AtLeastSize))
+    return zlib::StatusInvalidData;
+  if (!SizeMatches)
+    return zlib::StatusBufferTooShort;
+  Result.swap(Buf);
+  return zlib::StatusOK;
+}
+
+/// readAll - Decode the output of Streamer into pieces that double in size,
+/// then copy them into a new buffer of the right size.
+template<typename StreamerT>
+zlib::Status readAll(StreamerT &Streamer, cStringRef BufferName,
+                     OwningPtr<MemoryBuffer> &Result) {
+  std::vector<OwningArrayPtr<char> > Pieces;
+  std::vector<size_t> PieceSizes;
+  size_t Total = 0;
+  for (size_t PieceSize = 64 * 1024;; PieceSize *= 2) {
+    Pieces.push_back(OwningArrayPtr<char>(new char[PieceSize]));
+    size_t Read = Streamer.GetBytes(
+        reinterpret_cast<unsigned char *>(Pieces.back().get()), PieceSize);
+    PieceSizes.push_back(Read);
+    Total += Read;
+    if (Read < PieceSize)
+      break;
+  }
+  if (Streamer.has_error())
+    return zlib::StatusInvalidData;
+
+  MemoryBuffer *Buf = MemoryBuffer::getNewUninitMemBuffer(Total, BufferName);
+  if (!Buf)
+    return zlib::StatusOutOfMemory;
+  char *Out = const_cast<char *>(Buf->getBufferStart());
+  for (size_t I = 0, E = Pieces.size(); I != E; ++I) {
+    memcpy(Out, Pieces[I].get(), PieceSizes[I]);
+    Out += PieceSizes[I];
+  }
+  Result.reset(Buf);
+  return zlib::StatusOK;
+}
+
+/// The most one byte of input can expand to in each format, which bounds
+/// the size hints that are believed.
+const uint64_t kLZ4MaxExpansion = 255;
+const uint64_t kDeflateMaxExpansion = 1032;
+
+/// readStreamer - Decode everything a fresh streamer over Input produces,
+/// straight into the result if SizeHint turns out to be right. A hint beyond
+/// MaxExpansion times the input can't be, and isn't allocated for. If
+/// AtLeastHint, the format guarantees at least SizeHint bytes of output, so
+/// getting fewer, or a hint that the input can't reach, means the data is
+/// corrupt.
+template<typename StreamerT>
+zlib::Status readStreamer(cStringRef Input, const uint64_t *SizeHint,
+                          uint64_t MaxExpansion, bool AtLeastHint,
+                          cStringRef BufferName,
+                          OwningPtr<MemoryBuffer> &Result) {
+  if (SizeHint) {
+    bool Plausible = *SizeHint / MaxExpansion <= Input.size();
+    if (!Plausible && AtLeastHint)
+      return zlib::StatusInvalidData;
+    if (Plausible && *SizeHint == size_t(*SizeHint)) {
+      StreamerT Streamer(getDataBufferStreamer(Input));
+      zlib::Status Res = readExactly(Streamer, size_t(*SizeHint), AtLeastHint,
+                                     BufferName, Result);
+      if (Res != zlib::StatusBufferTooShort)
+        return Res;
+    }
+  }
+  StreamerT Streamer(getDataBufferStreamer(Input));
+  return readAll(Streamer, BufferName, Result);
+}
+
+} // anonymous namespace
+
+//===----------------------------------------------------------------------===//
+//  raw_lz4_ostream
+//===----------------------------------------------------------------------===//
+
+raw_lz4_ostream::raw_lz4_ostream(raw_ostream &O)
+    : Out(O), InputBuffer(new char[kLZ4InputBufferSize]),
+      CompressedBlock(new char[LZ4_compressBound(lz4::FrameBlockSize)]),
+      LZ4State(0), NextBlock(InputBuffer.get()), BytesIn(0), Closed(false) {
+  LZ4State = LZ4_create(InputBuffer.get());
+  if (!LZ4State)
+    FatalError::Die("Could not allocate the LZ4 stream state!");
+
+  // Linked 64 KB blocks, no checksums.
+  uint8_t Descriptor[3];
+  Descriptor[0] = kLZ4FlagVersion;
+  Descriptor[1] = 4 << 4;
+  Descriptor[2] = lz4HeaderChecksum(Descriptor, 2);
+  writeLE32(Out, lz4::FrameMagic);
+  Out.write(reinterpret_cast<const char *>(Descriptor), sizeof(Descriptor));
+
+  installBuffer();
+}
+
+raw_lz4_ostream::~raw_lz4_ostream() {
+  if (!Closed)
+    close();
+  LZ4_free(LZ4State);
+}
+
+void raw_lz4_ostream::close() {
+  assert(!Closed && "raw_lz4_ostream closed twice!");
+  flush();
+  writeLE32(Out, 0);
+  Closed = true;
+}
+
+void raw_lz4_ostream::installBuffer() {
+  char *End = InputBuffer.get() + kLZ4InputBufferSize;
+  if (size_t(End - NextBlock) < lz4::FrameBlockSize)
+    NextBlock = LZ4_slideInputBuffer(LZ4State);
+  SetBuffer(NextBlock, lz4::FrameBlockSize);
+}
+
+void raw_lz4_ostream::compressBlock(size_t Size) {
+  assert(Size <= lz4::FrameBlockSize && "block too large");
+  // Blocks that don't shrink are stored as they are. The compressor has still
+  // seen them, so later blocks can refer back into them either way.
+  int CompressedSize = LZ4_compress_limitedOutput_continue(
+      LZ4State, NextBlock, CompressedBlock.get(), int(Size), int(Size) - 1);
+  if (CompressedSize > 0) {
+    writeLE32(Out, uint32_t(CompressedSize));
+    Out.write(CompressedBlock.get(), CompressedSize);
+  } else {
+    writeLE32(Out, uint32_t(Size) | kLZ4BlockUncompressed);
+    Out.write(NextBlock, Size);
+  }
+  NextBlock += Size;
+  BytesIn += Size;
+}
+
+void raw_lz4_ostream::write_impl(const char *Ptr, size_t Size) {
+  assert(!Closed && "write to a closed raw_lz4_ostream!");
+  if (Ptr == NextBlock) {
+    // The usual case: the data was written straight into our buffer.
+    compressBlock(Size);
+  } else {
+    // A large write bypassed the buffer, so copy it in one block at a time.
+    while (Size) {
+      char *End = InputBuffer.get() + kLZ4InputBufferSize;
+      if (size_t(End - NextBlock) < lz4::FrameBlockSize)
+        NextBlock = LZ4_slideInputBuffer(LZ4State);
+      size_t BlockSize = std::min(Size, lz4::FrameBlockSize);
+      memcpy(NextBlock, Ptr, BlockSize);
+      compressBlock(BlockSize);
+      Ptr += BlockSize;
+      Size -= BlockSize;
+    }
+  }
+  installBuffer();
+}
+
+//===----------------------------------------------------------------------===//
+//  LZ4DataStreamer
+//===----------------------------------------------------------------------===//
+
+LZ4DataStreamer::LZ4DataStreamer(DataStreamer *Src)
+    : Source(Src), OutputBufferSize(0), ReadPos(0), DecodedPos(0),
+      BlockMaxSize(0), LinkedBlocks(false), BlockChecksums(false),
+      ContentChecksum(false), InFrame(false), AtEnd(false), Error(false) {}
+
+LZ4DataStreamer::~LZ4DataStreamer() {}
+
+bool LZ4DataStreamer::readSource(char *Buf, size_t Size) {
+  while (Size) {
+    size_t Read = Source->GetBytes(reinterpret_cast<unsigned char *>(Buf),
+                                   Size);
+    if (Read == 0 || Read > Size)
+      return false;
+    Buf += Read;
+    Size -= Read;
+  }
+  return true;
+}
+
+bool LZ4DataStreamer::readFrameHeader() {
+  char Buf[16];
+  for (;;) {
+    // Running out of input between frames is the normal end of the stream.
+    if (!readSource(Buf, 4))
+      return false;
+    uint32_t Magic = readLE32(Buf);
+    if ((Magic & kLZ4SkippableMagicMask) == kLZ4SkippableMagic) {
+      if (!readSource(Buf, 4))
+        break;
+      uint32_t Skip = readLE32(Buf);
+      while (Skip) {
+        uint32_t Chunk = std::min<uint32_t>(Skip, sizeof(Buf));
+        if (!readSource(Buf, Chunk))
+          break;
+        Skip -= Chunk;
+      }
+      // A skippable frame that is cut short is corrupt input, not the end
+      // of the stream.
+      if (Skip)
+        break;
+      continue;
+    }
+    if (Magic != lz4::FrameMagic)
+      break;
+
+    uint8_t Descriptor[15];
+    if (!readSource(reinterpret_cast<char *>(Descriptor), 2))
+      break;
+    uint8_t Flags = Descriptor[0];
+    if ((Flags & kLZ4FlagVersionMask) != kLZ4FlagVersion)
+      break;
+    size_t DescriptorSize = 2;
+    if (Flags & kLZ4FlagContentSize)
+      DescriptorSize += 8;
+    if (Flags & kLZ4FlagDictID)
+      DescriptorSize += 4;
+    // The optional fields and the header checksum.
+    if (!readSource(reinterpret_cast<char *>(Descriptor) + 2,
+                    DescriptorSize - 2 + 1))
+      break;
+    if (Descriptor[DescriptorSize] !=
+        lz4HeaderChecksum(Descriptor, DescriptorSize))
+      break;
+
+    unsigned BlockSizeID = (Descriptor[1] >> 4) & 0x7;
+    if (BlockSizeID < 4)
+      break;
+    BlockMaxSize = size_t(1) << (8 + 2 * BlockSizeID);
+    LinkedBlocks = !(Flags & kLZ4FlagIndependentBlocks);
+    BlockChecksums = Flags & kLZ4FlagBlockChecksum;
+    ContentChecksum = Flags & kLZ4FlagContentChecksum;
+
+    // Keep room for a few blocks behind the history window so it doesn't
+    // have to be slid back after every block.
+    size_t WantedSize = kLZ4HistorySize +
+        std::max(BlockMaxSize * 2, kLZ4InputBufferSize - kLZ4HistorySize);
+    if (WantedSize > OutputBufferSize) {
+      OutputBuffer.reset(new char[WantedSize]());
+      OutputBufferSize = WantedSize;
+      CompressedBlock.reset(new char[BlockMaxSize]);
+      ReadPos = DecodedPos = kLZ4HistorySize;
+    }
+    InFrame = true;
+    return true;
+  }
+  Error = true;
+  return false;
+}
+
+bool LZ4DataStreamer::decodeBlock() {
+  assert(ReadPos == DecodedPos && "decoding over unread data");
+  char Buf[4];
+  while (!InFrame) {
+    if (!readFrameHeader())
+      return false;
+  }
+  if (!readSource(Buf, 4)) {
+    Error = true;
+    return false;
+  }
+  uint32_t BlockSize = readLE32(Buf);
+  if (BlockSize == 0) {
+    // End mark. Checksums are not verified, just skipped.
+    InFrame = false;
+    if (ContentChecksum && !readSource(Buf, 4)) {
+      Error = true;
+      return false;
+    }
+    return true;
+  }
+
+  bool Uncompressed = BlockSize & kLZ4BlockUncompressed;
+  BlockSize &= ~kLZ4BlockUncompressed;
+  if (BlockSize > BlockMaxSize) {
+    Error = true;
+    return false;
+  }
+
+  // Slide the last 64 KB of output back to the start of the buffer once there
+  // is no more room for a full block after it.
+  if (DecodedPos + BlockMaxSize > OutputBufferSize) {
+    memmove(OutputBuffer.get(),
+            OutputBuffer.get() + DecodedPos - kLZ4HistorySize,
+            kLZ4HistorySize);
+    ReadPos = DecodedPos = kLZ4HistorySize;
+  }
+
+  char *Dest = OutputBuffer.get() + DecodedPos;
+  int DecodedSize;
+  if (Uncompressed) {
+    DecodedSize = readSource(Dest, BlockSize) ? int(BlockSize) : -1;
+  } else if (!readSource(CompressedBlock.get(), BlockSize)) {
+    DecodedSize = -1;
+  } else if (LinkedBlocks) {
+    DecodedSize = LZ4_decompress_safe_withPrefix64k(
+        CompressedBlock.get(), Dest, int(BlockSize), int(BlockMaxSize));
+  } else {
+    DecodedSize = LZ4_decompress_safe(CompressedBlock.get(), Dest,
+                                      int(BlockSize), int(BlockMaxSize));
+  }
+  if (DecodedSize < 0 || (BlockChecksums && !readSource(Buf, 4))) {
+    Error = true;
+    return false;
+  }
+  DecodedPos += DecodedSize;
+  return true;
+}
+
+size_t LZ4DataStreamer::GetBytes(unsigned char *buf, size_t len) {
+  size_t Copied = 0;
+  while (Copied < len) {
+    if (ReadPos == DecodedPos) {
+      if (AtEnd || !decodeBlock()) {
+        AtEnd = true;
+        break;
+      }
+      continue;
+    }
+    size_t Chunk = std::min(len - Copied, DecodedPos - ReadPos);
+    memcpy(buf + Copied, OutputBuffer.get() + ReadPos, Chunk);
+    ReadPos += Chunk;
+    Copied += Chunk;
+  }
+  return Copied;
+}
+
+//===----------------------------------------------------------------------===//
+//  raw_zlib_ostream
+//===----------------------------------------------------------------------===//
+
+raw_zlib_ostream::raw_zlib_ostream(raw_ostream &O, zlib::CompressionLevel Level,
+                                   zlib::StreamFormat Format)
+    : Out(O), Stream(new z_stream()),
+      CompressedBuffer(new char[kZlibBufferSize]), BytesIn(0), Closed(false),
+      Error(false) {
+  int WindowBits = 15;
+  if (Format == zlib::FormatGzip)
+    WindowBits += 16;
+  else if (Format == zlib::FormatRaw)
+    WindowBits = -WindowBits;
+  if (deflateInit2(Stream.get(), zlib::encodeCompressionLevel(Level),
+                   Z_DEFLATED, WindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    Error = true;
+    Stream.reset();
+  }
+}
+
+raw_zlib_ostream::~raw_zlib_ostream() {
+  if (!Closed)
+    close();
+}
+
+size_t raw_zlib_ostream::preferred_buffer_size() const {
+  return kZlibBufferSize;
+}
+
+void raw_zlib_ostream::deflateInput(int FlushMode) {
+  for (;;) {
+    Stream->next_out = reinterpret_cast<Bytef *>(CompressedBuffer.get());
+    Stream->avail_out = uInt(kZlibBufferSize);
+    int Res = deflate(Stream.get(), FlushMode);
+    size_t Size = kZlibBufferSize - Stream->avail_out;
+    if (Size)
+      Out.write(CompressedBuffer.get(), Size);
+    if (Res == Z_STREAM_END)
+      return;
+    if (Res != Z_OK && Res != Z_BUF_ERROR) {
+      Error = true;
+      return;
+    }
+    // deflate is done with the input once it leaves output space unused.
+    if (Stream->avail_out != 0 && FlushMode != Z_FINISH)
+      return;
+  }
+}
+
+void raw_zlib_ostream::write_impl(const char *Ptr, size_t Size) {
+  assert(!Closed && "write to a closed raw_zlib_ostream!");
+  BytesIn += Size;
+  if (!Stream)
+    return;
+  // avail_in is only 32 bits wide.
+  while (Size) {
+    uInt Chunk = uInt(std::min<size_t>(Size, 1U << 30));
+    Stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(Ptr));
+    Stream->avail_in = Chunk;
+    deflateInput(Z_NO_FLUSH);
+    Ptr += Chunk;
+    Size -= Chunk;
+  }
+}
+
+void raw_zlib_ostream::close() {
+  assert(!Closed && "raw_zlib_ostream closed twice!");
+  flush();
+  if (Stream) {
+    Stream->next_in = 0;
+    Stream->avail_in = 0;
+    deflateInput(Z_FINISH);
+    deflateEnd(Stream.get());
+    Stream.reset();
+  }
+  Closed = true;
+}
+
+//===----------------------------------------------------------------------===//
+//  ZlibDataStreamer
+//===----------------------------------------------------------------------===//
+
+ZlibDataStreamer::ZlibDataStreamer(DataStreamer *Src)
+    : Source(Src), Stream(new z_stream()),
+      CompressedBuffer(new unsigned char[kZlibBufferSize]), StreamEnded(false),
+      AtEnd(false), Error(false) {
+  // 32 added to the window size makes zlib detect zlib and gzip headers.
+  if (inflateInit2(Stream.get(), 15 + 32) != Z_OK) {
+    Error = AtEnd = true;
+    Stream.reset();
+  }
+}
+
+ZlibDataStreamer::~ZlibDataStreamer() {
+  if (Stream)
+    inflateEnd(Stream.get());
+}
+
+size_t ZlibDataStreamer::GetBytes(unsigned char *buf, size_t len) {
+  if (AtEnd)
+    return 0;
+  Stream->next_out = buf;
+  Stream->avail_out = uInt(std::min<size_t>(len, 1U << 30));
+  uInt Wanted = Stream->avail_out;
+  while (Stream->avail_out) {
+    if (Stream->avail_in == 0) {
+      size_t Read = Source->GetBytes(CompressedBuffer.get(), kZlibBufferSize);
+      if (Read == 0 || Read > kZlibBufferSize) {
+        // Running out of input is only fine right after a complete stream.
+        Error = !StreamEnded;
+        AtEnd = true;
+        break;
+      }
+      Stream->next_in = CompressedBuffer.get();
+      Stream->avail_in = uInt(Read);
+    }
+    if (StreamEnded) {
+      // More input after the end of a stream: another gzip member.
+      inflateReset(Stream.get());
+      StreamEnded = false;
+    }
+    int Res = inflate(Stream.get(), Z_NO_FLUSH);
+    if (Res == Z_STREAM_END) {
+      StreamEnded = true;
+    } else if (Res != Z_OK) {
+      Error = AtEnd = true;
+      break;
+    }
+  }
+  return Wanted - Stream->avail_out;
+}
+
+//===----------------------------------------------------------------------===//
+//  uncompressBuffer
+//===----------------------------------------------------------------------===//
+
+zlib::Status akj::uncompressBuffer(cStringRef InputBuffer,
+                                   OwningPtr<MemoryBuffer> &UncompressedBuffer,
+                                   cStringRef BufferName) {
+  return uncompressBuffer(InputBuffer, sys::fs::identify_magic(InputBuffer),
+                          UncompressedBuffer, BufferName);
+}
+
+zlib::Status akj::uncompressBuffer(cStringRef InputBuffer,
+                                   sys::fs::file_magic Format,
+                                   OwningPtr<MemoryBuffer> &UncompressedBuffer,
+                                   cStringRef BufferName) {
+  uint64_t SizeHint;
+  switch (Format) {
+    case sys::fs::file_magic::block_compressed:
+      return blocks::uncompress(InputBuffer, UncompressedBuffer, 0,
+                                BufferName);
+
+    case sys::fs::file_magic::gzip_compressed:
+      // The last member ends with its size modulo 4 GB. That is the size of
+      // the whole output for the usual single member file below 4 GB, and
+      // readStreamer() copes when it isn't.
+      if (InputBuffer.size() < 18)
+        return zlib::StatusInvalidData;
+      SizeHint = readLE32(InputBuffer.end() - 4);
+      return readStreamer<ZlibDataStreamer>(InputBuffer, &SizeHint,
+                                            kDeflateMaxExpansion, false,
+                                            BufferName, UncompressedBuffer);
+
+    case sys::fs::file_magic::zlib_compressed:
+      return readStreamer<ZlibDataStreamer>(InputBuffer, 0,
+                                            kDeflateMaxExpansion, false,
+                                            BufferName, UncompressedBuffer);
+
+    case sys::fs::file_magic::lz4_frame:
+      // The content size, if present, follows the frame flags. It is the
+      // size of the first frame, so more frames may add to it but the output
+      // can't be any shorter.
+      if (InputBuffer.size() >= 14 && readLE32(InputBuffer.data()) ==
+          lz4::FrameMagic && (InputBuffer[4] & kLZ4FlagContentSize)) {
+        SizeHint = support::endian::read<uint64_t, support::little,
+                                         support::unaligned>(
+            InputBuffer.data() + 6);
+        return readStreamer<LZ4DataStreamer>(InputBuffer, &SizeHint,
+                                             kLZ4MaxExpansion, true,
+                                             BufferName, UncompressedBuffer);
+      }
+      return readStreamer<LZ4DataStreamer>(InputBuffer, 0, kLZ4MaxExpansion,
+                                           false, BufferName,
+                                           UncompressedBuffer);
+
+    default:
+      return zlib::StatusInvalidArg;
+  }
+}
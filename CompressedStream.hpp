@@ -0,0 +1,254 @@
+//===-- akjCompressedStream.hpp - Streaming compression ----------*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares raw_ostream and DataStreamer adaptors that compress and
+// uncompress data incrementally, so that inputs and outputs never have to be
+// held in memory all at once.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "CompilerFeatures.hpp"
+#include "Compression.hpp"
+#include "DataStream.hpp"
+#include "FileSystem.hpp"
+#include "OwningPtr.hpp"
+#include "RawOstream.hpp"
+#include <stdint.h>
+
+struct z_stream_s;
+
+namespace akj {
+
+namespace zlib {
+
+/// StreamFormat - The wrapper around the deflate data written by
+/// raw_zlib_ostream.
+enum StreamFormat {
+  FormatZlib,  // zlib header and adler32 trailer (RFC 1950)
+  FormatGzip,  // gzip header and crc32 trailer (RFC 1952)
+  FormatRaw    // bare deflate data (RFC 1951)
+};
+
+}  // End of namespace zlib
+
+namespace lz4 {
+
+/// FrameMagic - The little endian magic number that starts every LZ4 frame.
+const uint32_t FrameMagic = 0x184D2204;
+
+/// FrameBlockSize - The maximum uncompressed block size written by
+/// raw_lz4_ostream (the "64 KB" block maximum of the frame format).
+const size_t FrameBlockSize = 64 * 1024;
+
+}  // End of namespace lz4
+
+/// raw_lz4_ostream - A raw_ostream that compresses everything written to it
+/// into an LZ4 frame and writes the frame to another raw_ostream. Blocks are
+/// linked, so each one can refer back to the previous 64 KB of input, and the
+/// output can be read by any LZ4 frame decoder (including LZ4DataStreamer).
+///
+/// The stream buffer is a window into the compressor's own input buffer, so
+/// data written with operator<< is only copied once. Memory use is bounded
+/// by a little over 1 MB regardless of how much data goes through.
+class raw_lz4_ostream : public raw_ostream {
+  raw_ostream &Out;
+
+  /// InputBuffer - Holds the 64 KB history window followed by the blocks
+  /// that are being filled and compressed.
+  OwningArrayPtr<char> InputBuffer;
+
+  /// CompressedBlock - Scratch space for one compressed block.
+  OwningArrayPtr<char> CompressedBlock;
+
+  /// LZ4State - The opaque LZ4 streaming state, see LZ4_create().
+  void *LZ4State;
+
+  /// NextBlock - Where the next block has to start in InputBuffer.
+  char *NextBlock;
+
+  uint64_t BytesIn;
+  bool Closed;
+
+  /// write_impl - See raw_ostream::write_impl.
+  virtual void write_impl(const char *Ptr, size_t Size) AKJ_OVERRIDE;
+
+  /// current_pos - Return the number of uncompressed bytes that have been
+  /// consumed, not counting the bytes currently in the buffer.
+  virtual uint64_t current_pos() const AKJ_OVERRIDE { return BytesIn; }
+
+  /// compressBlock - Compress the Size bytes at NextBlock and write them out
+  /// as one frame block.
+  void compressBlock(size_t Size);
+
+  /// installBuffer - Point the stream buffer at the free space after
+  /// NextBlock, sliding the history window back first if needed.
+  void installBuffer();
+
+  raw_lz4_ostream(const raw_lz4_ostream &) AKJ_DELETED_FUNCTION;
+  void operator=(const raw_lz4_ostream &) AKJ_DELETED_FUNCTION;
+public:
+  /// Construct a new raw_lz4_ostream and write the frame header to \p O.
+  explicit raw_lz4_ostream(raw_ostream &O);
+  ~raw_lz4_ostream();
+
+  /// close - Flush the stream and terminate the frame. Nothing may be
+  /// written after this. Called by the destructor if needed.
+  void close();
+};
+
+/// LZ4DataStreamer - A DataStreamer that reads LZ4 frames from another
+/// DataStreamer and hands out the uncompressed bytes. Linked and independent
+/// blocks, block sizes up to 4 MB and concatenated frames are supported;
+/// skippable frames are ignored.
+///
+/// Only the history window and a couple of blocks are kept in memory, so this
+/// can sit between getDataFileStreamer() and StreamingMemoryObject to read a
+/// compressed file of any size.
+class LZ4DataStreamer : public DataStreamer {
+  OwningPtr<DataStreamer> Source;
+
+  /// OutputBuffer - The 64 KB history window followed by decoded blocks.
+  OwningArrayPtr<char> OutputBuffer;
+  size_t OutputBufferSize;
+
+  /// CompressedBlock - Scratch space for one compressed block.
+  OwningArrayPtr<char> CompressedBlock;
+
+  /// ReadPos/DecodedPos - Bytes in [ReadPos, DecodedPos) of OutputBuffer have
+  /// been decoded but not yet handed out.
+  size_t ReadPos;
+  size_t DecodedPos;
+
+  size_t BlockMaxSize;
+  bool LinkedBlocks;
+  bool BlockChecksums;
+  bool ContentChecksum;
+  bool InFrame;
+  bool AtEnd;
+  bool Error;
+
+  /// readSource - Read exactly Size bytes from Source. Returns false at end of
+  /// input.
+  bool readSource(char *Buf, size_t Size);
+
+  /// readFrameHeader - Read frame headers, skipping any skippable frames,
+  /// until a data frame starts. Returns false at end of input or on error.
+  bool readFrameHeader();
+
+  /// decodeBlock - Decode the next block of the current frame into
+  /// OutputBuffer. Returns false at end of input or on error.
+  bool decodeBlock();
+
+  LZ4DataStreamer(const LZ4DataStreamer &) AKJ_DELETED_FUNCTION;
+  void operator=(const LZ4DataStreamer &) AKJ_DELETED_FUNCTION;
+public:
+  /// Construct a decoder reading from \p Src, which it takes ownership of.
+  explicit LZ4DataStreamer(DataStreamer *Src);
+  virtual ~LZ4DataStreamer();
+
+  virtual size_t GetBytes(unsigned char *buf, size_t len) AKJ_OVERRIDE;
+
+  /// has_error - Return true if the input was not a well formed LZ4 frame.
+  /// GetBytes reports the end of the stream as soon as an error is found.
+  bool has_error() const { return Error; }
+};
+
+/// raw_zlib_ostream - A raw_ostream that deflates everything written to it
+/// and writes the compressed data to another raw_ostream, a buffer at a time.
+class raw_zlib_ostream : public raw_ostream {
+  raw_ostream &Out;
+  OwningPtr<z_stream_s> Stream;
+  OwningArrayPtr<char> CompressedBuffer;
+  uint64_t BytesIn;
+  bool Closed;
+  bool Error;
+
+  /// write_impl - See raw_ostream::write_impl.
+  virtual void write_impl(const char *Ptr, size_t Size) AKJ_OVERRIDE;
+
+  /// current_pos - Return the number of uncompressed bytes that have been
+  /// consumed, not counting the bytes currently in the buffer.
+  virtual uint64_t current_pos() const AKJ_OVERRIDE { return BytesIn; }
+
+  /// preferred_buffer_size - Hand deflate reasonably large pieces.
+  virtual size_t preferred_buffer_size() const AKJ_OVERRIDE;
+
+  /// deflateInput - Run deflate over whatever input the stream holds with
+  /// the given flush mode, writing out the compressed data as it comes.
+  void deflateInput(int FlushMode);
+
+  raw_zlib_ostream(const raw_zlib_ostream &) AKJ_DELETED_FUNCTION;
+  void operator=(const raw_zlib_ostream &) AKJ_DELETED_FUNCTION;
+public:
+  explicit raw_zlib_ostream(raw_ostream &O,
+                            zlib::CompressionLevel Level =
+                                zlib::DefaultCompression,
+                            zlib::StreamFormat Format = zlib::FormatZlib);
+  ~raw_zlib_ostream();
+
+  /// close - Flush the stream and write the end of the compressed data.
+  /// Nothing may be written after this. Called by the destructor if needed.
+  void close();
+
+  /// has_error - Return true if zlib could not be set up or deflate failed,
+  /// in which case the output is incomplete.
+  bool has_error() const { return Error; }
+};
+
+/// ZlibDataStreamer - A DataStreamer that inflates zlib or gzip data (the
+/// format is detected from the header) read from another DataStreamer.
+/// Concatenated gzip members are read as one stream, like gzip -d does.
+/// Memory use is constant, so it can feed StreamingMemoryObject with
+/// compressed input of any size.
+class ZlibDataStreamer : public DataStreamer {
+  OwningPtr<DataStreamer> Source;
+  OwningPtr<z_stream_s> Stream;
+  OwningArrayPtr<unsigned char> CompressedBuffer;
+
+  /// StreamEnded - True when the last inflate call finished a complete zlib
+  /// stream or gzip member, so running out of input now is not an error.
+  bool StreamEnded;
+  bool AtEnd;
+  bool Error;
+
+  ZlibDataStreamer(const ZlibDataStreamer &) AKJ_DELETED_FUNCTION;
+  void operator=(const ZlibDataStreamer &) AKJ_DELETED_FUNCTION;
+public:
+  /// Construct an inflater reading from \p Src, which it takes ownership of.
+  explicit ZlibDataStreamer(DataStreamer *Src);
+  virtual ~ZlibDataStreamer();
+
+  virtual size_t GetBytes(unsigned char *buf, size_t len) AKJ_OVERRIDE;
+
+  /// has_error - Return true if the input was corrupt or truncated. GetBytes
+  /// reports the end of the stream as soon as an error is found.
+  bool has_error() const { return Error; }
+};
+
+/// uncompressBuffer - Uncompress InputBuffer, which holds gzip, zlib, LZ4
+/// frame or block container data as told by sys::fs::identify_magic, into a
+/// new MemoryBuffer called BufferName. When the format records the
+/// uncompressed size (block containers, single member gzip data and LZ4
+/// frames with a content size) the data is decoded straight into the result.
+/// Otherwise it is decoded in pieces that are copied into the result once.
+/// Returns StatusInvalidArg if InputBuffer isn't compressed data at all.
+zlib::Status uncompressBuffer(cStringRef InputBuffer,
+                              OwningPtr<MemoryBuffer> &UncompressedBuffer,
+                              cStringRef BufferName = "");
+
+/// uncompressBuffer - Like above, but uncompress InputBuffer as Format
+/// instead of identifying it. This is the only way to decode zlib streams,
+/// which identify_magic doesn't recognize.
+zlib::Status uncompressBuffer(cStringRef InputBuffer,
+                              sys::fs::file_magic Format,
+                              OwningPtr<MemoryBuffer> &UncompressedBuffer,
+                              cStringRef BufferName = "");
+
+} // End of namespace akj
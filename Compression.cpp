@@ -12,18 +12,30 @@
 //===----------------------------------------------------------------------===//
 
 #include "Compression.hpp"
+#include "CRC.hpp"
 #include "OwningPtr.hpp"
 #include "StringRef.hpp"
 #include "CompilerFeatures.hpp"
 #include "FatalError.hpp"
 #include "MemoryBuffer.hpp"
+#include "FileOutputBuffer.hpp"
+#include "Parallel.hpp"
+#include "STLExtras.hpp"
+#include "SmallVector.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <mutex>
+#include <string.h>
+#include <vector>
 #include <zlib.h>
 #include "lz4.h"
 
 namespace akj
 {
 
-static int encodeZlibCompressionLevel(zlib::CompressionLevel Level) {
+int zlib::encodeCompressionLevel(CompressionLevel Level) {
   switch (Level) {
     case zlib::NoCompression: return 0;
     case zlib::BestSpeedCompression: return 1;
@@ -45,60 +57,985 @@ static zlib::Status encodeZlibReturnValue(int ReturnValue) {
   return zlib::StatusInvalidArg;
 }
 
+namespace {
+
+/// ContextPool - A free list of codec contexts. Setting up a codec (zlib's
+/// window and hash chains, LZ4's hash table) costs as much as compressing a
+/// small record, so every call borrows a context that is already set up and
+/// only resets it. At most one idle context per hardware thread is kept;
+/// extras made during a burst are freed when they come back.
+template<typename ContextT>
+class ContextPool {
+  std::mutex Lock;
+  std::vector<ContextT *> Free;
+  size_t MaxFree;
+
+public:
+  ContextPool() : MaxFree(hardware_threads()) {}
+  ~ContextPool() { DeleteContainerPointers(Free); }
+
+  ContextT *acquire() {
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      if (!Free.empty()) {
+        ContextT *Context = Free.back();
+        Free.pop_back();
+        return Context;
+      }
+    }
+    return new ContextT();
+  }
+
+  void release(ContextT *Context) {
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      if (Free.size() < MaxFree) {
+        Free.push_back(Context);
+        return;
+      }
+    }
+    delete Context;
+  }
+};
+
+/// PooledContext - Borrow a context from a pool for the current scope.
+template<typename ContextT>
+class PooledContext {
+  ContextPool<ContextT> &Pool;
+  ContextT *Context;
+
+  PooledContext(const PooledContext &) AKJ_DELETED_FUNCTION;
+  void operator=(const PooledContext &) AKJ_DELETED_FUNCTION;
+public:
+  explicit PooledContext(ContextPool<ContextT> &P)
+    : Pool(P), Context(P.acquire()) {}
+  ~PooledContext() { Pool.release(Context); }
+
+  ContextT *operator->() const { return Context; }
+};
+
+/// DeflateContext - A z_stream that is initialized on first use and reset
+/// for every stream after that.
+struct DeflateContext {
+  z_stream Stream;
+  bool Initialized;
+
+  DeflateContext() : Initialized(false) { memset(&Stream, 0, sizeof(Stream)); }
+  ~DeflateContext() {
+    if (Initialized)
+      deflateEnd(&Stream);
+  }
+
+  /// start - Get ready to compress a new stream at the zlib level Level,
+  /// which must be the same on every call.
+  int start(int Level) {
+    if (Initialized)
+      return deflateReset(&Stream);
+    int Res = deflateInit(&Stream, Level);
+    Initialized = Res == Z_OK;
+    return Res;
+  }
+};
+
+/// InflateContext - The DeflateContext of uncompression.
+struct InflateContext {
+  z_stream Stream;
+  bool Initialized;
+
+  InflateContext() : Initialized(false) { memset(&Stream, 0, sizeof(Stream)); }
+  ~InflateContext() {
+    if (Initialized)
+      inflateEnd(&Stream);
+  }
+
+  int start() {
+    if (Initialized)
+      return inflateReset(&Stream);
+    int Res = inflateInit(&Stream);
+    Initialized = Res == Z_OK;
+    return Res;
+  }
+};
+
+/// LZ4Context - Room for LZ4's compression state, see LZ4_sizeofState().
+struct LZ4Context {
+  OwningArrayPtr<uint64_t> State;
+
+  LZ4Context()
+    : State(new uint64_t[(LZ4_sizeofState() + 7) / sizeof(uint64_t)]) {}
+};
+
+/// getDeflatePool - Deflate streams can't change level once they have
+/// started, so every level has its own pool. Level is checked before it is
+/// used as an index, as encodeCompressionLevel checks it.
+ContextPool<DeflateContext> &getDeflatePool(zlib::CompressionLevel Level) {
+  static ContextPool<DeflateContext> Pools[zlib::BestSizeCompression + 1];
+  if (unsigned(Level) > unsigned(zlib::BestSizeCompression))
+    FatalError::Die("Invalid zlib::CompressionLevel!");
+  return Pools[Level];
+}
+
+ContextPool<InflateContext> &getInflatePool() {
+  static ContextPool<InflateContext> Pool;
+  return Pool;
+}
+
+ContextPool<LZ4Context> &getLZ4Pool() {
+  static ContextPool<LZ4Context> Pool;
+  return Pool;
+}
+
+/// runZlib - Drive Stream over all of Input with Fn (deflate or inflate),
+/// writing to Output, and return the last result. zlib counts in 32 bit
+/// units, so larger buffers are handed over in pieces, as compress2 does.
+template<typename FnT>
+int runZlib(z_stream &Stream, cStringRef Input, cMutableArrayRef<char> Output,
+            size_t &OutputLeft, FnT Fn) {
+  size_t InputLeft = Input.size();
+  OutputLeft = Output.size();
+  Stream.next_in = (Bytef *)Input.data();
+  Stream.next_out = (Bytef *)Output.data();
+  Stream.avail_out = 0;
+  int Res;
+  do {
+    Stream.avail_in = uInt(std::min<size_t>(InputLeft, UINT_MAX));
+    InputLeft -= Stream.avail_in;
+    Stream.avail_out = uInt(std::min<size_t>(OutputLeft, UINT_MAX));
+    OutputLeft -= Stream.avail_out;
+    Res = Fn(InputLeft);
+    InputLeft += Stream.avail_in;
+    OutputLeft += Stream.avail_out;
+  } while (Res == Z_OK);
+  return Res;
+}
+
+/// LZ4DictWindow - The distance LZ4 matches can reach back.
+const size_t LZ4DictWindow = 64 * 1024;
+
+/// LZ4DictContext - LZ4's prefix mode needs the dictionary right in front of
+/// the record in memory, so this keeps a buffer that holds the dictionary at
+/// the end of a 64 KB window, followed by room for a record. Bad input can't
+/// make the decoder reach back past the start of the buffer.
+///
+/// Loading the dictionary into the compression state takes a pass over it,
+/// so that is done once and the loaded state is copied for every record. The
+/// state points into the buffer, so it is loaded again if the buffer moves.
+struct LZ4DictContext {
+  std::vector<char> Buffer;
+  OwningArrayPtr<uint64_t> State;
+  OwningArrayPtr<uint64_t> LoadedState;
+  bool Loaded;
+
+  /// MaxKeptRecordSize - Room for records up to this size stays in the
+  /// buffer for the next one. A larger record's room is freed when it is
+  /// done, so that one big record doesn't pin its size in the pool.
+  static const size_t MaxKeptRecordSize = 256 * 1024;
+
+  LZ4DictContext() : Loaded(false) {}
+
+  static size_t getStateSize() {
+    return (LZ4_sizeofStreamState() + 7) / sizeof(uint64_t);
+  }
+
+  /// reserve - Make room for a record of Size bytes after Dict and return
+  /// where it starts.
+  char *reserve(cStringRef Dict, size_t Size) {
+    if (Buffer.size() < LZ4DictWindow + Size) {
+      Buffer.resize(LZ4DictWindow + std::max(Size, 2 * Buffer.size()));
+      memcpy(&Buffer[LZ4DictWindow - Dict.size()], Dict.data(), Dict.size());
+      Loaded = false;
+    }
+    return &Buffer[LZ4DictWindow];
+  }
+
+  /// startCompression - Set State up to compress the record that starts
+  /// right after Dict, which must already be in the buffer.
+  void startCompression(cStringRef Dict) {
+    if (!State) {
+      State.reset(new uint64_t[getStateSize()]);
+      LoadedState.reset(new uint64_t[getStateSize()]);
+    }
+    if (!Loaded) {
+      const char *DictStart = &Buffer[LZ4DictWindow - Dict.size()];
+      LZ4_resetStreamState(LoadedState.get(), DictStart);
+      if (!Dict.empty()) {
+        OwningArrayPtr<char> Discard(
+            new char[LZ4_compressBound(int(Dict.size()))]);
+        LZ4_compress_continue(LoadedState.get(), DictStart, Discard.get(),
+                              int(Dict.size()));
+      }
+      Loaded = true;
+    }
+    memcpy(State.get(), LoadedState.get(), getStateSize() * sizeof(uint64_t));
+  }
+
+  /// finish - Done with the current record; give back oversized room.
+  void finish() {
+    if (Buffer.size() > LZ4DictWindow + MaxKeptRecordSize) {
+      std::vector<char>().swap(Buffer);
+      Loaded = false;
+    }
+  }
+};
+
+typedef ContextPool<LZ4DictContext> LZ4DictPool;
+
+/// finishCompressedBuffer - Cut Buf, which was allocated for the bound, down
+/// to the Size bytes written into it. If that leaves more than a quarter of
+/// it unused, move the data to an exact size buffer so the slack isn't kept
+/// alive with the result.
+void finishCompressedBuffer(OwningPtr<MemoryBuffer> &Buf, size_t Size) {
+  size_t Bound = Buf->getBufferSize();
+  MemoryBuffer::truncateNewMemBuffer(Buf.get(), Size);
+  if (Bound - Size <= Bound / 4)
+    return;
+  MemoryBuffer *Copy = MemoryBuffer::getMemBufferCopy(Buf->getBuffer());
+  // Without memory for the copy, the oversized buffer is still a result.
+  if (Copy)
+    Buf.reset(Copy);
+}
+
+} // End of anonymous namespace
+
+size_t zlib::compressBound(size_t InputSize) {
+  return ::compressBound(uLong(InputSize));
+}
+
 zlib::Status zlib::compress(cStringRef InputBuffer,
                             OwningPtr<MemoryBuffer> &CompressedBuffer,
                             CompressionLevel Level) {
-  unsigned long CompressedSize = ::compressBound(InputBuffer.size());
-  OwningArrayPtr<char> TmpBuffer(new char[CompressedSize]);
-  int CLevel = encodeZlibCompressionLevel(Level);
-  Status Res = encodeZlibReturnValue(::compress2(
-      (Bytef *)TmpBuffer.get(), &CompressedSize,
-      (const Bytef *)InputBuffer.data(), InputBuffer.size(), CLevel));
+  OwningPtr<MemoryBuffer> Buf(
+      MemoryBuffer::getNewUninitMemBuffer(compressBound(InputBuffer.size())));
+  if (!Buf)
+    return StatusOutOfMemory;
+  size_t CompressedSize;
+  Status Res = compress(InputBuffer,
+                        cMutableArrayRef<char>(
+                            const_cast<char *>(Buf->getBufferStart()),
+                            Buf->getBufferSize()),
+                        CompressedSize, Level);
   if (Res == StatusOK) {
-    CompressedBuffer.reset(MemoryBuffer::getMemBufferCopy(
-        cStringRef(TmpBuffer.get(), CompressedSize)));
-    // Tell MSan that memory initialized by zlib is valid.
-    __msan_unpoison(CompressedBuffer->getBufferStart(), CompressedSize);
+    finishCompressedBuffer(Buf, CompressedSize);
+    CompressedBuffer.swap(Buf);
   }
   return Res;
 }
 
+zlib::Status zlib::compress(cStringRef InputBuffer,
+                            cMutableArrayRef<char> OutputBuffer,
+                            size_t &CompressedSize, CompressionLevel Level) {
+  PooledContext<DeflateContext> Context(getDeflatePool(Level));
+  int Res = Context->start(encodeCompressionLevel(Level));
+  if (Res != Z_OK)
+    return encodeZlibReturnValue(Res);
+
+  z_stream &Stream = Context->Stream;
+  size_t OutputLeft;
+  Res = runZlib(Stream, InputBuffer, OutputBuffer, OutputLeft,
+                [&](size_t InputLeft) {
+    return deflate(&Stream, InputLeft ? Z_NO_FLUSH : Z_FINISH);
+  });
+  if (Res != Z_STREAM_END)
+    return encodeZlibReturnValue(Res);
+  CompressedSize = OutputBuffer.size() - OutputLeft;
+  // Tell MSan that memory initialized by zlib is valid.
+  __msan_unpoison(OutputBuffer.data(), CompressedSize);
+  return StatusOK;
+}
+
+zlib::Status zlib::compress(cStringRef InputBuffer,
+                            FileOutputBuffer &OutputBuffer,
+                            size_t &CompressedSize, CompressionLevel Level) {
+  return compress(InputBuffer,
+                  cMutableArrayRef<char>(
+                      (char *)OutputBuffer.getBufferStart(),
+                      size_t(OutputBuffer.getBufferSize())),
+                  CompressedSize, Level);
+}
+
 zlib::Status zlib::uncompress(cStringRef InputBuffer,
                               OwningPtr<MemoryBuffer> &UncompressedBuffer,
                               size_t UncompressedSize) {
-  OwningArrayPtr<char> TmpBuffer(new char[UncompressedSize]);
-  Status Res = encodeZlibReturnValue(
-      ::uncompress((Bytef *)TmpBuffer.get(), (uLongf *)&UncompressedSize,
-                   (const Bytef *)InputBuffer.data(), InputBuffer.size()));
+  OwningPtr<MemoryBuffer> Buf(
+      MemoryBuffer::getNewUninitMemBuffer(UncompressedSize));
+  if (!Buf)
+    return StatusOutOfMemory;
+  Status Res = uncompress(InputBuffer,
+                          cMutableArrayRef<char>(
+                              const_cast<char *>(Buf->getBufferStart()),
+                              UncompressedSize),
+                          UncompressedSize);
   if (Res == StatusOK) {
-    UncompressedBuffer.reset(MemoryBuffer::getMemBufferCopy(
-        cStringRef(TmpBuffer.get(), UncompressedSize)));
-    // Tell MSan that memory initialized by zlib is valid.
-    __msan_unpoison(UncompressedBuffer->getBufferStart(), UncompressedSize);
+    // A short result would leave part of the buffer uninitialized.
+    if (UncompressedSize != Buf->getBufferSize())
+      return StatusInvalidData;
+    UncompressedBuffer.swap(Buf);
   }
   return Res;
 }
 
+zlib::Status zlib::uncompress(cStringRef InputBuffer,
+                              cMutableArrayRef<char> OutputBuffer,
+                              size_t &UncompressedSize) {
+  PooledContext<InflateContext> Context(getInflatePool());
+  int Res = Context->start();
+  if (Res != Z_OK)
+    return encodeZlibReturnValue(Res);
+
+  z_stream &Stream = Context->Stream;
+  size_t OutputLeft;
+  Res = runZlib(Stream, InputBuffer, OutputBuffer, OutputLeft,
+                [&](size_t) { return inflate(&Stream, Z_NO_FLUSH); });
+  if (Res != Z_STREAM_END) {
+    // Running out of input rather than room means the data is truncated; a
+    // preset dictionary is something this interface can't provide.
+    if (Res == Z_NEED_DICT || (Res == Z_BUF_ERROR && OutputLeft))
+      return StatusInvalidData;
+    return encodeZlibReturnValue(Res);
+  }
+  UncompressedSize = OutputBuffer.size() - OutputLeft;
+  // Tell MSan that memory initialized by zlib is valid.
+  __msan_unpoison(OutputBuffer.data(), UncompressedSize);
+  return StatusOK;
+}
+
+zlib::Status zlib::compress(cStringRef InputBuffer,
+                            cMutableArrayRef<char> OutputBuffer,
+                            size_t &CompressedSize,
+                            const CompressionDictionary &Dictionary,
+                            CompressionLevel Level) {
+  PooledContext<DeflateContext> Context(getDeflatePool(Level));
+  int Res = Context->start(encodeCompressionLevel(Level));
+  z_stream &Stream = Context->Stream;
+  cStringRef Dict = Dictionary.getZlibData();
+  // zlib refuses an empty dictionary, so there is nothing to set.
+  if (Res == Z_OK && !Dict.empty())
+    Res = deflateSetDictionary(&Stream, (const Bytef *)Dict.data(),
+                               uInt(Dict.size()));
+  if (Res != Z_OK)
+    return encodeZlibReturnValue(Res);
+
+  size_t OutputLeft;
+  Res = runZlib(Stream, InputBuffer, OutputBuffer, OutputLeft,
+                [&](size_t InputLeft) {
+    return deflate(&Stream, InputLeft ? Z_NO_FLUSH : Z_FINISH);
+  });
+  if (Res != Z_STREAM_END)
+    return encodeZlibReturnValue(Res);
+  CompressedSize = OutputBuffer.size() - OutputLeft;
+  __msan_unpoison(OutputBuffer.data(), CompressedSize);
+  return StatusOK;
+}
+
+zlib::Status zlib::uncompress(cStringRef InputBuffer,
+                              cMutableArrayRef<char> OutputBuffer,
+                              size_t &UncompressedSize,
+                              const CompressionDictionary &Dictionary) {
+  PooledContext<InflateContext> Context(getInflatePool());
+  int Res = Context->start();
+  if (Res != Z_OK)
+    return encodeZlibReturnValue(Res);
+
+  z_stream &Stream = Context->Stream;
+  cStringRef Dict = Dictionary.getZlibData();
+  size_t OutputLeft;
+  Res = runZlib(Stream, InputBuffer, OutputBuffer, OutputLeft, [&](size_t) {
+    int R = inflate(&Stream, Z_NO_FLUSH);
+    // inflateSetDictionary checks the adler32 the stream asks for.
+    if (R == Z_NEED_DICT)
+      R = inflateSetDictionary(&Stream, (const Bytef *)Dict.data(),
+                               uInt(Dict.size()));
+    return R;
+  });
+  if (Res != Z_STREAM_END) {
+    if (Res == Z_NEED_DICT || (Res == Z_BUF_ERROR && OutputLeft))
+      return StatusInvalidData;
+    return encodeZlibReturnValue(Res);
+  }
+  UncompressedSize = OutputBuffer.size() - OutputLeft;
+  __msan_unpoison(OutputBuffer.data(), UncompressedSize);
+  return StatusOK;
+}
+
 uint32_t zlib::crc32(cStringRef Buffer) {
-  return ::crc32(0, (const Bytef *)Buffer.data(), Buffer.size());
+  return crc::crc32(Buffer);
 }
 
 
 	namespace lz4
 	{
+		size_t compressBound(size_t InputSize)
+		{
+			if (InputSize > LZ4_MAX_INPUT_SIZE)
+				return 0;
+			return LZ4_compressBound(int(InputSize));
+		}
+
 		int compress(cStringRef in_buffer,
 			OwningPtr<MemoryBuffer> &CompressedBuffer)
 		{
-			const size_t buf_size = LZ4_compressBound(in_buffer.size());
-			OwningArrayPtr<char> tmp_buf(new char[buf_size]);
-			int compressed_size =
-				LZ4_compress(in_buffer.data(), tmp_buf.get(), in_buffer.size());
-			CompressedBuffer.reset(MemoryBuffer::getMemBufferCopy(
-				cStringRef(tmp_buf.get(), compressed_size)));
-			return compressed_size < 0 ? -1 : compressed_size;
+			const size_t buf_size = compressBound(in_buffer.size());
+			if (buf_size == 0)
+				return -1;
+			OwningPtr<MemoryBuffer> buf(
+				MemoryBuffer::getNewUninitMemBuffer(buf_size));
+			if (!buf)
+				return -1;
+			int compressed_size = compress(in_buffer, cMutableArrayRef<char>(
+				const_cast<char*>(buf->getBufferStart()), buf_size));
+			if (compressed_size < 0)
+				return -1;
+			finishCompressedBuffer(buf, compressed_size);
+			CompressedBuffer.swap(buf);
+			return compressed_size;
+		}
+
+		int compress(cStringRef in_buffer, cMutableArrayRef<char> out_buffer)
+		{
+			if (in_buffer.size() > LZ4_MAX_INPUT_SIZE)
+				return -1;
+			const int in_size = int(in_buffer.size());
+			int compressed_size;
+			// The unchecked compressor is a little faster, so use it whenever
+			// the output is known to fit.
+			// The state comes from a pool so its hash table stays warm in the
+			// cache instead of being set up in a fresh stack frame every call.
+			PooledContext<LZ4Context> context(getLZ4Pool());
+			void *state = context->State.get();
+			if (out_buffer.size() >= compressBound(in_buffer.size()))
+			{
+				compressed_size = LZ4_compress_withState(state,
+					in_buffer.data(), out_buffer.data(), in_size);
+			}
+			else
+			{
+				const int out_size = int(std::min<size_t>(out_buffer.size(),
+					LZ4_MAX_INPUT_SIZE));
+				compressed_size = LZ4_compress_limitedOutput_withState(state,
+					in_buffer.data(), out_buffer.data(), in_size, out_size);
+			}
+			// LZ4 only returns 0 on failure, an empty input still takes a byte.
+			return compressed_size > 0 ? compressed_size : -1;
+		}
+
+		int compress(cStringRef in_buffer, FileOutputBuffer &out_buffer)
+		{
+			return compress(in_buffer, cMutableArrayRef<char>(
+				(char*)out_buffer.getBufferStart(),
+				size_t(out_buffer.getBufferSize())));
+		}
+
+		int uncompress(cStringRef in_buffer,
+			OwningPtr<MemoryBuffer> &UncompressedBuffer,
+			size_t uncompressed_size)
+		{
+			OwningPtr<MemoryBuffer> buf(
+				MemoryBuffer::getNewUninitMemBuffer(uncompressed_size));
+			if (!buf)
+				return -1;
+			int size = uncompress(in_buffer, cMutableArrayRef<char>(
+				const_cast<char*>(buf->getBufferStart()), uncompressed_size));
+			if (size < 0 || size_t(size) != uncompressed_size)
+				return -1;
+			UncompressedBuffer.swap(buf);
+			return size;
+		}
+
+		int uncompress(cStringRef in_buffer, cMutableArrayRef<char> out_buffer)
+		{
+			if (in_buffer.size() > LZ4_MAX_INPUT_SIZE)
+				return -1;
+			const int out_size = int(std::min<size_t>(out_buffer.size(),
+				LZ4_MAX_INPUT_SIZE));
+			int size = LZ4_decompress_safe(in_buffer.data(), out_buffer.data(),
+				int(in_buffer.size()), out_size);
+			return size < 0 ? -1 : size;
+		}
+
+		int compress(cStringRef in_buffer, cMutableArrayRef<char> out_buffer,
+			const CompressionDictionary &dictionary)
+		{
+			if (in_buffer.size() > LZ4_MAX_INPUT_SIZE)
+				return -1;
+			const int in_size = int(in_buffer.size());
+			const int out_size = int(std::min<size_t>(out_buffer.size(),
+				LZ4_MAX_INPUT_SIZE));
+			cStringRef dict = dictionary.getData();
+
+			// The record has to sit right after the dictionary, so it is
+			// copied in; that costs far less than what the dictionary gains.
+			PooledContext<LZ4DictContext> context(
+				*static_cast<LZ4DictPool *>(dictionary.LZ4Pool));
+			char *record = context->reserve(dict, in_buffer.size());
+			memcpy(record, in_buffer.data(), in_buffer.size());
+			context->startCompression(dict);
+			int compressed_size;
+			if (out_buffer.size() >= compressBound(in_buffer.size()))
+			{
+				compressed_size = LZ4_compress_continue(context->State.get(),
+					record, out_buffer.data(), in_size);
+			}
+			else
+			{
+				compressed_size = LZ4_compress_limitedOutput_continue(
+					context->State.get(), record, out_buffer.data(), in_size,
+					out_size);
+			}
+			context->finish();
+			return compressed_size > 0 ? compressed_size : -1;
+		}
+
+		int uncompress(cStringRef in_buffer, cMutableArrayRef<char> out_buffer,
+			const CompressionDictionary &dictionary)
+		{
+			if (in_buffer.size() > LZ4_MAX_INPUT_SIZE)
+				return -1;
+			// Every input byte expands to at most 255 bytes, so a short
+			// record never needs room for all of a large output buffer.
+			const int out_size = int(std::min<size_t>(out_buffer.size(),
+				std::min<size_t>(in_buffer.size() * 255 + 16,
+					LZ4_MAX_INPUT_SIZE)));
+			cStringRef dict = dictionary.getData();
+
+			PooledContext<LZ4DictContext> context(
+				*static_cast<LZ4DictPool *>(dictionary.LZ4Pool));
+			char *record = context->reserve(dict, size_t(out_size));
+			int size = LZ4_decompress_safe_withPrefix64k(in_buffer.data(),
+				record, int(in_buffer.size()), out_size);
+			if (size >= 0)
+				memcpy(out_buffer.data(), record, size_t(size));
+			context->finish();
+			return size < 0 ? -1 : size;
 		}
 	}
 
+namespace {
+
+/// AdaptiveTag - The high nibble of the first header byte; the low nibble
+/// holds the codec.
+const uint8_t AdaptiveTag = 0xA0;
+
+/// The sample chooseCodec looks at: this many slices of this size, spread
+/// evenly over the input.
+const size_t AdaptiveSliceSize = 4 * 1024;
+const unsigned AdaptiveNumSlices = 4;
+
+/// AdaptiveRandomEntropy - Above this many bits per byte the sample is taken
+/// to be compressed already, and no codec is tried on it.
+const double AdaptiveRandomEntropy = 7.9;
+
+/// AdaptiveMinSaving - A codec has to save this fraction of the sample to be
+/// worth running.
+const double AdaptiveMinSaving = 0.03;
+
+/// AdaptiveMinZlibGain - zlib has to beat LZ4's output by this fraction to
+/// be worth running that much slower.
+const double AdaptiveMinZlibGain = 0.10;
+
+/// AdaptiveMaxSize - No header claiming more than this is believed, whatever
+/// the codec.
+const uint64_t AdaptiveMaxSize = uint64_t(1) << 40;
+
+/// getMaxAdaptiveSize - The most that BodySize bytes compressed with C can
+/// uncompress to: stored data is as long as it is, an LZ4 byte can stand
+/// for at most 255 and a deflate byte for at most 1032.
+uint64_t getMaxAdaptiveSize(adaptive::Codec C, size_t BodySize) {
+  uint64_t Max = 0;
+  switch (C) {
+  case adaptive::CodecStore: Max = BodySize; break;
+  case adaptive::CodecLZ4: Max = uint64_t(BodySize) * 255 + 16; break;
+  case adaptive::CodecZlib: Max = uint64_t(BodySize) * 1032; break;
+  }
+  return std::min(Max, AdaptiveMaxSize);
+}
+
+size_t writeAdaptiveHeader(adaptive::Codec C, uint64_t Size, char *Out) {
+  size_t Pos = 0;
+  Out[Pos++] = char(AdaptiveTag | C);
+  do {
+    uint8_t Byte = Size & 0x7f;
+    Size >>= 7;
+    Out[Pos++] = char(Size ? Byte | 0x80 : Byte);
+  } while (Size);
+  return Pos;
+}
+
+zlib::Status readAdaptiveHeader(cStringRef In, adaptive::Codec &C,
+                                uint64_t &Size, size_t &HeaderSize) {
+  if (In.empty() || (uint8_t(In[0]) & 0xf0) != AdaptiveTag ||
+      (uint8_t(In[0]) & 0x0f) > adaptive::CodecZlib)
+    return zlib::StatusInvalidData;
+  C = adaptive::Codec(uint8_t(In[0]) & 0x0f);
+  Size = 0;
+  for (size_t Pos = 1, Shift = 0; Pos < In.size() && Shift < 64;
+       ++Pos, Shift += 7) {
+    uint8_t Byte = uint8_t(In[Pos]);
+    Size |= uint64_t(Byte & 0x7f) << Shift;
+    if (!(Byte & 0x80)) {
+      HeaderSize = Pos + 1;
+      return zlib::StatusOK;
+    }
+  }
+  return zlib::StatusInvalidData;
+}
+
+} // End of anonymous namespace
+
+adaptive::Codec adaptive::chooseCodec(cStringRef Input,
+                                      zlib::CompressionLevel Level,
+                                      unsigned MinMBPerSecond) {
+  if (Level == zlib::NoCompression || Input.empty())
+    return CodecStore;
+
+  cSmallVector<cStringRef, AdaptiveNumSlices> Slices;
+  if (Input.size() <= AdaptiveNumSlices * AdaptiveSliceSize) {
+    Slices.push_back(Input);
+  } else {
+    for (unsigned I = 0; I != AdaptiveNumSlices; ++I) {
+      size_t Start = (Input.size() - AdaptiveSliceSize) * I /
+                     (AdaptiveNumSlices - 1);
+      Slices.push_back(Input.substr(Start, AdaptiveSliceSize));
+    }
+  }
+
+  // Order 0 entropy is enough to spot compressed and encrypted data, which
+  // is most of what isn't worth compressing.
+  size_t Counts[256] = {};
+  size_t SampleSize = 0;
+  for (size_t S = 0, E = Slices.size(); S != E; ++S) {
+    for (size_t I = 0, IE = Slices[S].size(); I != IE; ++I)
+      ++Counts[uint8_t(Slices[S][I])];
+    SampleSize += Slices[S].size();
+  }
+  double Entropy = 0;
+  for (unsigned I = 0; I != 256; ++I) {
+    if (!Counts[I])
+      continue;
+    double P = double(Counts[I]) / SampleSize;
+    Entropy -= P * std::log(P);
+  }
+  if (Entropy / std::log(2.0) > AdaptiveRandomEntropy)
+    return CodecStore;
+
+  // Otherwise compress the sample both ways.
+  std::vector<char> Scratch(std::max(lz4::compressBound(Slices[0].size()),
+                                     zlib::compressBound(Slices[0].size())));
+  size_t LZ4Size = 0, ZlibSize = 0;
+  for (size_t S = 0, E = Slices.size(); S != E; ++S) {
+    int Size = lz4::compress(Slices[S], Scratch);
+    LZ4Size += Size < 0 ? Slices[S].size() : size_t(Size);
+  }
+  std::chrono::steady_clock::time_point Start =
+      std::chrono::steady_clock::now();
+  for (size_t S = 0, E = Slices.size(); S != E; ++S) {
+    size_t Size;
+    if (zlib::compress(Slices[S], Scratch, Size, Level) != zlib::StatusOK)
+      Size = Slices[S].size();
+    ZlibSize += Size;
+  }
+  bool ZlibFastEnough = true;
+  if (MinMBPerSecond) {
+    double Seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - Start).count();
+    ZlibFastEnough = SampleSize >= Seconds * MinMBPerSecond * 1e6;
+  }
+
+  double MaxUseful = SampleSize * (1 - AdaptiveMinSaving);
+  if (ZlibFastEnough && ZlibSize < MaxUseful &&
+      ZlibSize < LZ4Size * (1 - AdaptiveMinZlibGain))
+    return CodecZlib;
+  if (LZ4Size < MaxUseful)
+    return CodecLZ4;
+  return CodecStore;
+}
+
+size_t adaptive::compressBound(size_t InputSize) {
+  return MaxHeaderSize + InputSize;
+}
+
+zlib::Status adaptive::compress(cStringRef InputBuffer,
+                                cMutableArrayRef<char> OutputBuffer,
+                                size_t &CompressedSize,
+                                zlib::CompressionLevel Level,
+                                unsigned MinMBPerSecond) {
+  char Header[MaxHeaderSize];
+  Codec C = chooseCodec(InputBuffer, Level, MinMBPerSecond);
+  size_t HeaderSize = writeAdaptiveHeader(C, InputBuffer.size(), Header);
+  if (OutputBuffer.size() < HeaderSize)
+    return zlib::StatusBufferTooShort;
+
+  // Only output smaller than the input is any use, so that is all the room
+  // the codec gets; if it doesn't manage, the data is stored.
+  cMutableArrayRef<char> Body(OutputBuffer.data() + HeaderSize,
+                              std::min(OutputBuffer.size() - HeaderSize,
+                                       InputBuffer.size()));
+  size_t BodySize = 0;
+  bool Compressed = false;
+  if (C == CodecLZ4) {
+    int Size = lz4::compress(InputBuffer, Body);
+    Compressed = Size >= 0 && size_t(Size) < InputBuffer.size();
+    BodySize = size_t(Size);
+  } else if (C == CodecZlib) {
+    zlib::Status Res = zlib::compress(InputBuffer, Body, BodySize, Level);
+    if (Res != zlib::StatusOK && Res != zlib::StatusBufferTooShort)
+      return Res;
+    Compressed = Res == zlib::StatusOK && BodySize < InputBuffer.size();
+  }
+  if (!Compressed) {
+    C = CodecStore;
+    HeaderSize = writeAdaptiveHeader(C, InputBuffer.size(), Header);
+    if (OutputBuffer.size() < HeaderSize + InputBuffer.size())
+      return zlib::StatusBufferTooShort;
+    // The header can only have the same size, so the body is in place.
+    memcpy(OutputBuffer.data() + HeaderSize, InputBuffer.data(),
+           InputBuffer.size());
+    BodySize = InputBuffer.size();
+  }
+  memcpy(OutputBuffer.data(), Header, HeaderSize);
+  CompressedSize = HeaderSize + BodySize;
+  return zlib::StatusOK;
+}
+
+zlib::Status adaptive::compress(cStringRef InputBuffer,
+                                OwningPtr<MemoryBuffer> &CompressedBuffer,
+                                zlib::CompressionLevel Level,
+                                unsigned MinMBPerSecond) {
+  OwningPtr<MemoryBuffer> Buf(
+      MemoryBuffer::getNewUninitMemBuffer(compressBound(InputBuffer.size())));
+  if (!Buf)
+    return zlib::StatusOutOfMemory;
+  size_t CompressedSize;
+  zlib::Status Res = compress(InputBuffer,
+                              cMutableArrayRef<char>(
+                                  const_cast<char *>(Buf->getBufferStart()),
+                                  Buf->getBufferSize()),
+                              CompressedSize, Level, MinMBPerSecond);
+  if (Res == zlib::StatusOK) {
+    finishCompressedBuffer(Buf, CompressedSize);
+    CompressedBuffer.swap(Buf);
+  }
+  return Res;
+}
+
+zlib::Status adaptive::getUncompressedSize(cStringRef InputBuffer,
+                                           uint64_t &Size) {
+  Codec C;
+  size_t HeaderSize;
+  return readAdaptiveHeader(InputBuffer, C, Size, HeaderSize);
+}
+
+zlib::Status adaptive::getCodec(cStringRef InputBuffer, Codec &C) {
+  uint64_t Size;
+  size_t HeaderSize;
+  return readAdaptiveHeader(InputBuffer, C, Size, HeaderSize);
+}
+
+zlib::Status adaptive::uncompress(cStringRef InputBuffer,
+                                  cMutableArrayRef<char> OutputBuffer,
+                                  size_t &UncompressedSize) {
+  Codec C;
+  uint64_t Size;
+  size_t HeaderSize;
+  zlib::Status Res = readAdaptiveHeader(InputBuffer, C, Size, HeaderSize);
+  if (Res != zlib::StatusOK)
+    return Res;
+  if (OutputBuffer.size() < Size)
+    return zlib::StatusBufferTooShort;
+
+  cStringRef Body = InputBuffer.substr(HeaderSize);
+  cMutableArrayRef<char> Out(OutputBuffer.data(), size_t(Size));
+  size_t Written = 0;
+  switch (C) {
+  case CodecStore:
+    if (Body.size() != Size)
+      return zlib::StatusInvalidData;
+    memcpy(Out.data(), Body.data(), Body.size());
+    Written = Body.size();
+    break;
+  case CodecLZ4: {
+    int Result = lz4::uncompress(Body, Out);
+    if (Result < 0)
+      return zlib::StatusInvalidData;
+    Written = size_t(Result);
+    break;
+  }
+  case CodecZlib:
+    Res = zlib::uncompress(Body, Out, Written);
+    // The output is exactly as big as the header says, so running out of
+    // room means the header or the data is wrong.
+    if (Res == zlib::StatusBufferTooShort)
+      return zlib::StatusInvalidData;
+    if (Res != zlib::StatusOK)
+      return Res;
+    break;
+  }
+  if (Written != Size)
+    return zlib::StatusInvalidData;
+  UncompressedSize = Written;
+  return zlib::StatusOK;
+}
+
+zlib::Status adaptive::uncompress(cStringRef InputBuffer,
+                                  OwningPtr<MemoryBuffer> &UncompressedBuffer) {
+  Codec C;
+  uint64_t Size;
+  size_t HeaderSize;
+  zlib::Status Res = readAdaptiveHeader(InputBuffer, C, Size, HeaderSize);
+  if (Res != zlib::StatusOK)
+    return Res;
+  // Check the size against what the body can hold before allocating it, so
+  // that a few corrupt bytes can't ask for any amount of memory.
+  if (Size > getMaxAdaptiveSize(C, InputBuffer.size() - HeaderSize))
+    return zlib::StatusInvalidData;
+  if (Size != size_t(Size))
+    return zlib::StatusOutOfMemory;
+  OwningPtr<MemoryBuffer> Buf(
+      MemoryBuffer::getNewUninitMemBuffer(size_t(Size)));
+  if (!Buf)
+    return zlib::StatusOutOfMemory;
+  size_t UncompressedSize;
+  Res = uncompress(InputBuffer,
+                   cMutableArrayRef<char>(
+                       const_cast<char *>(Buf->getBufferStart()),
+                       Buf->getBufferSize()),
+                   UncompressedSize);
+  if (Res == zlib::StatusOK)
+    UncompressedBuffer.swap(Buf);
+  return Res;
+}
+
+const size_t CompressionDictionary::MaxSize;
+
+CompressionDictionary::CompressionDictionary(cStringRef Contents)
+  : LZ4Pool(new LZ4DictPool()) {
+  if (Contents.size() > MaxSize)
+    Contents = Contents.substr(Contents.size() - MaxSize);
+  Data.assign(Contents.begin(), Contents.end());
+}
+
+CompressionDictionary::~CompressionDictionary() {
+  delete static_cast<LZ4DictPool *>(LZ4Pool);
+}
+
+cStringRef CompressionDictionary::getData() const {
+  return Data.empty() ? cStringRef() : cStringRef(&Data[0], Data.size());
+}
+
+cStringRef CompressionDictionary::getZlibData() const {
+  // zlib only keeps a 32 KB window, and charges for the rest.
+  cStringRef All = getData();
+  return All.substr(All.size() - std::min<size_t>(All.size(), 32 * 1024));
+}
+
+void CompressionDictionary::train(cArrayRef<cStringRef> Samples,
+                                  cSmallVectorImpl<char> &Dictionary,
+                                  size_t Size) {
+  // Pieces are scored by the 8 byte strings ("k-mers") they contain, each
+  // worth the number of samples it occurs in. The input is split into one
+  // epoch per segment the dictionary has room for, and each epoch
+  // contributes its best segment; the k-mers of a chosen segment are worth
+  // nothing after that, so later segments bring something new.
+  const size_t K = 8;
+  const size_t SegmentSize = 64;
+  const uint32_t NoKmer = ~0u;
+  Dictionary.clear();
+  Size = std::min(Size, MaxSize);
+
+  std::vector<char> All;
+  std::vector<std::pair<uint64_t, uint32_t> > KmerSamples;
+  // Positions whose k-mer would run into the next sample don't count.
+  std::vector<bool> HasKmer;
+  for (size_t S = 0, E = Samples.size(); S != E; ++S) {
+    cStringRef Sample = Samples[S];
+    for (size_t I = 0; I < Sample.size(); ++I) {
+      HasKmer.push_back(I + K <= Sample.size());
+      if (HasKmer.back()) {
+        uint64_t Kmer;
+        memcpy(&Kmer, Sample.data() + I, K);
+        KmerSamples.push_back(std::make_pair(Kmer, uint32_t(S)));
+      }
+    }
+    All.insert(All.end(), Sample.begin(), Sample.end());
+  }
+  if (All.empty())
+    return;
+
+  // Count the samples every k-mer occurs in, and replace each position's
+  // k-mer with its index in the sorted list of distinct k-mers.
+  std::sort(KmerSamples.begin(), KmerSamples.end());
+  KmerSamples.erase(std::unique(KmerSamples.begin(), KmerSamples.end()),
+                    KmerSamples.end());
+  std::vector<uint64_t> Kmers;
+  std::vector<uint32_t> Worth;
+  for (size_t I = 0, E = KmerSamples.size(); I != E; ++I) {
+    if (Kmers.empty() || Kmers.back() != KmerSamples[I].first) {
+      Kmers.push_back(KmerSamples[I].first);
+      Worth.push_back(0);
+    }
+    ++Worth.back();
+  }
+  // A k-mer that only one sample has is no use in a shared dictionary.
+  for (size_t I = 0, E = Worth.size(); I != E; ++I)
+    if (Worth[I] < 2)
+      Worth[I] = 0;
+  std::vector<uint32_t> Ids(All.size(), NoKmer);
+  for (size_t I = 0, E = All.size(); I != E; ++I) {
+    if (!HasKmer[I])
+      continue;
+    uint64_t Kmer;
+    memcpy(&Kmer, &All[I], K);
+    Ids[I] = uint32_t(std::lower_bound(Kmers.begin(), Kmers.end(), Kmer) -
+                      Kmers.begin());
+  }
+
+  size_t NumSegments = std::max<size_t>(Size / SegmentSize, 1);
+  size_t EpochSize = std::max(All.size() / NumSegments, SegmentSize);
+  std::vector<uint32_t> InWindow(Kmers.size());
+  std::vector<std::pair<uint64_t, size_t> > Chosen;  // (score, start)
+  for (size_t Begin = 0; Begin < All.size(); Begin += EpochSize) {
+    size_t End = std::min(Begin + EpochSize, All.size());
+    if (End - Begin < SegmentSize)
+      break;
+
+    // Slide a segment sized window over the epoch, keeping the worth of the
+    // distinct k-mers in it.
+    uint64_t Score = 0, BestScore = 0;
+    size_t BestStart = Begin;
+    for (size_t I = Begin; I != End; ++I) {
+      if (Ids[I] != NoKmer && InWindow[Ids[I]]++ == 0)
+        Score += Worth[Ids[I]];
+      if (I >= Begin + SegmentSize) {
+        size_t Out = I - SegmentSize;
+        if (Ids[Out] != NoKmer && --InWindow[Ids[Out]] == 0)
+          Score -= Worth[Ids[Out]];
+      }
+      if (I + 1 >= Begin + SegmentSize && Score > BestScore) {
+        BestScore = Score;
+        BestStart = I + 1 - SegmentSize;
+      }
+    }
+    for (size_t I = std::max(Begin, End - SegmentSize); I != End; ++I)
+      if (Ids[I] != NoKmer)
+        InWindow[Ids[I]] = 0;
+
+    if (BestScore == 0)
+      continue;
+    for (size_t I = BestStart; I != BestStart + SegmentSize; ++I)
+      if (Ids[I] != NoKmer)
+        Worth[Ids[I]] = 0;
+    Chosen.push_back(std::make_pair(BestScore, BestStart));
+  }
+
+  // The best segments go last, and the weakest are dropped if the segments
+  // don't all fit.
+  std::sort(Chosen.begin(), Chosen.end());
+  size_t First = 0;
+  if (Chosen.size() * SegmentSize > Size)
+    First = Chosen.size() - Size / SegmentSize;
+  for (size_t I = First, E = Chosen.size(); I != E; ++I)
+    Dictionary.append(All.begin() + Chosen[I].second,
+                      All.begin() + Chosen[I].second + SegmentSize);
+}
 
 
 /*
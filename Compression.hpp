@@ -12,12 +12,18 @@
 
 #pragma once
 
+#include "ArrayRef.hpp"
+#include "CompilerFeatures.hpp"
+#include "OwningPtr.hpp"
 #include <stdint.h>
+#include <vector>
 
 namespace akj {
 
+class CompressionDictionary;
+class FileOutputBuffer;
 class MemoryBuffer;
-template<typename T> class OwningPtr;
+template <typename T> class cSmallVectorImpl;
 class cStringRef;
 
 namespace zlib {
@@ -38,23 +44,217 @@ enum Status {
   StatusInvalidData  // data was corrupted or incomplete
 };
 
+/// encodeCompressionLevel - Return the zlib library's numeric equivalent of
+/// Level, for code that drives deflate directly.
+int encodeCompressionLevel(CompressionLevel Level);
+
+/// compressBound - Return the largest size that compressing InputSize bytes
+/// can produce.
+size_t compressBound(size_t InputSize);
+
+/// compress - Compress InputBuffer into a new MemoryBuffer. The compressed
+/// data is written straight into a buffer of compressBound() bytes, which is
+/// only copied to one of the exact size when that saves a lot of memory.
 Status compress(cStringRef InputBuffer,
                 OwningPtr<MemoryBuffer> &CompressedBuffer,
                 CompressionLevel Level = DefaultCompression);
 
+/// compress - Compress InputBuffer into OutputBuffer and set CompressedSize
+/// to the number of bytes written. Returns StatusBufferTooShort if the output
+/// doesn't fit; room for compressBound() bytes is always enough.
+Status compress(cStringRef InputBuffer, cMutableArrayRef<char> OutputBuffer,
+                size_t &CompressedSize,
+                CompressionLevel Level = DefaultCompression);
+
+/// compress - Compress InputBuffer into the start of a FileOutputBuffer. The
+/// caller commits the buffer, passing CompressedSize as the final size.
+Status compress(cStringRef InputBuffer, FileOutputBuffer &OutputBuffer,
+                size_t &CompressedSize,
+                CompressionLevel Level = DefaultCompression);
+
+/// uncompress - Uncompress InputBuffer, which must expand to exactly
+/// UncompressedSize bytes, straight into a new MemoryBuffer.
 Status uncompress(cStringRef InputBuffer,
                   OwningPtr<MemoryBuffer> &UncompressedBuffer,
                   size_t UncompressedSize);
 
+/// uncompress - Uncompress InputBuffer into OutputBuffer and set
+/// UncompressedSize to the number of bytes written.
+Status uncompress(cStringRef InputBuffer, cMutableArrayRef<char> OutputBuffer,
+                  size_t &UncompressedSize);
+
+/// compress - Compress InputBuffer into OutputBuffer against Dictionary,
+/// which must be given again to uncompress it. The output is a zlib stream
+/// that records the dictionary's adler32, so the wrong dictionary is caught.
+Status compress(cStringRef InputBuffer, cMutableArrayRef<char> OutputBuffer,
+                size_t &CompressedSize, const CompressionDictionary &Dictionary,
+                CompressionLevel Level = DefaultCompression);
+
+/// uncompress - Uncompress InputBuffer, which was compressed against
+/// Dictionary, into OutputBuffer.
+Status uncompress(cStringRef InputBuffer, cMutableArrayRef<char> OutputBuffer,
+                  size_t &UncompressedSize,
+                  const CompressionDictionary &Dictionary);
+
+/// crc32 - Return the CRC32 of Buffer, as computed by zlib. This uses the
+/// hardware accelerated crc::crc32 where available.
 uint32_t crc32(cStringRef Buffer);
 
 }  // End of namespace zlib
 
 namespace lz4 {
+	/// compressBound - Return the largest size that compressing InputSize
+	/// bytes can produce, or 0 if the input is too large for LZ4.
+	size_t compressBound(size_t InputSize);
+
+	/// compress - Compress into a new MemoryBuffer, sized as zlib::compress
+	/// sizes it. Returns the compressed size, or -1 on failure.
 	int compress(cStringRef InputBuffer,
 		OwningPtr<MemoryBuffer> &CompressedBuffer);
+
+	/// compress - Compress into OutputBuffer. Returns the compressed size, or
+	/// -1 if it doesn't fit.
+	int compress(cStringRef InputBuffer, cMutableArrayRef<char> OutputBuffer);
+
+	/// compress - Compress into the start of a FileOutputBuffer, which the
+	/// caller then commits with the returned size.
+	int compress(cStringRef InputBuffer, FileOutputBuffer &OutputBuffer);
+
+	/// uncompress - Uncompress into a new MemoryBuffer of exactly
+	/// UncompressedSize bytes. Returns UncompressedSize, or -1 on failure.
+	int uncompress(cStringRef InputBuffer,
+		OwningPtr<MemoryBuffer> &UncompressedBuffer,
+		size_t UncompressedSize);
+
+	/// uncompress - Uncompress into OutputBuffer. Returns the number of bytes
+	/// written, or -1 if the input is malformed or the output doesn't fit.
+	int uncompress(cStringRef InputBuffer, cMutableArrayRef<char> OutputBuffer);
+
+	/// compress - Compress into OutputBuffer as if InputBuffer followed the
+	/// last 64 KB of Dictionary, so it can refer back to it. Returns the
+	/// compressed size, or -1 if it doesn't fit. Nothing in the output says
+	/// which dictionary was used.
+	int compress(cStringRef InputBuffer, cMutableArrayRef<char> OutputBuffer,
+		const CompressionDictionary &Dictionary);
+
+	/// uncompress - Uncompress data compressed against Dictionary into
+	/// OutputBuffer. Returns the number of bytes written, or -1.
+	int uncompress(cStringRef InputBuffer, cMutableArrayRef<char> OutputBuffer,
+		const CompressionDictionary &Dictionary);
 }
 
+/// Adaptive compression picks a codec for each input by looking at a sample
+/// of it, and writes a small header so that uncompress can dispatch on its
+/// own. The header is one byte holding a tag and the codec, followed by the
+/// uncompressed size as a ULEB128 number.
+namespace adaptive {
+
+enum Codec {
+  CodecStore,
+  CodecLZ4,
+  CodecZlib
+};
+
+/// MaxHeaderSize - The most bytes the header can take.
+const size_t MaxHeaderSize = 11;
+
+/// chooseCodec - Estimate how well Input compresses from a few slices of
+/// it, and pick the codec that fits best:
+///   - store if the sample looks random (already compressed data, media),
+///   - zlib at Level if it shrinks the sample clearly more than LZ4 and
+///     compressed the sample at no less than MinMBPerSecond,
+///   - LZ4 otherwise, or store if even LZ4 gains next to nothing.
+/// MinMBPerSecond is a throughput budget for zlib measured on this machine;
+/// 0 means no budget, which also makes the choice deterministic.
+/// NoCompression always picks store.
+Codec chooseCodec(cStringRef Input, zlib::CompressionLevel Level,
+                  unsigned MinMBPerSecond = 0);
+
+/// compressBound - Return the largest size that compressing InputSize bytes
+/// can produce. Data that doesn't shrink is stored, so this is small.
+size_t compressBound(size_t InputSize);
+
+/// compress - Compress InputBuffer with the codec chooseCodec picks into
+/// OutputBuffer and set CompressedSize to the number of bytes written.
+/// Falls back to storing the data if the codec doesn't make it smaller.
+zlib::Status compress(cStringRef InputBuffer,
+                      cMutableArrayRef<char> OutputBuffer,
+                      size_t &CompressedSize,
+                      zlib::CompressionLevel Level = zlib::DefaultCompression,
+                      unsigned MinMBPerSecond = 0);
+
+/// compress - Compress InputBuffer into a new MemoryBuffer.
+zlib::Status compress(cStringRef InputBuffer,
+                      OwningPtr<MemoryBuffer> &CompressedBuffer,
+                      zlib::CompressionLevel Level = zlib::DefaultCompression,
+                      unsigned MinMBPerSecond = 0);
+
+/// getUncompressedSize - Read the uncompressed size from the header of
+/// data written by adaptive::compress.
+zlib::Status getUncompressedSize(cStringRef InputBuffer, uint64_t &Size);
+
+/// getCodec - Read which codec compressed InputBuffer.
+zlib::Status getCodec(cStringRef InputBuffer, Codec &C);
+
+/// uncompress - Uncompress data written by adaptive::compress into
+/// OutputBuffer, which must be at least getUncompressedSize() bytes.
+zlib::Status uncompress(cStringRef InputBuffer,
+                        cMutableArrayRef<char> OutputBuffer,
+                        size_t &UncompressedSize);
+
+/// uncompress - Uncompress data written by adaptive::compress straight into
+/// a new MemoryBuffer of exactly the recorded size.
+zlib::Status uncompress(cStringRef InputBuffer,
+                        OwningPtr<MemoryBuffer> &UncompressedBuffer);
+
+}  // End of namespace adaptive
+
+/// CompressionDictionary - Data that small records are compressed against,
+/// so that even the first bytes of each record can be matched against
+/// something. Records that share field names, keys or markup with the
+/// dictionary compress far better and faster than they would on their own.
+///
+/// A dictionary is immutable and can be used from many threads at once. It
+/// keeps a pool of LZ4 contexts that already have it loaded.
+class CompressionDictionary {
+  std::vector<char> Data;
+
+  /// LZ4Pool - The pool of LZ4 contexts that have this dictionary loaded.
+  /// Its type is private to Compression.cpp.
+  void *LZ4Pool;
+
+  friend int lz4::compress(cStringRef InputBuffer,
+                           cMutableArrayRef<char> OutputBuffer,
+                           const CompressionDictionary &Dictionary);
+  friend int lz4::uncompress(cStringRef InputBuffer,
+                             cMutableArrayRef<char> OutputBuffer,
+                             const CompressionDictionary &Dictionary);
+
+  CompressionDictionary(const CompressionDictionary &) AKJ_DELETED_FUNCTION;
+  void operator=(const CompressionDictionary &) AKJ_DELETED_FUNCTION;
+public:
+  /// MaxSize - The most of a dictionary that any codec can use; LZ4 sees
+  /// the last 64 KB, zlib the last 32 KB.
+  static const size_t MaxSize = 64 * 1024;
+
+  /// Construct a dictionary from the last MaxSize bytes of Contents.
+  explicit CompressionDictionary(cStringRef Contents);
+  ~CompressionDictionary();
+
+  cStringRef getData() const;
+
+  /// getZlibData - The part of the dictionary that fits zlib's window.
+  cStringRef getZlibData() const;
+
+  /// train - Build a dictionary of at most Size bytes out of the pieces of
+  /// Samples that recur across the most samples, in the spirit of zstd's
+  /// COVER algorithm. The pieces found in the most samples go last, where
+  /// both codecs reach them most cheaply. Samples should be representative
+  /// records; a few hundred is plenty.
+  static void train(cArrayRef<cStringRef> Samples,
+                    cSmallVectorImpl<char> &Dictionary, size_t Size = MaxSize);
+};
+
 
 } // End of namespace llvm
 
@@ -0,0 +1,354 @@
+//===-- CompressionFilters.cpp - Pre-compression filters ------------------===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// The SSE2 byte shuffle treats a group of 16 elements as a bit addressed
+// matrix. Interleaving the bytes of two vectors with unpacklo/unpackhi
+// rotates the address bits of the pair by one, so a few rounds of pairwise
+// interleaving move the byte position bits above the element bits (or back).
+//
+//===----------------------------------------------------------------------===//
+
+#include "CompressionFilters.hpp"
+#include "Endian.hpp"
+#include "MathExtras.hpp"
+#include "SmallVector.hpp"
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define AKJ_FILTERS_SSE2 1
+# include <emmintrin.h>
+#else
+# define AKJ_FILTERS_SSE2 0
+#endif
+
+namespace akj {
+
+namespace {
+
+#if AKJ_FILTERS_SSE2
+
+/// interleaveVectors - Run Rounds rounds of interleaving the bytes of
+/// vector J with those of vector J + Count / 2, which rotates the address
+/// bits of the Count * 16 bytes in V left by one per round.
+void interleaveVectors(__m128i *V, size_t Count, unsigned Rounds) {
+  __m128i T[16];
+  size_t Half = Count / 2;
+  for (unsigned R = 0; R != Rounds; ++R) {
+    for (size_t J = 0; J != Half; ++J) {
+      T[2 * J] = _mm_unpacklo_epi8(V[J], V[J + Half]);
+      T[2 * J + 1] = _mm_unpackhi_epi8(V[J], V[J + Half]);
+    }
+    for (size_t J = 0; J != Count; ++J)
+      V[J] = T[J];
+  }
+}
+
+#endif // AKJ_FILTERS_SSE2
+
+/// canInterleave - The vector shuffles work on 16 elements of a power of two
+/// size up to 16 bytes at a time.
+inline bool canInterleave(size_t ElementSize) {
+  return AKJ_FILTERS_SSE2 && ElementSize <= 16 &&
+         isPowerOf2_64(ElementSize);
+}
+
+/// transposeBits - Transpose the 8x8 bit matrix whose rows are the bytes of
+/// X (Hacker's Delight 7-3). Its own inverse.
+inline uint64_t transposeBits(uint64_t X) {
+  uint64_t T;
+  T = (X ^ (X >> 7)) & 0x00AA00AA00AA00AAULL;
+  X = X ^ T ^ (T << 7);
+  T = (X ^ (X >> 14)) & 0x0000CCCC0000CCCCULL;
+  X = X ^ T ^ (T << 14);
+  T = (X ^ (X >> 28)) & 0x00000000F0F0F0F0ULL;
+  X = X ^ T ^ (T << 28);
+  return X;
+}
+
+/// bitShufflePlane - Write bit B of every byte of the Size bytes at In
+/// (a multiple of 8) to the B'th eighth of Out.
+void bitShufflePlane(const char *In, size_t Size, char *Out) {
+  using namespace support;
+  size_t Groups = Size / 8, G = 0;
+#if AKJ_FILTERS_SSE2
+  // movemask collects the top bit of every byte; shifting brings the next
+  // bit up.
+  for (; G + 2 <= Groups; G += 2) {
+    __m128i V = _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + 8 * G));
+    for (unsigned B = 8; B-- != 0;) {
+      unsigned Mask = unsigned(_mm_movemask_epi8(V));
+      Out[B * Groups + G] = char(Mask & 0xff);
+      Out[B * Groups + G + 1] = char(Mask >> 8);
+      V = _mm_slli_epi16(V, 1);
+    }
+  }
+#endif
+  for (; G != Groups; ++G) {
+    uint64_t Bits =
+        transposeBits(endian::read<uint64_t, little, unaligned>(In + 8 * G));
+    for (unsigned B = 0; B != 8; ++B)
+      Out[B * Groups + G] = char(Bits >> (8 * B));
+  }
+}
+
+/// bitUnshufflePlane - Undo bitShufflePlane.
+void bitUnshufflePlane(const char *In, size_t Size, char *Out) {
+  using namespace support;
+  size_t Groups = Size / 8;
+  for (size_t G = 0; G != Groups; ++G) {
+    uint64_t Bits = 0;
+    for (unsigned B = 0; B != 8; ++B)
+      Bits |= uint64_t(uint8_t(In[B * Groups + G])) << (8 * B);
+    endian::write<uint64_t, little, unaligned>(Out + 8 * G,
+                                               transposeBits(Bits));
+  }
+}
+
+/// deltaEncodeImpl - Delta encode elements [Begin, Count) of In.
+template<typename T>
+void deltaEncodeImpl(const char *In, size_t Begin, size_t Count, char *Out) {
+  using namespace support;
+  T Prev = Begin ? endian::read<T, little, unaligned>(In + (Begin - 1) *
+                                                           sizeof(T))
+                 : T(0);
+  for (size_t I = Begin; I != Count; ++I) {
+    T Cur = endian::read<T, little, unaligned>(In + I * sizeof(T));
+    endian::write<T, little, unaligned>(Out + I * sizeof(T), T(Cur - Prev));
+    Prev = Cur;
+  }
+}
+
+template<typename T>
+void deltaDecodeImpl(const char *In, size_t Count, char *Out) {
+  using namespace support;
+  T Sum = 0;
+  for (size_t I = 0; I != Count; ++I) {
+    Sum += endian::read<T, little, unaligned>(In + I * sizeof(T));
+    endian::write<T, little, unaligned>(Out + I * sizeof(T), Sum);
+  }
+}
+
+typedef void (*FilterFn)(cStringRef, size_t, char *);
+
+/// runChain - Run Fns over Input one after the other, alternating between
+/// Output and a scratch buffer so that the last one writes to Output.
+void runChain(const FilterFn *Fns, size_t NumFns, size_t ElementSize,
+              cStringRef Input, char *Output) {
+  // Empty input may come with null pointers, which memcpy can't take.
+  if (Input.empty())
+    return;
+  if (NumFns == 0) {
+    memcpy(Output, Input.data(), Input.size());
+    return;
+  }
+  std::vector<char> Scratch(NumFns > 1 ? Input.size() : 0);
+  cStringRef Cur = Input;
+  for (size_t I = 0; I != NumFns; ++I) {
+    char *Dest = (NumFns - 1 - I) % 2 == 0 ? Output : Scratch.data();
+    Fns[I](Cur, ElementSize, Dest);
+    Cur = cStringRef(Dest, Input.size());
+  }
+}
+
+} // End of anonymous namespace
+
+void filters::byteShuffle(cStringRef Input, size_t ElementSize,
+                          char *Output) {
+  if (Input.empty())
+    return;
+  const char *In = Input.data();
+  if (ElementSize <= 1) {
+    memcpy(Output, In, Input.size());
+    return;
+  }
+  size_t Count = Input.size() / ElementSize;
+  size_t E = 0;
+#if AKJ_FILTERS_SSE2
+  if (canInterleave(ElementSize)) {
+    // Four rounds move the four element bits below the byte position bits.
+    __m128i V[16];
+    for (; E + 16 <= Count; E += 16) {
+      for (size_t B = 0; B != ElementSize; ++B)
+        V[B] = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(In + E * ElementSize + 16 * B));
+      interleaveVectors(V, ElementSize, 4);
+      for (size_t B = 0; B != ElementSize; ++B)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(Output + B * Count + E),
+                         V[B]);
+    }
+  }
+#endif
+  for (; E != Count; ++E)
+    for (size_t B = 0; B != ElementSize; ++B)
+      Output[B * Count + E] = In[E * ElementSize + B];
+  memcpy(Output + E * ElementSize, In + E * ElementSize,
+         Input.size() - E * ElementSize);
+}
+
+void filters::byteUnshuffle(cStringRef Input, size_t ElementSize,
+                            char *Output) {
+  if (Input.empty())
+    return;
+  const char *In = Input.data();
+  if (ElementSize <= 1) {
+    memcpy(Output, In, Input.size());
+    return;
+  }
+  size_t Count = Input.size() / ElementSize;
+  size_t E = 0;
+#if AKJ_FILTERS_SSE2
+  if (canInterleave(ElementSize)) {
+    // Here the byte position bits start on top, and log2(ElementSize)
+    // rounds move them down.
+    __m128i V[16];
+    unsigned Rounds = Log2_64(ElementSize);
+    for (; E + 16 <= Count; E += 16) {
+      for (size_t B = 0; B != ElementSize; ++B)
+        V[B] = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(In + B * Count + E));
+      interleaveVectors(V, ElementSize, Rounds);
+      for (size_t B = 0; B != ElementSize; ++B)
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(Output + E * ElementSize + 16 * B),
+            V[B]);
+    }
+  }
+#endif
+  for (; E != Count; ++E)
+    for (size_t B = 0; B != ElementSize; ++B)
+      Output[E * ElementSize + B] = In[B * Count + E];
+  memcpy(Output + E * ElementSize, In + E * ElementSize,
+         Input.size() - E * ElementSize);
+}
+
+void filters::bitShuffle(cStringRef Input, size_t ElementSize, char *Output) {
+  if (Input.empty())
+    return;
+  size_t Count = ElementSize ? Input.size() / ElementSize : 0;
+  size_t Count8 = Count & ~size_t(7);
+  size_t Size8 = Count8 * ElementSize;
+  if (Count8) {
+    std::vector<char> Bytes(Size8);
+    byteShuffle(Input.substr(0, Size8), ElementSize, &Bytes[0]);
+    for (size_t B = 0; B != ElementSize; ++B)
+      bitShufflePlane(&Bytes[B * Count8], Count8, Output + B * Count8);
+  }
+  memcpy(Output + Size8, Input.data() + Size8, Input.size() - Size8);
+}
+
+void filters::bitUnshuffle(cStringRef Input, size_t ElementSize,
+                           char *Output) {
+  if (Input.empty())
+    return;
+  size_t Count = ElementSize ? Input.size() / ElementSize : 0;
+  size_t Count8 = Count & ~size_t(7);
+  size_t Size8 = Count8 * ElementSize;
+  if (Count8) {
+    std::vector<char> Bytes(Size8);
+    for (size_t B = 0; B != ElementSize; ++B)
+      bitUnshufflePlane(Input.data() + B * Count8, Count8, &Bytes[B * Count8]);
+    byteUnshuffle(cStringRef(&Bytes[0], Size8), ElementSize, Output);
+  }
+  memcpy(Output + Size8, Input.data() + Size8, Input.size() - Size8);
+}
+
+void filters::deltaEncode(cStringRef Input, size_t ElementSize,
+                          char *Output) {
+  if (Input.empty())
+    return;
+  size_t Count = ElementSize ? Input.size() / ElementSize : 0;
+  size_t Size = Count * ElementSize;
+  const char *In = Input.data();
+  size_t Done = 0;
+#if AKJ_FILTERS_SSE2
+  // Every difference is independent, so whole vectors of elements can be
+  // subtracted from the vectors one element earlier.
+  if (ElementSize <= 8 && isPowerOf2_64(ElementSize) && Size >= ElementSize) {
+    memcpy(Output, In, ElementSize);
+    Done = ElementSize;
+    for (; Done + 16 <= Size; Done += 16) {
+      __m128i Cur =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(In + Done));
+      __m128i Prev = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(In + Done - ElementSize));
+      __m128i Diff;
+      switch (ElementSize) {
+      case 1: Diff = _mm_sub_epi8(Cur, Prev); break;
+      case 2: Diff = _mm_sub_epi16(Cur, Prev); break;
+      case 4: Diff = _mm_sub_epi32(Cur, Prev); break;
+      default: Diff = _mm_sub_epi64(Cur, Prev); break;
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(Output + Done), Diff);
+    }
+  }
+#endif
+  switch (ElementSize) {
+  case 1: deltaEncodeImpl<uint8_t>(In, Done, Count, Output); break;
+  case 2: deltaEncodeImpl<uint16_t>(In, Done / 2, Count, Output); break;
+  case 4: deltaEncodeImpl<uint32_t>(In, Done / 4, Count, Output); break;
+  case 8: deltaEncodeImpl<uint64_t>(In, Done / 8, Count, Output); break;
+  default:
+    // Other sizes (structs, 3 byte samples, ...) are differenced bytewise
+    // against the same byte of the previous element.
+    for (size_t I = 0; I != Size; ++I)
+      Output[I] = char(I < ElementSize ? In[I] : In[I] - In[I - ElementSize]);
+    break;
+  }
+  memcpy(Output + Size, In + Size, Input.size() - Size);
+}
+
+void filters::deltaDecode(cStringRef Input, size_t ElementSize,
+                          char *Output) {
+  if (Input.empty())
+    return;
+  size_t Count = ElementSize ? Input.size() / ElementSize : 0;
+  size_t Size = Count * ElementSize;
+  const char *In = Input.data();
+  switch (ElementSize) {
+  case 1: deltaDecodeImpl<uint8_t>(In, Count, Output); break;
+  case 2: deltaDecodeImpl<uint16_t>(In, Count, Output); break;
+  case 4: deltaDecodeImpl<uint32_t>(In, Count, Output); break;
+  case 8: deltaDecodeImpl<uint64_t>(In, Count, Output); break;
+  default:
+    for (size_t I = 0; I != Size; ++I)
+      Output[I] = char(I < ElementSize ? In[I]
+                                       : In[I] + Output[I - ElementSize]);
+    break;
+  }
+  memcpy(Output + Size, In + Size, Input.size() - Size);
+}
+
+void filters::applyFilters(cArrayRef<Filter> Filters, size_t ElementSize,
+                           cStringRef Input, char *Output) {
+  cSmallVector<FilterFn, 4> Chain(Filters.size());
+  for (size_t I = 0, E = Filters.size(); I != E; ++I) {
+    switch (Filters[I]) {
+    case FilterByteShuffle: Chain[I] = byteShuffle; break;
+    case FilterBitShuffle: Chain[I] = bitShuffle; break;
+    case FilterDelta: Chain[I] = deltaEncode; break;
+    }
+  }
+  runChain(Chain.data(), Chain.size(), ElementSize, Input, Output);
+}
+
+void filters::removeFilters(cArrayRef<Filter> Filters, size_t ElementSize,
+                            cStringRef Input, char *Output) {
+  cSmallVector<FilterFn, 4> Chain(Filters.size());
+  for (size_t I = 0, E = Filters.size(); I != E; ++I) {
+    switch (Filters[E - 1 - I]) {
+    case FilterByteShuffle: Chain[I] = byteUnshuffle; break;
+    case FilterBitShuffle: Chain[I] = bitUnshuffle; break;
+    case FilterDelta: Chain[I] = deltaDecode; break;
+    }
+  }
+  runChain(Chain.data(), Chain.size(), ElementSize, Input, Output);
+}
+
+} // End of namespace akj
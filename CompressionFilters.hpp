@@ -0,0 +1,75 @@
+//===-- akjCompressionFilters.hpp - Pre-compression filters ------*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares reversible filters for arrays of fixed size elements,
+// such as little endian integers and floats. Run in front of lz4::compress
+// or zlib::compress, they turn slowly changing numbers into long runs of
+// equal bytes that LZ4 and zlib do well on.
+//
+//   - Byte shuffle stores the first byte of every element, then the second
+//     byte of every element, and so on. High bytes that rarely change end up
+//     next to each other.
+//   - Bit shuffle goes further and groups the bits of each byte position.
+//   - Delta stores the difference between each element and the one before
+//     it, so sorted keys and timestamps become small numbers.
+//
+// Every filter maps Size bytes to Size bytes. Bytes after the last whole
+// element are passed through, so does anything a filter can't group.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "ArrayRef.hpp"
+#include "StringRef.hpp"
+#include <stddef.h>
+
+namespace akj {
+namespace filters {
+
+enum Filter {
+  FilterByteShuffle,
+  FilterBitShuffle,
+  FilterDelta
+};
+
+/// byteShuffle - Write the bytes of the ElementSize byte elements in Input
+/// to Output grouped by their position in the element.
+void byteShuffle(cStringRef Input, size_t ElementSize, char *Output);
+
+/// byteUnshuffle - Undo byteShuffle.
+void byteUnshuffle(cStringRef Input, size_t ElementSize, char *Output);
+
+/// bitShuffle - Byte shuffle Input, then group the bits of each byte
+/// position as well. Elements are handled eight at a time; any left over are
+/// passed through.
+void bitShuffle(cStringRef Input, size_t ElementSize, char *Output);
+
+/// bitUnshuffle - Undo bitShuffle.
+void bitUnshuffle(cStringRef Input, size_t ElementSize, char *Output);
+
+/// deltaEncode - Replace every element but the first with its difference
+/// from the element before it. Elements of 1, 2, 4 and 8 bytes are treated
+/// as little endian integers; other sizes are differenced bytewise.
+void deltaEncode(cStringRef Input, size_t ElementSize, char *Output);
+
+/// deltaDecode - Undo deltaEncode.
+void deltaDecode(cStringRef Input, size_t ElementSize, char *Output);
+
+/// applyFilters - Run Input through Filters, first to last, and write the
+/// result to Output, which must not overlap Input. Delta followed by a
+/// shuffle is usually the best chain for numeric columns.
+void applyFilters(cArrayRef<Filter> Filters, size_t ElementSize,
+                  cStringRef Input, char *Output);
+
+/// removeFilters - Undo applyFilters with the same Filters.
+void removeFilters(cArrayRef<Filter> Filters, size_t ElementSize,
+                   cStringRef Input, char *Output);
+
+}  // End of namespace filters
+} // End of namespace akj
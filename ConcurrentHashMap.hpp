@@ -0,0 +1,303 @@
+//===-- akjConcurrentHashMap.hpp - Sharded thread-safe hash map --*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines ConcurrentHashMap, a hash map that any number of threads
+// may use at once.
+//
+// The map is split into a power of two number of shards, each a FlatHashMap
+// behind its own reader-writer lock. A key's hash, from the map's info class
+// (by default hash_value from Hashing.hpp), picks its shard and is then reused
+// by the shard's table, so every key is hashed once per operation. Lookups
+// take their shard's lock shared, so readers only ever wait for a writer of
+// the same shard, and with several shards per thread that is rare. The locks
+// are spin locks that yield, which suits the short critical sections here.
+//
+// Values are copied out rather than returned by reference, since another
+// thread may erase or move them as soon as the lock is released.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "CompilerFeatures.hpp"
+#include "FlatHashSet.hpp"
+#include "Hashing.hpp"
+#include "Parallel.hpp"
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace akj {
+
+namespace concurrent_detail {
+
+/// SharedSpinLock - A reader-writer spin lock. A waiting writer keeps new
+/// readers out, so a steady stream of readers can't starve it.
+class SharedSpinLock {
+  enum {
+    WriterHeld = 1u << 31,
+    WriterWaiting = 1u << 30,
+    ReaderMask = WriterWaiting - 1
+  };
+  std::atomic<unsigned> State;
+
+  static void backoff(unsigned &Spins) {
+    if (++Spins >= 64) {
+      std::this_thread::yield();
+      Spins = 0;
+    }
+  }
+
+  SharedSpinLock(const SharedSpinLock &) AKJ_DELETED_FUNCTION;
+  void operator=(const SharedSpinLock &) AKJ_DELETED_FUNCTION;
+
+public:
+  SharedSpinLock() : State(0) {}
+
+  void lock_shared() {
+    unsigned Spins = 0;
+    while (true) {
+      unsigned S = State.load(std::memory_order_relaxed);
+      if (!(S & (WriterHeld | WriterWaiting)) &&
+          State.compare_exchange_weak(S, S + 1, std::memory_order_acquire,
+                                      std::memory_order_relaxed))
+        return;
+      backoff(Spins);
+    }
+  }
+
+  void unlock_shared() {
+    State.fetch_sub(1, std::memory_order_release);
+  }
+
+  void lock() {
+    unsigned Spins = 0;
+    while (true) {
+      unsigned S = State.load(std::memory_order_relaxed);
+      if (!(S & (WriterHeld | ReaderMask))) {
+        // Free, perhaps with writers waiting (this one among them). Other
+        // waiting writers set their flag again on their next try.
+        if (State.compare_exchange_weak(S, WriterHeld,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed))
+          return;
+      } else if (!(S & WriterWaiting)) {
+        State.fetch_or(WriterWaiting, std::memory_order_relaxed);
+      }
+      backoff(Spins);
+    }
+  }
+
+  void unlock() {
+    State.fetch_and(~unsigned(WriterHeld), std::memory_order_release);
+  }
+};
+
+/// SharedGuard - Holds a SharedSpinLock shared for its lifetime.
+class SharedGuard {
+  SharedSpinLock &Lock;
+
+  SharedGuard(const SharedGuard &) AKJ_DELETED_FUNCTION;
+  void operator=(const SharedGuard &) AKJ_DELETED_FUNCTION;
+
+public:
+  explicit SharedGuard(SharedSpinLock &L) : Lock(L) { Lock.lock_shared(); }
+  ~SharedGuard() { Lock.unlock_shared(); }
+};
+
+/// HashedKey - A key together with its hash, so that a shard's table can
+/// look it up without hashing it again.
+template<typename KeyT>
+struct HashedKey {
+  const KeyT &Key;
+  size_t Hash;
+
+  HashedKey(const KeyT &Key, size_t Hash) : Key(Key), Hash(Hash) {}
+};
+
+/// HashedKeyInfo - The info class of a shard's table. It hashes stored keys
+/// with InfoT, and takes the hash of a HashedKey from the key.
+template<typename KeyT, typename InfoT>
+struct HashedKeyInfo {
+  static hash_code getHashValue(const KeyT &Key) {
+    return hash_code(size_t(InfoT::getHashValue(Key)));
+  }
+  static hash_code getHashValue(const HashedKey<KeyT> &HK) {
+    return hash_code(HK.Hash);
+  }
+  static bool isEqual(const KeyT &LHS, const KeyT &RHS) {
+    return InfoT::isEqual(LHS, RHS);
+  }
+  static bool isEqual(const HashedKey<KeyT> &LHS, const KeyT &RHS) {
+    return InfoT::isEqual(LHS.Key, RHS);
+  }
+};
+
+} // end namespace concurrent_detail
+
+/// ConcurrentHashMap - A thread-safe map from KeyT to ValueT. All members may
+/// be called concurrently. KeyT and ValueT must be copyable.
+template<typename KeyT, typename ValueT, typename InfoT = FlatHashInfo<KeyT> >
+class ConcurrentHashMap {
+  typedef concurrent_detail::HashedKey<KeyT> HashedKeyTy;
+  typedef FlatHashMap<KeyT, ValueT,
+                      concurrent_detail::HashedKeyInfo<KeyT, InfoT> > TableTy;
+
+  struct Shard {
+    mutable concurrent_detail::SharedSpinLock Lock;
+    TableTy Table;
+    // Keep the next shard's lock off this shard's cache line.
+    char Padding[64];
+  };
+
+  Shard *Shards;
+  unsigned ShardBits;
+
+  ConcurrentHashMap(const ConcurrentHashMap &) AKJ_DELETED_FUNCTION;
+  void operator=(const ConcurrentHashMap &) AKJ_DELETED_FUNCTION;
+
+  static size_t hashOf(const KeyT &Key) {
+    return size_t(InfoT::getHashValue(Key));
+  }
+
+  /// shardFor - Pick a shard by the top bits of the hash, multiplied first
+  /// so that a narrow hash still reaches them. The shard's table probes with
+  /// the low bits.
+  Shard &shardFor(size_t Hash) const {
+    if (ShardBits == 0)
+      return Shards[0];
+    uint64_t Mixed = uint64_t(Hash) * 0x9E3779B97F4A7C15ULL;
+    return Shards[Mixed >> (64 - ShardBits)];
+  }
+
+public:
+  typedef KeyT key_type;
+  typedef ValueT mapped_type;
+
+  /// Create a map with NumShards shards, rounded up to a power of two. The
+  /// default of 0 uses four shards per hardware thread.
+  explicit ConcurrentHashMap(unsigned NumShards = 0) : ShardBits(0) {
+    if (NumShards == 0)
+      NumShards = 4 * hardware_threads();
+    while ((1u << ShardBits) < NumShards)
+      ++ShardBits;
+    Shards = new Shard[size_t(1) << ShardBits];
+  }
+
+  ~ConcurrentHashMap() {
+    delete[] Shards;
+  }
+
+  unsigned getNumShards() const { return 1u << ShardBits; }
+
+  /// find - If Key is present, copy its value to Result and return true.
+  bool find(const KeyT &Key, ValueT &Result) const {
+    size_t Hash = hashOf(Key);
+    Shard &S = shardFor(Hash);
+    concurrent_detail::SharedGuard Guard(S.Lock);
+    typename TableTy::const_iterator I =
+        S.Table.find_as(HashedKeyTy(Key, Hash));
+    if (I == S.Table.end())
+      return false;
+    Result = I->second;
+    return true;
+  }
+
+  /// count - Return 1 if Key is present, 0 otherwise.
+  size_t count(const KeyT &Key) const {
+    size_t Hash = hashOf(Key);
+    Shard &S = shardFor(Hash);
+    concurrent_detail::SharedGuard Guard(S.Lock);
+    return S.Table.find_as(HashedKeyTy(Key, Hash)) != S.Table.end() ? 1 : 0;
+  }
+
+  /// insert_or_get - Insert Key with Value unless Key is already present.
+  /// Return the value now stored for Key, and whether it was inserted. When
+  /// several threads insert the same key at once, exactly one inserts and
+  /// all of them return its value.
+  std::pair<ValueT, bool> insert_or_get(const KeyT &Key, const ValueT &Value) {
+    size_t Hash = hashOf(Key);
+    HashedKeyTy HK(Key, Hash);
+    Shard &S = shardFor(Hash);
+
+    // Most calls find the key, and can share the shard while they look.
+    {
+      concurrent_detail::SharedGuard Guard(S.Lock);
+      typename TableTy::const_iterator I = S.Table.find_as(HK);
+      if (I != S.Table.end())
+        return std::pair<ValueT, bool>(I->second, false);
+    }
+
+    std::lock_guard<concurrent_detail::SharedSpinLock> Guard(S.Lock);
+    std::pair<typename TableTy::iterator, bool> R =
+        S.Table.insert_as(std::make_pair(Key, Value), HK);
+    return std::pair<ValueT, bool>(R.first->second, R.second);
+  }
+
+  /// erase - Remove Key, returning true if it was present.
+  bool erase(const KeyT &Key) {
+    size_t Hash = hashOf(Key);
+    Shard &S = shardFor(Hash);
+    std::lock_guard<concurrent_detail::SharedSpinLock> Guard(S.Lock);
+    typename TableTy::iterator I = S.Table.find_as(HashedKeyTy(Key, Hash));
+    if (I == S.Table.end())
+      return false;
+    S.Table.erase(I);
+    return true;
+  }
+
+  /// size - The number of entries. Shards are counted one at a time, so the
+  /// result is only exact if no other thread changes the map meanwhile.
+  size_t size() const {
+    size_t Total = 0;
+    for (size_t I = 0, E = getNumShards(); I != E; ++I) {
+      concurrent_detail::SharedGuard Guard(Shards[I].Lock);
+      Total += Shards[I].Table.size();
+    }
+    return Total;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  /// clear - Remove every entry, one shard at a time.
+  void clear() {
+    for (size_t I = 0, E = getNumShards(); I != E; ++I) {
+      std::lock_guard<concurrent_detail::SharedSpinLock> Guard(Shards[I].Lock);
+      Shards[I].Table.clear();
+    }
+  }
+
+  /// for_each - Call Fn(Key, Value) for every entry. Each shard's entries
+  /// are copied out under its lock and Fn is called on the copies after it
+  /// is released, so Fn may use the map, and entries other threads add or
+  /// erase meanwhile may or may not be seen.
+  template<typename FnT>
+  void for_each(FnT Fn) const {
+    std::vector<std::pair<KeyT, ValueT> > Entries;
+    for (size_t I = 0, E = getNumShards(); I != E; ++I) {
+      const Shard &S = Shards[I];
+      Entries.clear();
+      {
+        concurrent_detail::SharedGuard Guard(S.Lock);
+        Entries.reserve(S.Table.size());
+        for (typename TableTy::const_iterator J = S.Table.begin(),
+                                              JE = S.Table.end();
+             J != JE; ++J)
+          Entries.push_back(std::make_pair(J->first, J->second));
+      }
+      for (size_t J = 0, JE = Entries.size(); J != JE; ++J)
+        Fn(Entries[J].first, Entries[J].second);
+    }
+  }
+};
+
+} // end namespace akj
@@ -17,9 +17,12 @@
 #include "DataStream.hpp"
 #include "FileSystem.hpp"
 #include "ProgramUtils.hpp"
+#include "StringRef.hpp"
 #include "SystemError.hpp"
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #if !defined(_MSC_VER) && !defined(__MINGW32__)
 #include <unistd.h>
@@ -70,6 +73,20 @@ public:
   }
 };
 
+// Stream over a buffer that is already in memory, for feeding in-memory data
+// to code that consumes a DataStreamer.
+class DataBufferStreamer : public DataStreamer {
+  cStringRef Buffer;
+public:
+  explicit DataBufferStreamer(cStringRef Buffer) : Buffer(Buffer) {}
+  virtual size_t GetBytes(unsigned char *buf, size_t len) AKJ_OVERRIDE {
+    size_t Size = std::min(len, Buffer.size());
+    memcpy(buf, Buffer.data(), Size);
+    Buffer = Buffer.substr(Size);
+    return Size;
+  }
+};
+
 }
 
 namespace akj {
@@ -84,4 +101,8 @@ DataStreamer *getDataFileStreamer(const std::string &Filename,
   return s;
 }
 
+DataStreamer *getDataBufferStreamer(cStringRef Buffer) {
+  return new DataBufferStreamer(Buffer);
+}
+
 }
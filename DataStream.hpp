@@ -20,6 +20,8 @@
 
 namespace akj {
 
+class cStringRef;
+
 class DataStreamer {
 public:
   /// Fetch bytes [start-end) from the stream, and write them to the
@@ -32,5 +34,9 @@ public:
 DataStreamer *getDataFileStreamer(const std::string &Filename,
                                   std::string *Err);
 
+/// getDataBufferStreamer - Return a DataStreamer that hands out the bytes of
+/// Buffer, which must outlive it.
+DataStreamer *getDataBufferStreamer(cStringRef Buffer);
+
 }
 
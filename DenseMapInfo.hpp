@@ -0,0 +1,143 @@
+//===-- akjDenseMapInfo.hpp - Type traits for DenseMap -----------*- C++ -*-===//
+//
+//           originally from The LLVM Compiler Infrastructure
+//
+// Was distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines DenseMapInfo traits for DenseMap. A DenseMapInfo names
+// two key values that are never inserted, one marking empty buckets and one
+// marking erased ones (tombstones), and says how to hash and compare keys.
+// Hashes come from the hash_value overloads in Hashing.hpp, so any type with
+// a hash_value can be given a DenseMapInfo in a few lines.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "Hashing.hpp"
+#include "StringRef.hpp"
+#include "TypeTraits.hpp"
+#include <stdint.h>
+#include <utility>
+
+namespace akj {
+
+template<typename T>
+struct DenseMapInfo {
+  //static inline T getEmptyKey();
+  //static inline T getTombstoneKey();
+  //static unsigned getHashValue(const T &Val);
+  //static bool isEqual(const T &LHS, const T &RHS);
+};
+
+namespace dense_map_detail {
+/// getHash - Fold a hash_code into the unsigned that DenseMap probes with.
+/// The low bits of a hash_code are as well mixed as the high ones.
+inline unsigned getHash(hash_code Code) {
+  return unsigned(size_t(Code));
+}
+} // end namespace dense_map_detail
+
+// Provide DenseMapInfo for all pointers. Objects are at least four byte
+// aligned, so the empty and tombstone keys are addresses no object has.
+template<typename T>
+struct DenseMapInfo<T*> {
+  static inline T* getEmptyKey() {
+    uintptr_t Val = static_cast<uintptr_t>(-1);
+    Val <<= 2;
+    return reinterpret_cast<T*>(Val);
+  }
+  static inline T* getTombstoneKey() {
+    uintptr_t Val = static_cast<uintptr_t>(-2);
+    Val <<= 2;
+    return reinterpret_cast<T*>(Val);
+  }
+  static unsigned getHashValue(const T *PtrVal) {
+    return dense_map_detail::getHash(hash_value(PtrVal));
+  }
+  static bool isEqual(const T *LHS, const T *RHS) { return LHS == RHS; }
+};
+
+// Provide DenseMapInfo for integers. Each type gives up two values as the
+// empty and tombstone keys: the two largest for unsigned types, ~0 and ~0 - 1
+// converted to char for char, and the largest and smallest for the other
+// signed types.
+#define AKJ_DENSEMAPINFO_INTEGER(TYPE, EMPTY, TOMBSTONE) \
+template<> struct DenseMapInfo<TYPE> { \
+  static inline TYPE getEmptyKey() { return EMPTY; } \
+  static inline TYPE getTombstoneKey() { return TOMBSTONE; } \
+  static unsigned getHashValue(const TYPE &Val) { \
+    return dense_map_detail::getHash(hash_value(Val)); \
+  } \
+  static bool isEqual(const TYPE &LHS, const TYPE &RHS) { \
+    return LHS == RHS; \
+  } \
+};
+
+AKJ_DENSEMAPINFO_INTEGER(char, ~0, ~0 - 1)
+AKJ_DENSEMAPINFO_INTEGER(unsigned, ~0U, ~0U - 1)
+AKJ_DENSEMAPINFO_INTEGER(unsigned long, ~0UL, ~0UL - 1L)
+AKJ_DENSEMAPINFO_INTEGER(unsigned long long, ~0ULL, ~0ULL - 1ULL)
+AKJ_DENSEMAPINFO_INTEGER(int, 0x7fffffff, -0x7fffffff - 1)
+AKJ_DENSEMAPINFO_INTEGER(long, (long)(~0UL >> 1), -(long)(~0UL >> 1) - 1)
+AKJ_DENSEMAPINFO_INTEGER(long long, 0x7fffffffffffffffLL,
+                         -0x7fffffffffffffffLL - 1)
+
+#undef AKJ_DENSEMAPINFO_INTEGER
+
+// Provide DenseMapInfo for all pairs whose members have info.
+template<typename T, typename U>
+struct DenseMapInfo<std::pair<T, U> > {
+  typedef std::pair<T, U> Pair;
+  typedef DenseMapInfo<T> FirstInfo;
+  typedef DenseMapInfo<U> SecondInfo;
+
+  static inline Pair getEmptyKey() {
+    return std::make_pair(FirstInfo::getEmptyKey(),
+                          SecondInfo::getEmptyKey());
+  }
+  static inline Pair getTombstoneKey() {
+    return std::make_pair(FirstInfo::getTombstoneKey(),
+                          SecondInfo::getTombstoneKey());
+  }
+  static unsigned getHashValue(const Pair &PairVal) {
+    return dense_map_detail::getHash(
+        hash_combine(FirstInfo::getHashValue(PairVal.first),
+                     SecondInfo::getHashValue(PairVal.second)));
+  }
+  static bool isEqual(const Pair &LHS, const Pair &RHS) {
+    return FirstInfo::isEqual(LHS.first, RHS.first) &&
+           SecondInfo::isEqual(LHS.second, RHS.second);
+  }
+};
+
+// Provide DenseMapInfo for cStringRefs. The map doesn't own the characters,
+// so they must outlive it. The empty and tombstone keys point at addresses
+// no string has and are only ever compared by address.
+template<> struct DenseMapInfo<cStringRef> {
+  static inline cStringRef getEmptyKey() {
+    return cStringRef(reinterpret_cast<const char *>(~static_cast<uintptr_t>(0)),
+                      0);
+  }
+  static inline cStringRef getTombstoneKey() {
+    return cStringRef(reinterpret_cast<const char *>(~static_cast<uintptr_t>(1)),
+                      0);
+  }
+  static unsigned getHashValue(cStringRef Val) {
+    assert(Val.data() != getEmptyKey().data() && "Cannot hash the empty key!");
+    assert(Val.data() != getTombstoneKey().data() &&
+           "Cannot hash the tombstone key!");
+    return dense_map_detail::getHash(hash_value(Val));
+  }
+  static bool isEqual(cStringRef LHS, cStringRef RHS) {
+    if (RHS.data() == getEmptyKey().data())
+      return LHS.data() == getEmptyKey().data();
+    if (RHS.data() == getTombstoneKey().data())
+      return LHS.data() == getTombstoneKey().data();
+    return LHS == RHS;
+  }
+};
+
+} // end namespace akj
@@ -0,0 +1,173 @@
+//===-- akjDenseSet.hpp - Dense probed hash set ------------------*- C++ -*-===//
+//
+//           originally from The LLVM Compiler Infrastructure
+//
+// Was distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the DenseSet and SmallDenseSet classes, sets built on
+// DenseMap and SmallDenseMap. Their values are keys of the map, so the same
+// DenseMapInfo rules apply: two values are reserved and may not be inserted.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "DenseMap.hpp"
+
+namespace akj {
+
+namespace detail {
+/// DenseSetImpl - The set operations shared by DenseSet and SmallDenseSet.
+/// MapTy is a map from ValueT to char whose mapped values are ignored.
+template<typename ValueT, typename MapTy, typename ValueInfoT>
+class DenseSetImpl {
+  MapTy TheMap;
+
+public:
+  typedef ValueT key_type;
+  typedef ValueT value_type;
+  typedef unsigned size_type;
+
+  explicit DenseSetImpl(unsigned NumInitBuckets = 0)
+    : TheMap(NumInitBuckets) {}
+
+  bool empty() const { return TheMap.empty(); }
+  size_type size() const { return TheMap.size(); }
+  size_t getMemorySize() const { return TheMap.getMemorySize(); }
+
+  /// Grow the set so that it has at least Size buckets. Does not shrink.
+  void resize(size_t Size) { TheMap.resize(Size); }
+
+  void clear() {
+    TheMap.clear();
+  }
+
+  bool count(const ValueT &V) const {
+    return TheMap.count(V);
+  }
+
+  bool erase(const ValueT &V) {
+    return TheMap.erase(V);
+  }
+
+  void swap(DenseSetImpl& RHS) {
+    TheMap.swap(RHS.TheMap);
+  }
+
+  // Iterators.
+
+  class Iterator {
+    typename MapTy::iterator I;
+    friend class DenseSetImpl;
+  public:
+    typedef typename MapTy::iterator::difference_type difference_type;
+    typedef ValueT value_type;
+    typedef value_type *pointer;
+    typedef value_type &reference;
+    typedef std::forward_iterator_tag iterator_category;
+
+    Iterator(const typename MapTy::iterator &i) : I(i) {}
+
+    ValueT& operator*() { return I->first; }
+    ValueT* operator->() { return &I->first; }
+
+    Iterator& operator++() { ++I; return *this; }
+    bool operator==(const Iterator& X) const { return I == X.I; }
+    bool operator!=(const Iterator& X) const { return I != X.I; }
+  };
+
+  class ConstIterator {
+    typename MapTy::const_iterator I;
+    friend class DenseSetImpl;
+  public:
+    typedef typename MapTy::const_iterator::difference_type difference_type;
+    typedef ValueT value_type;
+    typedef value_type *pointer;
+    typedef value_type &reference;
+    typedef std::forward_iterator_tag iterator_category;
+
+    ConstIterator(const typename MapTy::const_iterator &i) : I(i) {}
+
+    const ValueT& operator*() { return I->first; }
+    const ValueT* operator->() { return &I->first; }
+
+    ConstIterator& operator++() { ++I; return *this; }
+    bool operator==(const ConstIterator& X) const { return I == X.I; }
+    bool operator!=(const ConstIterator& X) const { return I != X.I; }
+  };
+
+  typedef Iterator      iterator;
+  typedef ConstIterator const_iterator;
+
+  iterator begin() { return Iterator(TheMap.begin()); }
+  iterator end() { return Iterator(TheMap.end()); }
+
+  const_iterator begin() const { return ConstIterator(TheMap.begin()); }
+  const_iterator end() const { return ConstIterator(TheMap.end()); }
+
+  iterator find(const ValueT &V) { return Iterator(TheMap.find(V)); }
+  const_iterator find(const ValueT &V) const {
+    return ConstIterator(TheMap.find(V));
+  }
+
+  /// Alternate version of find() which allows a different, and possibly less
+  /// expensive, key type. The ValueInfoT is responsible for supplying
+  /// getHashValue(LookupKeyT) and isEqual(LookupKeyT, ValueT) for each key
+  /// type used.
+  template<class LookupKeyT>
+  iterator find_as(const LookupKeyT &Val) {
+    return Iterator(TheMap.find_as(Val));
+  }
+  template<class LookupKeyT>
+  const_iterator find_as(const LookupKeyT &Val) const {
+    return ConstIterator(TheMap.find_as(Val));
+  }
+
+  void erase(Iterator I) { return TheMap.erase(I.I); }
+  void erase(ConstIterator CI) { return TheMap.erase(CI.I); }
+
+  std::pair<iterator, bool> insert(const ValueT &V) {
+    return TheMap.insert(std::make_pair(V, 0));
+  }
+
+  // Range insertion of values.
+  template<typename InputIt>
+  void insert(InputIt I, InputIt E) {
+    for (; I != E; ++I)
+      insert(*I);
+  }
+};
+} // end namespace detail
+
+/// DenseSet - A set whose buckets are always on the heap.
+template<typename ValueT, typename ValueInfoT = DenseMapInfo<ValueT> >
+class DenseSet
+    : public detail::DenseSetImpl<ValueT, DenseMap<ValueT, char, ValueInfoT>,
+                                  ValueInfoT> {
+  typedef detail::DenseSetImpl<ValueT, DenseMap<ValueT, char, ValueInfoT>,
+                               ValueInfoT> BaseT;
+
+public:
+  explicit DenseSet(unsigned NumInitBuckets = 0) : BaseT(NumInitBuckets) {}
+};
+
+/// SmallDenseSet - A set that keeps its first InlineBuckets buckets inside
+/// the object, like SmallDenseMap.
+template<typename ValueT, unsigned InlineBuckets = 4,
+         typename ValueInfoT = DenseMapInfo<ValueT> >
+class SmallDenseSet
+    : public detail::DenseSetImpl<
+          ValueT, SmallDenseMap<ValueT, char, InlineBuckets, ValueInfoT>,
+          ValueInfoT> {
+  typedef detail::DenseSetImpl<
+      ValueT, SmallDenseMap<ValueT, char, InlineBuckets, ValueInfoT>,
+      ValueInfoT> BaseT;
+
+public:
+  explicit SmallDenseSet(unsigned NumInitBuckets = 0)
+    : BaseT(NumInitBuckets) {}
+};
+
+} // end namespace akj
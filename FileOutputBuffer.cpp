@@ -12,29 +12,277 @@
 
 #include "FileOutputBuffer.hpp"
 #include "OwningPtr.hpp"
+#include "Parallel.hpp"
 #include "SmallVector.hpp"
 #include "RawOstream.hpp"
 #include "SystemError.hpp"
+#include "lz4.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <string.h>
+#include <thread>
+#include <vector>
 
 using akj::sys::fs::mapped_file_region;
 
 namespace akj {
+
+/// CompressionState - The in-memory buffer of a compressed FileOutputBuffer,
+/// the blocks compressed so far and the threads compressing the rest.
+struct FileOutputBuffer::CompressionState {
+  /// Takes ownership of Buffer, which holds Size bytes.
+  CompressionState(int FD, uint8_t *Buffer, size_t Size, blocks::Codec C,
+                   zlib::CompressionLevel Level, size_t BlockSize,
+                   unsigned NumThreads);
+  ~CompressionState();
+
+  void markDone(uint64_t Offset, uint64_t Size);
+
+  /// finish - Compress every block of the first FinalSize bytes that hasn't
+  /// been compressed yet, helping the workers with the queue, and wait until
+  /// they are all done.
+  void finish(size_t FinalSize);
+
+  /// write - Write the container of the first FinalSize bytes to Out.
+  void write(size_t FinalSize);
+
+  raw_fd_ostream Out;
+  OwningArrayPtr<uint8_t> Buffer;
+  size_t Size;
+  blocks::Codec Codec;
+  zlib::CompressionLevel Level;
+  size_t BlockSize;
+
+private:
+  size_t getBlockLength(size_t I, size_t TotalSize) const {
+    return std::min(BlockSize, TotalSize - I * BlockSize);
+  }
+  void compressBlock(size_t I, size_t Length, char *Scratch);
+  bool runOne(std::unique_lock<std::mutex> &Guard, char *Scratch);
+  void runWorker();
+
+  /// Bytes of each block that haven't been marked done yet. A block is
+  /// queued when its count drops to zero.
+  std::vector<size_t> Unfilled;
+  /// The compressed blocks, null for blocks that are stored.
+  std::vector<OwningArrayPtr<char> > Blocks;
+  /// The size of each block in the container.
+  std::vector<size_t> Sizes;
+  /// The number of input bytes each block was compressed from, 0 if it
+  /// hasn't been compressed yet.
+  std::vector<size_t> CompressedFrom;
+
+  std::mutex Lock;
+  std::condition_variable WorkReady;
+  std::condition_variable WorkDone;
+  std::deque<size_t> Queue;
+  unsigned Busy;
+  bool Stopping;
+  std::vector<std::thread> Workers;
+};
+
+FileOutputBuffer::CompressionState::CompressionState(
+    int FD, uint8_t *Buffer, size_t Size, blocks::Codec C,
+    zlib::CompressionLevel Level, size_t BlockSize, unsigned NumThreads)
+  : Out(FD, true), Buffer(Buffer), Size(Size), Codec(C),
+    Level(Level), BlockSize(BlockSize), Busy(0), Stopping(false) {
+  size_t NumBlocks = (Size + BlockSize - 1) / BlockSize;
+  Unfilled.resize(NumBlocks);
+  for (size_t I = 0; I != NumBlocks; ++I)
+    Unfilled[I] = getBlockLength(I, Size);
+  Blocks.resize(NumBlocks);
+  Sizes.resize(NumBlocks);
+  CompressedFrom.resize(NumBlocks);
+
+  if (NumThreads == 0)
+    NumThreads = hardware_threads();
+  if (NumThreads > NumBlocks)
+    NumThreads = unsigned(NumBlocks);
+  for (unsigned I = 0; I != NumThreads; ++I)
+    Workers.push_back(std::thread([this] { runWorker(); }));
+}
+
+FileOutputBuffer::CompressionState::~CompressionState() {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Queue.clear();
+    Stopping = true;
+  }
+  WorkReady.notify_all();
+  for (size_t I = 0, E = Workers.size(); I != E; ++I)
+    Workers[I].join();
+}
+
+void FileOutputBuffer::CompressionState::compressBlock(size_t I,
+                                                       size_t Length,
+                                                       char *Scratch) {
+  cStringRef Input(reinterpret_cast<const char *>(Buffer.get()) +
+                       I * BlockSize, Length);
+  size_t CompressedSize = blocks::compressBlock(Codec, Level, Input, Scratch);
+  // Each block is only ever compressed by one thread at a time, and finish()
+  // reads the results under Lock after that thread is done with it.
+  if (CompressedSize) {
+    Blocks[I].reset(new char[CompressedSize]);
+    memcpy(Blocks[I].get(), Scratch, CompressedSize);
+  } else {
+    Blocks[I].reset();
+    CompressedSize = Length;
+  }
+  Sizes[I] = CompressedSize;
+  CompressedFrom[I] = Length;
+}
+
+bool FileOutputBuffer::CompressionState::runOne(
+    std::unique_lock<std::mutex> &Guard, char *Scratch) {
+  if (Queue.empty())
+    return false;
+  size_t I = Queue.front();
+  Queue.pop_front();
+  ++Busy;
+  Guard.unlock();
+  compressBlock(I, getBlockLength(I, Size), Scratch);
+  Guard.lock();
+  if (--Busy == 0 && Queue.empty())
+    WorkDone.notify_all();
+  return true;
+}
+
+void FileOutputBuffer::CompressionState::runWorker() {
+  OwningArrayPtr<char> Scratch(new char[BlockSize]);
+  std::unique_lock<std::mutex> Guard(Lock);
+  while (!Stopping) {
+    if (!runOne(Guard, Scratch.get()))
+      WorkReady.wait(Guard);
+  }
+}
+
+void FileOutputBuffer::CompressionState::markDone(uint64_t Offset,
+                                                  uint64_t Length) {
+  if (Offset >= Size)
+    return;
+  uint64_t End = Offset + std::min(Length, Size - Offset);
+  if (End == Offset)
+    return;
+
+  bool Queued = false;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    for (size_t I = size_t(Offset / BlockSize); I * BlockSize < End; ++I) {
+      uint64_t Begin = std::max<uint64_t>(Offset, I * BlockSize);
+      uint64_t Stop = std::min<uint64_t>(End, I * BlockSize + BlockSize);
+      size_t Done = size_t(std::min<uint64_t>(Stop - Begin, Unfilled[I]));
+      if (Done == 0)
+        continue;
+      Unfilled[I] -= Done;
+      if (Unfilled[I] == 0) {
+        Queue.push_back(I);
+        Queued = true;
+      }
+    }
+  }
+  if (Queued)
+    WorkReady.notify_all();
+}
+
+void FileOutputBuffer::CompressionState::finish(size_t FinalSize) {
+  size_t NumBlocks = (FinalSize + BlockSize - 1) / BlockSize;
+  OwningArrayPtr<char> Scratch(new char[BlockSize]);
+  {
+    std::unique_lock<std::mutex> Guard(Lock);
+    // Blocks past the end won't be written, so there's no point in
+    // compressing the ones still waiting.
+    Queue.erase(std::remove_if(Queue.begin(), Queue.end(),
+                               [=](size_t I) { return I >= NumBlocks; }),
+                Queue.end());
+    for (size_t I = 0; I != NumBlocks; ++I) {
+      if (Unfilled[I] != 0) {
+        Unfilled[I] = 0;
+        Queue.push_back(I);
+      }
+    }
+    WorkReady.notify_all();
+    while (runOne(Guard, Scratch.get()))
+      ;
+    while (Busy != 0)
+      WorkDone.wait(Guard);
+  }
+
+  // A smaller final size can cut the last block short after it was
+  // compressed whole.
+  if (NumBlocks != 0) {
+    size_t Last = NumBlocks - 1;
+    size_t Length = getBlockLength(Last, FinalSize);
+    if (CompressedFrom[Last] != Length)
+      compressBlock(Last, Length, Scratch.get());
+  }
+}
+
+void FileOutputBuffer::CompressionState::write(size_t FinalSize) {
+  size_t NumBlocks = (FinalSize + BlockSize - 1) / BlockSize;
+  blocks::ContainerHeader Header;
+  Header.Magic = blocks::ContainerMagic;
+  Header.Version = blocks::ContainerVersion;
+  Header.Codec = uint8_t(Codec);
+  Header.Level = uint8_t(Level);
+  Header.Reserved = 0;
+  // A single block is recorded at its own size, as blocks::compress does,
+  // since readers reject a block size far beyond the data.
+  Header.BlockSize = uint32_t(std::min(BlockSize,
+                                       std::max<size_t>(FinalSize, 1)));
+  Header.NumBlocks = uint32_t(NumBlocks);
+  Header.UncompressedSize = FinalSize;
+  Out.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+
+  support::ulittle64_t Offset;
+  Offset = blocks::getContainerHeaderSize(NumBlocks);
+  Out.write(reinterpret_cast<const char *>(&Offset), sizeof(Offset));
+  for (size_t I = 0; I != NumBlocks; ++I) {
+    Offset = Offset + Sizes[I];
+    Out.write(reinterpret_cast<const char *>(&Offset), sizeof(Offset));
+  }
+
+  for (size_t I = 0; I != NumBlocks; ++I) {
+    const char *Data = Blocks[I].get();
+    if (!Data)
+      Data = reinterpret_cast<const char *>(Buffer.get()) + I * BlockSize;
+    Out.write(Data, Sizes[I]);
+  }
+  Out.close();
+}
+
 FileOutputBuffer::FileOutputBuffer(mapped_file_region * R,
                                    cStringRef Path, cStringRef TmpPath)
   : Region(R)
+  , BufferStart((uint8_t*)R->data())
+  , BufferSize(R->size())
+  , FinalPath(Path)
+  , TempPath(TmpPath) {
+}
+
+FileOutputBuffer::FileOutputBuffer(CompressionState *C,
+                                   cStringRef Path, cStringRef TmpPath)
+  : Compressor(C)
+  , BufferStart(C->Buffer.get())
+  , BufferSize(C->Size)
   , FinalPath(Path)
   , TempPath(TmpPath) {
 }
 
 FileOutputBuffer::~FileOutputBuffer() {
+  // Stop the workers and close the temp file before removing it.
+  Compressor.reset();
   bool Existed;
   sys::fs::remove(Twine(TempPath), Existed);
 }
 
-error_code FileOutputBuffer::create(cStringRef FilePath,
-                                    size_t Size,
-                                    OwningPtr<FileOutputBuffer> &Result,
-                                    unsigned Flags) {
+/// Replace FilePath with a new, empty file in the same directory that gets
+/// a random name, and return its path and descriptor.
+static error_code createOutputTempFile(cStringRef FilePath, unsigned Flags,
+                                       cSmallVectorImpl<char> &TempFilePath,
+                                       int &FD) {
   // If file already exists, it must be a regular file (to be mappable).
   sys::fs::file_status Stat;
   error_code EC = sys::fs::status(FilePath, Stat);
@@ -63,14 +311,21 @@ error_code FileOutputBuffer::create(cStringRef FilePath,
 
   unsigned Mode = sys::fs::all_read | sys::fs::all_write;
   // If requested, make the output file executable.
-  if (Flags & F_executable)
+  if (Flags & FileOutputBuffer::F_executable)
     Mode |= sys::fs::all_exe;
 
   // Create new file in same directory but with random name.
+  return sys::fs::createUniqueFile(Twine(FilePath) + ".tmp%%%%%%%", FD,
+                                   TempFilePath, Mode);
+}
+
+error_code FileOutputBuffer::create(cStringRef FilePath,
+                                    size_t Size,
+                                    OwningPtr<FileOutputBuffer> &Result,
+                                    unsigned Flags) {
   SmallString<128> TempFilePath;
   int FD;
-  EC = sys::fs::createUniqueFile(Twine(FilePath) + ".tmp%%%%%%%", FD,
-                                 TempFilePath, Mode);
+  error_code EC = createOutputTempFile(FilePath, Flags, TempFilePath, FD);
   if (EC)
     return EC;
 
@@ -86,7 +341,61 @@ error_code FileOutputBuffer::create(cStringRef FilePath,
   return error_code::success();
 }
 
+error_code FileOutputBuffer::createCompressed(
+    cStringRef FilePath, size_t Size, OwningPtr<FileOutputBuffer> &Result,
+    blocks::Codec C, zlib::CompressionLevel Level, size_t BlockSize,
+    unsigned NumThreads, unsigned Flags) {
+  if (BlockSize == 0 || BlockSize > LZ4_MAX_INPUT_SIZE ||
+      C > blocks::CodecZlib ||
+      (uint64_t(Size) + BlockSize - 1) / BlockSize > UINT32_MAX)
+    return make_error_code(errc::invalid_argument);
+
+  // Get the memory first, so running out of it leaves the file alone.
+  OwningArrayPtr<uint8_t> Buffer(new (std::nothrow) uint8_t[Size]);
+  if (!Buffer)
+    return make_error_code(errc::not_enough_memory);
+
+  SmallString<128> TempFilePath;
+  int FD;
+  error_code EC = createOutputTempFile(FilePath, Flags, TempFilePath, FD);
+  if (EC)
+    return EC;
+
+  Result.reset(new FileOutputBuffer(
+      new CompressionState(FD, Buffer.take(), Size, C, Level, BlockSize,
+                           NumThreads),
+      FilePath, TempFilePath));
+  return error_code::success();
+}
+
+void FileOutputBuffer::markDone(uint64_t Offset, uint64_t Size) {
+  if (Compressor)
+    Compressor->markDone(Offset, Size);
+}
+
+error_code FileOutputBuffer::commitCompressed(int64_t NewSmallerSize) {
+  size_t FinalSize = BufferSize;
+  if (NewSmallerSize != -1 && uint64_t(NewSmallerSize) < FinalSize)
+    FinalSize = size_t(NewSmallerSize);
+
+  Compressor->finish(FinalSize);
+  Compressor->write(FinalSize);
+  bool Failed = Compressor->Out.has_error();
+  Compressor->Out.clear_error();
+  // Free the buffer and the compressed blocks, and stop the workers.
+  Compressor.reset();
+  BufferStart = 0;
+  BufferSize = 0;
+  if (Failed)
+    return make_error_code(errc::io_error);
+
+  return sys::fs::rename(Twine(TempPath), Twine(FinalPath));
+}
+
 error_code FileOutputBuffer::commit(int64_t NewSmallerSize) {
+  if (Compressor)
+    return commitCompressed(NewSmallerSize);
+
   // Unmap buffer, letting OS flush dirty pages to file on disk.
   Region.reset(0);
 
@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include "BlockCompression.hpp"
 #include "OwningPtr.hpp"
 #include "SmallString.hpp"
 #include "StringRef.hpp"
@@ -28,6 +29,11 @@ class error_code;
 /// If the FileOutputBuffer is committed, the target file's content will become
 /// the buffer content at the time of the commit.  If the FileOutputBuffer is
 /// not committed, the file will be deleted in the FileOutputBuffer destructor.
+///
+/// A buffer made by createCompressed() commits to a block compressed container
+/// (see BlockCompression.hpp) instead. Its blocks are compressed on background
+/// threads as soon as the producer has marked all of their bytes done, so by
+/// the time commit() is called most of the work is usually finished.
 class FileOutputBuffer {
 public:
 
@@ -42,21 +48,47 @@ public:
                            OwningPtr<FileOutputBuffer> &Result,
                            unsigned Flags = 0);
 
+  /// Factory method to create an OutputBuffer object whose file is written as
+  /// a block compressed container when committed. The buffer itself lives in
+  /// memory. Blocks of BlockSize bytes are compressed with C at Level by up to
+  /// NumThreads background threads (all hardware threads if 0) as they are
+  /// passed to markDone(); commit() compresses whatever is left.
+  static error_code createCompressed(cStringRef FilePath, size_t Size,
+                                     OwningPtr<FileOutputBuffer> &Result,
+                                     blocks::Codec C = blocks::CodecLZ4,
+                                     zlib::CompressionLevel Level =
+                                         zlib::DefaultCompression,
+                                     size_t BlockSize =
+                                         blocks::DefaultBlockSize,
+                                     unsigned NumThreads = 0,
+                                     unsigned Flags = 0);
+
   /// Returns a pointer to the start of the buffer.
   uint8_t *getBufferStart() {
-    return (uint8_t*)Region->data();
+    return BufferStart;
   }
 
   /// Returns a pointer to the end of the buffer.
   uint8_t *getBufferEnd() {
-    return (uint8_t*)Region->data() + Region->size();
+    return BufferStart + BufferSize;
   }
 
   /// Returns size of the buffer.
   uint64_t getBufferSize() const {
-    return Region->size();
+    return BufferSize;
+  }
+
+  /// Returns true if the buffer was made by createCompressed().
+  bool isCompressed() const {
+    return Compressor.get() != 0;
   }
 
+  /// Tells a compressed buffer that the Size bytes at Offset won't change
+  /// again, so that every block they complete can be compressed right away.
+  /// Regions passed in must not overlap; they may be marked from several
+  /// threads at once. Does nothing for uncompressed buffers.
+  void markDone(uint64_t Offset, uint64_t Size);
+
   /// Returns path where file will show up if buffer is committed.
   cStringRef getPath() const {
     return FinalPath;
@@ -78,10 +110,19 @@ private:
   FileOutputBuffer(const FileOutputBuffer &) AKJ_DELETED_FUNCTION;
   FileOutputBuffer &operator=(const FileOutputBuffer &) AKJ_DELETED_FUNCTION;
 
+  struct CompressionState;
+
   FileOutputBuffer(sys::fs::mapped_file_region *R,
                    cStringRef Path, cStringRef TempPath);
+  FileOutputBuffer(CompressionState *C,
+                   cStringRef Path, cStringRef TempPath);
+
+  error_code commitCompressed(int64_t NewSmallerSize);
 
   OwningPtr<akj::sys::fs::mapped_file_region> Region;
+  OwningPtr<CompressionState> Compressor;
+  uint8_t            *BufferStart;
+  size_t              BufferSize;
   SmallString<128>    FinalPath;
   SmallString<128>    TempPath;
 };
@@ -237,11 +237,20 @@ struct file_magic {
     macho_dsym_companion,     ///< Mach-O dSYM companion file
     macho_universal_binary,   ///< Mach-O universal binary
     coff_object,              ///< COFF object file
-    pecoff_executable         ///< PECOFF executable file
+    pecoff_executable,        ///< PECOFF executable file
+    gzip_compressed,          ///< gzip compressed data
+    zlib_compressed,          ///< zlib stream (never identified: the 2 byte
+                              ///< header is too weak to tell from text)
+    lz4_frame,                ///< LZ4 frame format
+    block_compressed          ///< akj block compressed container
   };
 
   bool is_object() const {
-    return V == unknown ? false : true;
+    return V == unknown || is_compressed() ? false : true;
+  }
+
+  bool is_compressed() const {
+    return V >= gzip_compressed && V <= block_compressed;
   }
 
   file_magic() : V(unknown) {}
@@ -785,6 +794,90 @@ error_code map_file_pages(const Twine &path, off_t file_offset, size_t size,
 ///          platform specific error_code.
 error_code unmap_file_pages(void *base, size_t size);
 
+/// file_digest - A 64-bit fingerprint of the contents of a file that can be
+/// brought up to date cheaply after the file changes.
+///
+/// The file is split into chunks of chunkSize() bytes, each chunk is mapped
+/// with mapped_file_region and hashed with hash_bulk on its own thread, and
+/// the chunk hashes are combined pairwise into a binary tree whose root,
+/// together with the file size, is the digest. The shape of the tree only
+/// depends on the file size and the chunk size, so the digest is the same
+/// however many threads computed it. A fixed seed is used rather than the
+/// execution seed, so digests can be compared between runs.
+///
+/// update() remembers the size and modification time of the file and the
+/// hash of every chunk. The next update() does nothing if neither the size
+/// nor the time changed. Otherwise, chunks marked with invalidate() and any
+/// chunk whose length changed are hashed again, the rest are reused. If the
+/// file changed and nothing was invalidated, every chunk is hashed again,
+/// since there is no telling where the change is.
+class file_digest {
+public:
+  enum { DefaultChunkSize = 4 << 20 };
+
+  /// Create an empty digest. ChunkSize is rounded up to a multiple of
+  /// mapped_file_region::alignment(); keep it a multiple of 64 KB for
+  /// digests that are the same on all platforms.
+  explicit file_digest(uint64_t ChunkSize = DefaultChunkSize);
+
+  /// @brief Bring the digest up to date with the file at \a path.
+  ///
+  /// @param path Input path.
+  /// @param NumThreads Hash on up to this many threads, all hardware threads
+  ///        if 0.
+  /// @returns errc::success if the digest has been updated, otherwise a
+  ///          platform specific error_code, in which case the digest is
+  ///          cleared.
+  error_code update(const Twine &path, unsigned NumThreads = 0);
+
+  /// @brief A version for when a file descriptor is already available. The
+  /// descriptor is not closed.
+  error_code update(int FD, unsigned NumThreads = 0);
+
+  /// Mark the chunks overlapping [Offset, Offset + Length) as changed, so the
+  /// next update() hashes them again. Used when the caller knows which parts
+  /// of the file it wrote.
+  void invalidate(uint64_t Offset, uint64_t Length);
+
+  /// Forget everything, so the next update() hashes the whole file.
+  void clear();
+
+  /// Return true if update() has succeeded since the last clear().
+  bool valid() const { return Valid; }
+
+  uint64_t digest() const { return Digest; }
+  uint64_t chunkSize() const { return ChunkSize; }
+  uint64_t size() const { return Size; }
+  TimeValue lastModificationTime() const { return ModTime; }
+  size_t numChunks() const { return ChunkHashes.size(); }
+  uint64_t chunkHash(size_t I) const { return ChunkHashes[I]; }
+
+  /// Return how many chunks the last update() hashed.
+  size_t chunksRehashed() const { return Rehashed; }
+
+private:
+  uint64_t ChunkSize;
+  uint64_t Size;
+  TimeValue ModTime;
+  std::vector<uint64_t> ChunkHashes;
+  std::vector<bool> Stale;
+  bool AnyStale;
+  bool Valid;
+  uint64_t Digest;
+  size_t Rehashed;
+};
+
+/// @brief Compute the file_digest of \a path with the default chunk size.
+///
+/// @param path Input path.
+/// @param result Set to the digest of the file.
+/// @param NumThreads Hash on up to this many threads, all hardware threads
+///        if 0.
+/// @returns errc::success if result has been successfully set, otherwise a
+///          platform specific error_code.
+error_code digest_file(const Twine &path, uint64_t &result,
+                       unsigned NumThreads = 0);
+
 /// Return the path to the main executable, given the value of argv[0] from
 /// program startup and the address of main itself. In extremis, this function
 /// may fail and return an empty path.
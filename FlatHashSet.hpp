@@ -0,0 +1,696 @@
+//===-- akjFlatHashSet.hpp - Group-probed open addressing table --*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines FlatHashSet and FlatHashMap, "Swiss table" style hash
+// tables that stay fast up to a load factor of 7/8.
+//
+// Next to the array of elements the table keeps one control byte per slot:
+// empty, deleted, or, for a full slot, the low 7 bits of the element's hash.
+// The rest of the hash picks where probing starts. A lookup loads a group of
+// control bytes at once, 16 with SSE2 or 8 with the portable fallback, and
+// compares all of them against the 7-bit tag in a few instructions. Only
+// slots whose tag matches are compared with the key, which is about one slot
+// in 128 that is not the one sought. Probing moves on by whole groups and
+// stops at the first group that has an empty slot, so even at high load a
+// lookup rarely reads more than one or two groups.
+//
+// Elements are stored by value, hashed with the table's info class (by
+// default through hash_value from Hashing.hpp), and there are no reserved key
+// values. Inserting and rehashing move elements, so iterators, pointers and
+// references into a table are invalidated by inserting into it. Erasing only
+// invalidates the erased element.
+//
+// FoldingSetFlatHashInfo lets a FlatHashSet of node pointers stand in for a
+// FoldingSet: nodes are hashed and compared by their profile, and can be
+// looked up or inserted by FoldingSetNodeID.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "AlignOf.hpp"
+#include "CompilerFeatures.hpp"
+#include "FoldingSet.hpp"
+#include "Hashing.hpp"
+#include "MathExtras.hpp"
+#include "SwapByteOrder.hpp"
+#include "TypeTraits.hpp"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <stdint.h>
+#include <utility>
+
+// SSE2 is part of every x86-64 target. Define AKJ_FLAT_HASH_NO_SSE2 to use
+// the portable groups anyway.
+#if !defined(AKJ_FLAT_HASH_NO_SSE2) && \
+    (defined(__SSE2__) || defined(_M_X64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# define AKJ_FLAT_HASH_SSE2 1
+# include <emmintrin.h>
+#else
+# define AKJ_FLAT_HASH_SSE2 0
+#endif
+
+namespace akj {
+
+/// FlatHashInfo - How FlatHashSet and FlatHashMap hash and compare keys. The
+/// default uses hash_value and operator==. Specializations, or info classes
+/// passed as a template argument, may add getHashValue and isEqual overloads
+/// for other key types to use with find_as and insert_as.
+template<typename T>
+struct FlatHashInfo {
+  static hash_code getHashValue(const T &Val) { return hash_value(Val); }
+  static bool isEqual(const T &LHS, const T &RHS) { return LHS == RHS; }
+};
+
+/// FoldingSetFlatHashInfo - Hash and compare pointers to FoldingSet nodes by
+/// the profile FoldingSetTrait<T> gives them, so that a
+/// FlatHashSet<T*, FoldingSetFlatHashInfo<T> > uniques nodes the way a
+/// FoldingSet<T> does. find_as(ID) replaces FindNodeOrInsertPos, and
+/// insert_as(N, ID) replaces GetOrInsertNode without profiling N again. The
+/// nodes need not derive from FoldingSetNode.
+template<typename T>
+struct FoldingSetFlatHashInfo {
+  static hash_code getHashValue(const FoldingSetNodeID &ID) {
+    return ID.ComputeHashCode();
+  }
+  static hash_code getHashValue(const T *N) {
+    FoldingSetNodeID ID;
+    FoldingSetTrait<T>::Profile(*const_cast<T *>(N), ID);
+    return getHashValue(ID);
+  }
+  static bool isEqual(const FoldingSetNodeID &ID, const T *N) {
+    FoldingSetNodeID TempID;
+    FoldingSetTrait<T>::Profile(*const_cast<T *>(N), TempID);
+    return ID == TempID;
+  }
+  static bool isEqual(const T *LHS, const T *RHS) {
+    if (LHS == RHS)
+      return true;
+    FoldingSetNodeID ID;
+    FoldingSetTrait<T>::Profile(*const_cast<T *>(LHS), ID);
+    return isEqual(ID, RHS);
+  }
+};
+
+namespace flat_hash_detail {
+
+typedef signed char ctrl_t;
+
+/// Control byte values. A full slot holds its 7-bit hash tag, 0 to 127, so
+/// exactly the empty and deleted slots have the sign bit set.
+enum {
+  CtrlEmpty = -128,
+  CtrlDeleted = -2
+};
+
+/// BitMask - The slots of a group selected by a match, one bit (or one bit
+/// per byte) per slot, lowest slot first.
+template<typename T, unsigned Width, unsigned Shift>
+class BitMask {
+  T Mask;
+
+public:
+  explicit BitMask(T M) : Mask(M) {}
+
+  bool any() const { return Mask != 0; }
+  void clearLowest() { Mask &= Mask - 1; }
+
+  /// lowestBitSet - The index of the first selected slot. Requires any().
+  unsigned lowestBitSet() const {
+    return countTrailingZeros(Mask, ZB_Undefined) >> Shift;
+  }
+
+  /// trailingZeros - The number of unselected slots before the first one.
+  unsigned trailingZeros() const {
+    return any() ? lowestBitSet() : Width;
+  }
+
+  /// leadingZeros - The number of unselected slots after the last one.
+  unsigned leadingZeros() const {
+    const unsigned ExtraBits = sizeof(T) * CHAR_BIT - (Width << Shift);
+    return (countLeadingZeros(Mask) - ExtraBits) >> Shift;
+  }
+};
+
+#if AKJ_FLAT_HASH_SSE2
+/// Group - 16 control bytes compared with SSE2.
+class Group {
+  __m128i Ctrl;
+
+  static BitMask<uint32_t, 16, 0> toMask(__m128i Bytes) {
+    return BitMask<uint32_t, 16, 0>(uint32_t(_mm_movemask_epi8(Bytes)));
+  }
+
+public:
+  enum { Width = 16 };
+  typedef BitMask<uint32_t, 16, 0> MaskTy;
+
+  explicit Group(const ctrl_t *Pos)
+    : Ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(Pos))) {}
+
+  MaskTy match(ctrl_t Tag) const {
+    return toMask(_mm_cmpeq_epi8(_mm_set1_epi8(Tag), Ctrl));
+  }
+  MaskTy matchEmpty() const {
+    return toMask(_mm_cmpeq_epi8(_mm_set1_epi8(char(CtrlEmpty)), Ctrl));
+  }
+  MaskTy matchEmptyOrDeleted() const {
+    // Only empty and deleted slots have the sign bit set.
+    return toMask(Ctrl);
+  }
+};
+#else
+/// Group - 8 control bytes compared as one 64-bit word. Byte I of the group
+/// is selected by bit 8*I+7 of a mask.
+class Group {
+  uint64_t Ctrl;
+
+  static uint64_t lsbs() { return 0x0101010101010101ULL; }
+  static uint64_t msbs() { return 0x8080808080808080ULL; }
+
+public:
+  enum { Width = 8 };
+  typedef BitMask<uint64_t, 8, 3> MaskTy;
+
+  explicit Group(const ctrl_t *Pos) {
+    memcpy(&Ctrl, Pos, sizeof(Ctrl));
+    if (sys::IsBigEndianHost)
+      Ctrl = sys::SwapByteOrder_64(Ctrl);
+  }
+
+  MaskTy match(ctrl_t Tag) const {
+    // Bytes equal to Tag become zero and are found with the usual zero byte
+    // test. A borrow can also select the byte after a true match, but only
+    // when that byte is a full slot, whose key is then compared and rejected.
+    uint64_t X = Ctrl ^ (lsbs() * uint8_t(Tag));
+    return MaskTy((X - lsbs()) & ~X & msbs());
+  }
+  MaskTy matchEmpty() const {
+    // 0x80 is the only control byte with the top bit set and bit 1 clear.
+    return MaskTy(Ctrl & (~Ctrl << 6) & msbs());
+  }
+  MaskTy matchEmptyOrDeleted() const {
+    return MaskTy(Ctrl & msbs());
+  }
+};
+#endif
+
+/// Identity - The key of a set element is the element.
+template<typename T>
+struct Identity {
+  const T &operator()(const T &V) const { return V; }
+};
+
+/// SelectFirst - The key of a map element is its first member.
+template<typename PairT>
+struct SelectFirst {
+  const typename PairT::first_type &operator()(const PairT &P) const {
+    return P.first;
+  }
+};
+
+/// Iterator - Walks the full slots of a table in slot order.
+template<typename ValueT, bool IsConst>
+class Iterator {
+  friend class Iterator<ValueT, true>;
+public:
+  typedef ptrdiff_t difference_type;
+  typedef typename conditional<IsConst, const ValueT, ValueT>::type value_type;
+  typedef value_type *pointer;
+  typedef value_type &reference;
+  typedef std::forward_iterator_tag iterator_category;
+
+private:
+  const ctrl_t *Ctrl, *End;
+  pointer Slot;
+
+  void skipFree() {
+    while (Ctrl != End && *Ctrl < 0) {
+      ++Ctrl;
+      ++Slot;
+    }
+  }
+
+public:
+  Iterator() : Ctrl(0), End(0), Slot(0) {}
+  Iterator(const ctrl_t *C, const ctrl_t *E, pointer S, bool NoAdvance = false)
+    : Ctrl(C), End(E), Slot(S) {
+    if (!NoAdvance)
+      skipFree();
+  }
+
+  // Converting constructor from non-const iterators to const iterators.
+  template<bool IsConstSrc>
+  Iterator(const Iterator<ValueT, IsConstSrc> &I)
+    : Ctrl(I.Ctrl), End(I.End), Slot(I.Slot) {}
+
+  reference operator*() const { return *Slot; }
+  pointer operator->() const { return Slot; }
+
+  bool operator==(const Iterator &RHS) const { return Ctrl == RHS.Ctrl; }
+  bool operator!=(const Iterator &RHS) const { return Ctrl != RHS.Ctrl; }
+
+  Iterator &operator++() {  // Preincrement
+    ++Ctrl;
+    ++Slot;
+    skipFree();
+    return *this;
+  }
+  Iterator operator++(int) {  // Postincrement
+    Iterator Tmp = *this; ++*this; return Tmp;
+  }
+};
+
+/// FlatHashTable - The table shared by FlatHashSet and FlatHashMap. KeyOfT
+/// extracts the key from an element, and InfoT hashes and compares keys.
+///
+/// The control bytes are followed by a copy of their first Group::Width - 1
+/// bytes, so that a group can be loaded at any slot without wrapping. The
+/// capacity is zero or a power of two no smaller than a group.
+template<typename ValueT, typename KeyT, typename KeyOfT, typename InfoT>
+class FlatHashTable {
+public:
+  typedef KeyT key_type;
+  typedef ValueT value_type;
+  typedef size_t size_type;
+  typedef Iterator<ValueT, false> iterator;
+  typedef Iterator<ValueT, true> const_iterator;
+
+private:
+  ctrl_t *Ctrl;
+  ValueT *Slots;
+  size_t Capacity;
+  size_t Size;
+  /// The number of empty slots that may still be filled before the table
+  /// has to grow or be cleaned of deleted slots.
+  size_t GrowthLeft;
+
+  static size_t maxLoad(size_t Cap) { return Cap - Cap / 8; }
+
+  static size_t slotOffset(size_t Cap) {
+    size_t Align = AlignOf<ValueT>::Alignment;
+    return (Cap + Group::Width + Align - 1) & ~(Align - 1);
+  }
+
+  static ctrl_t tagOf(size_t Hash) { return ctrl_t(Hash & 0x7F); }
+
+  template<typename LookupKeyT>
+  static size_t hashOf(const LookupKeyT &Key) {
+    return size_t(InfoT::getHashValue(Key));
+  }
+
+  void setCtrl(size_t I, ctrl_t C) {
+    Ctrl[I] = C;
+    // Keep the copy of the first group in step. For I >= Width this just
+    // stores to Ctrl[I] again.
+    Ctrl[((I - Group::Width) & (Capacity - 1)) + Group::Width] = C;
+  }
+
+  /// findIndex - Return the slot holding Key, or Capacity if there is none.
+  template<typename LookupKeyT>
+  size_t findIndex(const LookupKeyT &Key, size_t Hash) const {
+    if (Capacity == 0)
+      return 0;
+    const size_t Mask = Capacity - 1;
+    const ctrl_t Tag = tagOf(Hash);
+    size_t Pos = (Hash >> 7) & Mask;
+    size_t Stride = 0;
+    while (true) {
+      Group G(Ctrl + Pos);
+      for (typename Group::MaskTy M = G.match(Tag); M.any(); M.clearLowest()) {
+        size_t I = (Pos + M.lowestBitSet()) & Mask;
+        if (AKJ_LIKELY(InfoT::isEqual(Key, KeyOfT()(Slots[I]))))
+          return I;
+      }
+      if (AKJ_LIKELY(G.matchEmpty().any()))
+        return Capacity;
+      // Triangular steps of whole groups reach every group of a power of two
+      // table before repeating.
+      Stride += Group::Width;
+      Pos = (Pos + Stride) & Mask;
+    }
+  }
+
+  /// findFirstNonFull - Return the first empty or deleted slot on the probe
+  /// sequence of Hash. There always is one.
+  size_t findFirstNonFull(size_t Hash) const {
+    const size_t Mask = Capacity - 1;
+    size_t Pos = (Hash >> 7) & Mask;
+    size_t Stride = 0;
+    while (true) {
+      typename Group::MaskTy M = Group(Ctrl + Pos).matchEmptyOrDeleted();
+      if (AKJ_LIKELY(M.any()))
+        return (Pos + M.lowestBitSet()) & Mask;
+      Stride += Group::Width;
+      Pos = (Pos + Stride) & Mask;
+    }
+  }
+
+  /// findOrPrepareInsert - Return the slot holding Key and false, or a slot
+  /// whose control byte now claims it for Key and true. In the second case
+  /// the caller must construct the element in the slot.
+  template<typename LookupKeyT>
+  std::pair<size_t, bool> findOrPrepareInsert(const LookupKeyT &Key) {
+    size_t Hash = hashOf(Key);
+    size_t I = findIndex(Key, Hash);
+    if (I != Capacity)
+      return std::make_pair(I, false);
+
+    if (Capacity == 0) {
+      rehash(Group::Width);
+    } else {
+      I = findFirstNonFull(Hash);
+      if (AKJ_LIKELY(GrowthLeft != 0 || Ctrl[I] == CtrlDeleted))
+        return std::make_pair(claimSlot(I, Hash), true);
+      // Grow if the table is more than half full of live elements,
+      // otherwise rebuild it at the same size to drop the deleted slots.
+      rehash(Size * 2 >= maxLoad(Capacity) ? Capacity * 2 : Capacity);
+    }
+    return std::make_pair(claimSlot(findFirstNonFull(Hash), Hash), true);
+  }
+
+  size_t claimSlot(size_t I, size_t Hash) {
+    if (Ctrl[I] == CtrlEmpty)
+      --GrowthLeft;
+    ++Size;
+    setCtrl(I, tagOf(Hash));
+    return I;
+  }
+
+  void allocate(size_t Cap) {
+    Capacity = Cap;
+    char *Mem = static_cast<char *>(operator new(slotOffset(Cap) +
+                                                 Cap * sizeof(ValueT)));
+    Ctrl = reinterpret_cast<ctrl_t *>(Mem);
+    Slots = reinterpret_cast<ValueT *>(Mem + slotOffset(Cap));
+    memset(Ctrl, CtrlEmpty, Cap + Group::Width);
+    GrowthLeft = maxLoad(Cap);
+  }
+
+  /// rehash - Move every element into a new table of NewCap slots.
+  void rehash(size_t NewCap) {
+    assert(isPowerOf2_64(NewCap) && NewCap >= size_t(Group::Width) &&
+           maxLoad(NewCap) >= Size && "Bad table capacity!");
+    ctrl_t *OldCtrl = Ctrl;
+    ValueT *OldSlots = Slots;
+    size_t OldCap = Capacity;
+
+    allocate(NewCap);
+    for (size_t I = 0; I != OldCap; ++I) {
+      if (OldCtrl[I] < 0)
+        continue;
+      size_t Hash = hashOf(KeyOfT()(OldSlots[I]));
+      size_t J = findFirstNonFull(Hash);
+      setCtrl(J, tagOf(Hash));
+      new (&Slots[J]) ValueT(llvm_move(OldSlots[I]));
+      OldSlots[I].~ValueT();
+    }
+    GrowthLeft -= Size;
+
+    if (OldCap)
+      operator delete(OldCtrl);
+  }
+
+  void destroyAll() {
+    if (isPodLike<ValueT>::value)
+      return;
+    for (size_t I = 0; I != Capacity; ++I)
+      if (Ctrl[I] >= 0)
+        Slots[I].~ValueT();
+  }
+
+  /// eraseAt - Destroy the element in slot I. The slot becomes empty again
+  /// if no probe can have passed over it, which is the case when every
+  /// group containing it also has an empty slot.
+  void eraseAt(size_t I) {
+    Slots[I].~ValueT();
+    --Size;
+    size_t Before = (I - Group::Width) & (Capacity - 1);
+    typename Group::MaskTy EmptyBefore = Group(Ctrl + Before).matchEmpty();
+    typename Group::MaskTy EmptyAfter = Group(Ctrl + I).matchEmpty();
+    bool WasNeverFull = EmptyBefore.any() && EmptyAfter.any() &&
+      EmptyAfter.trailingZeros() + EmptyBefore.leadingZeros() <
+        unsigned(Group::Width);
+    if (WasNeverFull) {
+      setCtrl(I, CtrlEmpty);
+      ++GrowthLeft;
+    } else {
+      setCtrl(I, CtrlDeleted);
+    }
+  }
+
+  iterator makeIterator(size_t I) {
+    return iterator(Ctrl + I, Ctrl + Capacity, Slots + I, true);
+  }
+  const_iterator makeIterator(size_t I) const {
+    return const_iterator(Ctrl + I, Ctrl + Capacity, Slots + I, true);
+  }
+
+public:
+  explicit FlatHashTable(size_t NumElements = 0)
+    : Ctrl(0), Slots(0), Capacity(0), Size(0), GrowthLeft(0) {
+    reserve(NumElements);
+  }
+
+  FlatHashTable(const FlatHashTable &Other)
+    : Ctrl(0), Slots(0), Capacity(0), Size(0), GrowthLeft(0) {
+    reserve(Other.size());
+    for (const_iterator I = Other.begin(), E = Other.end(); I != E; ++I)
+      insert(*I);
+  }
+
+#if AKJ_HAS_RVALUE_REFERENCES
+  FlatHashTable(FlatHashTable &&Other)
+    : Ctrl(0), Slots(0), Capacity(0), Size(0), GrowthLeft(0) {
+    swap(Other);
+  }
+#endif
+
+  ~FlatHashTable() {
+    destroyAll();
+    if (Capacity)
+      operator delete(Ctrl);
+  }
+
+  FlatHashTable &operator=(FlatHashTable Other) {
+    swap(Other);
+    return *this;
+  }
+
+  void swap(FlatHashTable &RHS) {
+    std::swap(Ctrl, RHS.Ctrl);
+    std::swap(Slots, RHS.Slots);
+    std::swap(Capacity, RHS.Capacity);
+    std::swap(Size, RHS.Size);
+    std::swap(GrowthLeft, RHS.GrowthLeft);
+  }
+
+  // Iterators.
+  iterator begin() {
+    return iterator(Ctrl, Ctrl + Capacity, Slots);
+  }
+  iterator end() {
+    return iterator(Ctrl + Capacity, Ctrl + Capacity, Slots + Capacity, true);
+  }
+  const_iterator begin() const {
+    return const_iterator(Ctrl, Ctrl + Capacity, Slots);
+  }
+  const_iterator end() const {
+    return const_iterator(Ctrl + Capacity, Ctrl + Capacity, Slots + Capacity,
+                          true);
+  }
+
+  bool empty() const { return Size == 0; }
+  size_type size() const { return Size; }
+
+  /// capacity - The number of slots, of which at most 7/8 are ever full.
+  size_type capacity() const { return Capacity; }
+
+  /// getMemorySize - The number of bytes allocated for the table.
+  size_t getMemorySize() const {
+    return Capacity ? slotOffset(Capacity) + Capacity * sizeof(ValueT) : 0;
+  }
+
+  /// reserve - Grow the table so that NumElements elements fit without a
+  /// rehash. Does not shrink.
+  void reserve(size_t NumElements) {
+    if (NumElements == 0)
+      return;
+    size_t Cap = Group::Width;
+    while (maxLoad(Cap) < NumElements)
+      Cap *= 2;
+    if (Cap > Capacity)
+      rehash(Cap);
+  }
+
+  /// clear - Destroy every element but keep the slots.
+  void clear() {
+    if (Capacity == 0)
+      return;
+    destroyAll();
+    memset(Ctrl, CtrlEmpty, Capacity + Group::Width);
+    Size = 0;
+    GrowthLeft = maxLoad(Capacity);
+  }
+
+  size_type count(const KeyT &Key) const {
+    return findIndex(Key, hashOf(Key)) != Capacity ? 1 : 0;
+  }
+
+  iterator find(const KeyT &Key) {
+    return makeIterator(findIndex(Key, hashOf(Key)));
+  }
+  const_iterator find(const KeyT &Key) const {
+    return makeIterator(findIndex(Key, hashOf(Key)));
+  }
+
+  /// Alternate version of find() which allows a different, and possibly less
+  /// expensive, key type. The InfoT is responsible for supplying
+  /// getHashValue(LookupKeyT) and isEqual(LookupKeyT, KeyT) for each key type
+  /// used, and equal keys must hash the same.
+  template<class LookupKeyT>
+  iterator find_as(const LookupKeyT &Key) {
+    return makeIterator(findIndex(Key, hashOf(Key)));
+  }
+  template<class LookupKeyT>
+  const_iterator find_as(const LookupKeyT &Key) const {
+    return makeIterator(findIndex(Key, hashOf(Key)));
+  }
+
+  /// insert - Insert a copy of V unless an element with the same key is
+  /// already present. Returns the element with that key and whether it was
+  /// inserted.
+  std::pair<iterator, bool> insert(const ValueT &V) {
+    std::pair<size_t, bool> R = findOrPrepareInsert(KeyOfT()(V));
+    if (R.second)
+      new (&Slots[R.first]) ValueT(V);
+    return std::make_pair(makeIterator(R.first), R.second);
+  }
+
+#if AKJ_HAS_RVALUE_REFERENCES
+  std::pair<iterator, bool> insert(ValueT &&V) {
+    std::pair<size_t, bool> R = findOrPrepareInsert(KeyOfT()(V));
+    if (R.second)
+      new (&Slots[R.first]) ValueT(std::move(V));
+    return std::make_pair(makeIterator(R.first), R.second);
+  }
+#endif
+
+  /// insert_as - Like insert, but look V up by Key, which must compare and
+  /// hash the same as V's key. Useful when the caller already has a cheaper
+  /// form of the key than V itself provides.
+  template<class LookupKeyT>
+  std::pair<iterator, bool> insert_as(const ValueT &V, const LookupKeyT &Key) {
+    std::pair<size_t, bool> R = findOrPrepareInsert(Key);
+    if (R.second)
+      new (&Slots[R.first]) ValueT(V);
+    return std::make_pair(makeIterator(R.first), R.second);
+  }
+
+  // Range insertion of values.
+  template<typename InputIt>
+  void insert(InputIt I, InputIt E) {
+    for (; I != E; ++I)
+      insert(*I);
+  }
+
+  bool erase(const KeyT &Key) {
+    size_t I = findIndex(Key, hashOf(Key));
+    if (I == Capacity)
+      return false;
+    eraseAt(I);
+    return true;
+  }
+  void erase(const_iterator I) {
+    assert(I != end() && "Can't erase end()!");
+    eraseAt(size_t(&*I - Slots));
+  }
+
+protected:
+  /// findOrConstruct - Return the element with Key, inserting one built from
+  /// Key with MakeValue(Key) if there is none.
+  template<typename MakeT>
+  ValueT &findOrConstruct(const KeyT &Key, MakeT MakeValue) {
+    std::pair<size_t, bool> R = findOrPrepareInsert(Key);
+    if (R.second)
+      new (&Slots[R.first]) ValueT(MakeValue(Key));
+    return Slots[R.first];
+  }
+};
+
+} // end namespace flat_hash_detail
+
+/// FlatHashSet - A set of values kept in a flat_hash_detail::FlatHashTable.
+template<typename ValueT, typename InfoT = FlatHashInfo<ValueT> >
+class FlatHashSet
+    : public flat_hash_detail::FlatHashTable<
+          ValueT, ValueT, flat_hash_detail::Identity<ValueT>, InfoT> {
+  typedef flat_hash_detail::FlatHashTable<
+      ValueT, ValueT, flat_hash_detail::Identity<ValueT>, InfoT> BaseT;
+
+public:
+  explicit FlatHashSet(size_t NumElements = 0) : BaseT(NumElements) {}
+
+  template<typename InputIt>
+  FlatHashSet(const InputIt &I, const InputIt &E) {
+    this->insert(I, E);
+  }
+};
+
+/// FlatHashMap - A map from KeyT to ValueT kept in a
+/// flat_hash_detail::FlatHashTable. Its elements are std::pair<KeyT, ValueT>,
+/// as in DenseMap.
+template<typename KeyT, typename ValueT, typename InfoT = FlatHashInfo<KeyT> >
+class FlatHashMap
+    : public flat_hash_detail::FlatHashTable<
+          std::pair<KeyT, ValueT>, KeyT,
+          flat_hash_detail::SelectFirst<std::pair<KeyT, ValueT> >, InfoT> {
+  typedef flat_hash_detail::FlatHashTable<
+      std::pair<KeyT, ValueT>, KeyT,
+      flat_hash_detail::SelectFirst<std::pair<KeyT, ValueT> >, InfoT> BaseT;
+
+  static std::pair<KeyT, ValueT> makeDefault(const KeyT &Key) {
+    return std::pair<KeyT, ValueT>(Key, ValueT());
+  }
+
+public:
+  typedef ValueT mapped_type;
+  typedef std::pair<KeyT, ValueT> value_type;
+
+  explicit FlatHashMap(size_t NumElements = 0) : BaseT(NumElements) {}
+
+  template<typename InputIt>
+  FlatHashMap(const InputIt &I, const InputIt &E) {
+    this->insert(I, E);
+  }
+
+  /// lookup - Return the entry for the specified key, or a default
+  /// constructed value if no such entry exists.
+  ValueT lookup(const KeyT &Key) const {
+    typename BaseT::const_iterator I = this->find(Key);
+    if (I != this->end())
+      return I->second;
+    return ValueT();
+  }
+
+  value_type &FindAndConstruct(const KeyT &Key) {
+    return this->findOrConstruct(Key, &FlatHashMap::makeDefault);
+  }
+
+  ValueT &operator[](const KeyT &Key) {
+    return FindAndConstruct(Key).second;
+  }
+};
+
+} // end namespace akj
@@ -29,7 +29,18 @@ using namespace akj;
 /// ComputeHash - Compute a strong hash value for this FoldingSetNodeIDRef,
 /// used to lookup the node in the FoldingSetImpl.
 unsigned FoldingSetNodeIDRef::ComputeHash() const {
-  return static_cast<unsigned>(hash_combine_range(Data, Data+Size));
+  return static_cast<unsigned>(ComputeHashCode());
+}
+
+/// ComputeHashCode - Compute the full hash_code that ComputeHash truncates.
+hash_code FoldingSetNodeIDRef::ComputeHashCode() const {
+  return hash_combine_range(Data, Data+Size);
+}
+
+/// ComputeHash128 - Compute a 128-bit hash of this FoldingSetNodeIDRef. Its
+/// low half truncates to ComputeHash().
+hash_code128 FoldingSetNodeIDRef::ComputeHash128() const {
+  return hash_combine_range128(Data, Data+Size);
 }
 
 bool FoldingSetNodeIDRef::operator==(FoldingSetNodeIDRef RHS) const {
@@ -147,6 +158,16 @@ unsigned FoldingSetNodeID::ComputeHash() const {
   return FoldingSetNodeIDRef(Bits.data(), Bits.size()).ComputeHash();
 }
 
+/// ComputeHashCode - Compute the full hash_code that ComputeHash truncates.
+hash_code FoldingSetNodeID::ComputeHashCode() const {
+  return FoldingSetNodeIDRef(Bits.data(), Bits.size()).ComputeHashCode();
+}
+
+/// ComputeHash128 - Compute a 128-bit hash of this FoldingSetNodeID.
+hash_code128 FoldingSetNodeID::ComputeHash128() const {
+  return FoldingSetNodeIDRef(Bits.data(), Bits.size()).ComputeHash128();
+}
+
 /// operator== - Used to compare two nodes to each other.
 ///
 bool FoldingSetNodeID::operator==(const FoldingSetNodeID &RHS) const {
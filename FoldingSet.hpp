@@ -20,6 +20,8 @@
 
 namespace akj {
   class BumpPtrAllocator;
+  class hash_code;
+  class hash_code128;
 
 /// This folding set used for two purposes:
 ///   1. Given information about a node we want to create, look up the unique
@@ -272,6 +274,14 @@ public:
   /// used to lookup the node in the FoldingSetImpl.
   unsigned ComputeHash() const;
 
+  /// ComputeHashCode - Compute the full hash_code that ComputeHash truncates,
+  /// for hash tables that use all of its bits.
+  hash_code ComputeHashCode() const;
+
+  /// ComputeHash128 - Compute a 128-bit hash of this FoldingSetNodeIDRef, for
+  /// callers that key their own caches on the hash alone.
+  hash_code128 ComputeHash128() const;
+
   bool operator==(FoldingSetNodeIDRef) const;
 
   /// Used to compare the "ordering" of two nodes as defined by the
@@ -322,6 +332,12 @@ public:
   /// to lookup the node in the FoldingSetImpl.
   unsigned ComputeHash() const;
 
+  /// ComputeHashCode - Compute the full hash_code that ComputeHash truncates.
+  hash_code ComputeHashCode() const;
+
+  /// ComputeHash128 - Compute a 128-bit hash of this FoldingSetNodeID.
+  hash_code128 ComputeHash128() const;
+
   /// operator== - Used to compare two nodes to each other.
   ///
   bool operator==(const FoldingSetNodeID &RHS) const;
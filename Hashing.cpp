@@ -25,3 +25,312 @@ size_t akj::hashing::detail::fixed_seed_override = 0;
 void akj::set_fixed_execution_hash_seed(size_t fixed_value) {
   hashing::detail::fixed_seed_override = fixed_value;
 }
+
+//===----------------------------------------------------------------------===//
+// Bulk hashing
+//===----------------------------------------------------------------------===//
+//
+// hash_bulk_long keeps eight 64-bit accumulators, one per 8 bytes of each
+// 64-byte stripe. Every stripe adds, to each lane, the product of the low and
+// high halves of the data xor a key, and the data of the neighbouring lane.
+// The products are 32x32->64 bit multiplies, which SSE2 and AVX2 do two and
+// four at a time. The key depends on the stripe's position in its 1 KB block,
+// so reordering stripes changes the result, and the accumulators are
+// scrambled with a multiply after every block. The layout follows XXH3.
+//
+//===----------------------------------------------------------------------===//
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+# define AKJ_HASH_X86 1
+# if defined(_MSC_VER)
+#  include <intrin.h>
+#  define AKJ_HASH_TARGET(x)
+# else
+#  include <cpuid.h>
+#  define AKJ_HASH_TARGET(x) __attribute__((target(x)))
+# endif
+# include <immintrin.h>
+#else
+# define AKJ_HASH_X86 0
+#endif
+
+namespace akj {
+namespace hashing {
+namespace detail {
+namespace {
+
+const size_t HashBulkStripeSize = 64;
+const size_t HashBulkStripesPerBlock = 16;
+const size_t HashBulkBlockSize = HashBulkStripeSize * HashBulkStripesPerBlock;
+/// Stripe N of a block uses keys N to N + 7; the scramble after the block
+/// uses the last eight.
+const size_t HashBulkNumKeys = HashBulkStripesPerBlock + 8;
+/// Where the keys of the final, overlapping stripe start.
+const size_t HashBulkLastStripeKeys = 9;
+const uint32_t HashBulkPrime = 0x9E3779B1U;
+
+struct HashBulkKeys {
+  uint64_t Keys[HashBulkNumKeys];
+
+  /// The keys for seed 0, which other seeds are added to and subtracted
+  /// from. Deriving every key from the seed afresh would cost more than
+  /// hashing a short input.
+  static const HashBulkKeys &getBase() {
+    static const HashBulkKeys Base;
+    return Base;
+  }
+
+  HashBulkKeys() {
+    for (size_t I = 0; I != HashBulkNumKeys; ++I)
+      Keys[I] = hash_16_bytes(I * k0, k3 ^ I);
+  }
+
+  explicit HashBulkKeys(uint64_t Seed) {
+    const HashBulkKeys &Base = getBase();
+    for (size_t I = 0; I != HashBulkNumKeys; ++I)
+      Keys[I] = Base.Keys[I] + (I & 1 ? 0 - Seed : Seed);
+  }
+};
+
+typedef void (*HashBulkAccumulateFn)(uint64_t *Acc, const char *S,
+                                     size_t NumStripes, const uint64_t *Keys);
+typedef void (*HashBulkScrambleFn)(uint64_t *Acc, const uint64_t *Keys);
+
+void hashBulkAccumulate(uint64_t *Acc, const char *S, size_t NumStripes,
+                        const uint64_t *Keys) {
+  for (size_t N = 0; N != NumStripes; ++N, S += HashBulkStripeSize) {
+    for (unsigned I = 0; I != 8; ++I) {
+      uint64_t Data = fetch64(S + 8 * I);
+      uint64_t Keyed = Data ^ Keys[N + I];
+      Acc[I ^ 1] += Data;
+      Acc[I] += (Keyed & 0xffffffff) * (Keyed >> 32);
+    }
+  }
+}
+
+void hashBulkScramble(uint64_t *Acc, const uint64_t *Keys) {
+  for (unsigned I = 0; I != 8; ++I) {
+    uint64_t A = shift_mix(Acc[I]) ^ Keys[I];
+    Acc[I] = A * HashBulkPrime;
+  }
+}
+
+#if AKJ_HASH_X86
+
+AKJ_HASH_TARGET("sse2")
+void hashBulkAccumulateSSE2(uint64_t *Acc, const char *S, size_t NumStripes,
+                            const uint64_t *Keys) {
+  __m128i A[4];
+  for (unsigned J = 0; J != 4; ++J)
+    A[J] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Acc) + J);
+  for (size_t N = 0; N != NumStripes; ++N, S += HashBulkStripeSize) {
+    for (unsigned J = 0; J != 4; ++J) {
+      __m128i Data =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(S) + J);
+      __m128i Key =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(Keys + N + 2 * J));
+      __m128i Keyed = _mm_xor_si128(Data, Key);
+      __m128i Product = _mm_mul_epu32(Keyed, _mm_srli_epi64(Keyed, 32));
+      __m128i Swapped = _mm_shuffle_epi32(Data, _MM_SHUFFLE(1, 0, 3, 2));
+      A[J] = _mm_add_epi64(A[J], _mm_add_epi64(Product, Swapped));
+    }
+  }
+  for (unsigned J = 0; J != 4; ++J)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Acc) + J, A[J]);
+}
+
+AKJ_HASH_TARGET("sse2")
+void hashBulkScrambleSSE2(uint64_t *Acc, const uint64_t *Keys) {
+  const __m128i Prime = _mm_set1_epi32(int(HashBulkPrime));
+  for (unsigned J = 0; J != 4; ++J) {
+    __m128i A = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Acc) + J);
+    __m128i Key =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(Keys) + J);
+    A = _mm_xor_si128(_mm_xor_si128(A, _mm_srli_epi64(A, 47)), Key);
+    __m128i Low = _mm_mul_epu32(A, Prime);
+    __m128i High = _mm_mul_epu32(_mm_srli_epi64(A, 32), Prime);
+    A = _mm_add_epi64(Low, _mm_slli_epi64(High, 32));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Acc) + J, A);
+  }
+}
+
+AKJ_HASH_TARGET("avx2")
+void hashBulkAccumulateAVX2(uint64_t *Acc, const char *S, size_t NumStripes,
+                            const uint64_t *Keys) {
+  __m256i A0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Acc));
+  __m256i A1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Acc) + 1);
+  for (size_t N = 0; N != NumStripes; ++N, S += HashBulkStripeSize) {
+    const __m256i *Data = reinterpret_cast<const __m256i *>(S);
+    const __m256i *Key = reinterpret_cast<const __m256i *>(Keys + N);
+    __m256i D0 = _mm256_loadu_si256(Data);
+    __m256i D1 = _mm256_loadu_si256(Data + 1);
+    __m256i K0 = _mm256_xor_si256(D0, _mm256_loadu_si256(Key));
+    __m256i K1 = _mm256_xor_si256(D1, _mm256_loadu_si256(Key + 1));
+    __m256i P0 = _mm256_mul_epu32(K0, _mm256_srli_epi64(K0, 32));
+    __m256i P1 = _mm256_mul_epu32(K1, _mm256_srli_epi64(K1, 32));
+    // Swaps the 64-bit halves of each 128-bit lane, like I ^ 1 does.
+    __m256i S0 = _mm256_shuffle_epi32(D0, _MM_SHUFFLE(1, 0, 3, 2));
+    __m256i S1 = _mm256_shuffle_epi32(D1, _MM_SHUFFLE(1, 0, 3, 2));
+    A0 = _mm256_add_epi64(A0, _mm256_add_epi64(P0, S0));
+    A1 = _mm256_add_epi64(A1, _mm256_add_epi64(P1, S1));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(Acc), A0);
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(Acc) + 1, A1);
+}
+
+AKJ_HASH_TARGET("avx2")
+void hashBulkScrambleAVX2(uint64_t *Acc, const uint64_t *Keys) {
+  const __m256i Prime = _mm256_set1_epi32(int(HashBulkPrime));
+  for (unsigned J = 0; J != 2; ++J) {
+    __m256i A = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Acc) + J);
+    __m256i Key =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Keys) + J);
+    A = _mm256_xor_si256(_mm256_xor_si256(A, _mm256_srli_epi64(A, 47)), Key);
+    __m256i Low = _mm256_mul_epu32(A, Prime);
+    __m256i High = _mm256_mul_epu32(_mm256_srli_epi64(A, 32), Prime);
+    A = _mm256_add_epi64(Low, _mm256_slli_epi64(High, 32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(Acc) + J, A);
+  }
+}
+
+/// hasHashAVX2 - Return true if both the processor and the operating system
+/// support AVX2.
+bool hasHashAVX2() {
+#if defined(_MSC_VER)
+  int Regs[4];
+  __cpuid(Regs, 1);
+  unsigned ECX = unsigned(Regs[2]);
+  if (!((ECX >> 27) & 1) || !((ECX >> 28) & 1))
+    return false;
+  if ((_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(Regs, 7, 0);
+  return (unsigned(Regs[1]) >> 5) & 1;
+#else
+  unsigned EAX, EBX, ECX, EDX;
+  if (!__get_cpuid(1, &EAX, &EBX, &ECX, &EDX))
+    return false;
+  // The OS must have enabled saving the YMM registers (OSXSAVE and AVX).
+  if (!((ECX >> 27) & 1) || !((ECX >> 28) & 1))
+    return false;
+  unsigned XCR0Low, XCR0High;
+  __asm__("xgetbv" : "=a"(XCR0Low), "=d"(XCR0High) : "c"(0));
+  if ((XCR0Low & 6) != 6)
+    return false;
+  if (__get_cpuid_max(0, 0) < 7)
+    return false;
+  __cpuid_count(7, 0, EAX, EBX, ECX, EDX);
+  return (EBX >> 5) & 1;
+#endif
+}
+
+#endif // AKJ_HASH_X86
+
+struct HashBulkImpl {
+  HashBulkAccumulateFn Accumulate;
+  HashBulkScrambleFn Scramble;
+
+  HashBulkImpl() : Accumulate(hashBulkAccumulate), Scramble(hashBulkScramble) {
+#if AKJ_HASH_X86
+    if (hasHashAVX2()) {
+      Accumulate = hashBulkAccumulateAVX2;
+      Scramble = hashBulkScrambleAVX2;
+    } else {
+      Accumulate = hashBulkAccumulateSSE2;
+      Scramble = hashBulkScrambleSSE2;
+    }
+#endif
+  }
+};
+
+const HashBulkImpl &getHashBulkImpl() {
+  static const HashBulkImpl Impl;
+  return Impl;
+}
+
+} // end anonymous namespace
+
+uint64_t hash_bulk_long(const char *s, size_t length,
+                        uint64_t seed) {
+  assert(length > HashBulkStripeSize && "too short for the bulk hash");
+  const HashBulkImpl &Impl = getHashBulkImpl();
+  const HashBulkKeys Keys(seed);
+  uint64_t Acc[8] = { k0, k1, k2, k3, HashBulkPrime, ~k0, ~k1, ~k2 };
+
+  // The last block has between 1 and HashBulkBlockSize bytes.
+  size_t NumBlocks = (length - 1) / HashBulkBlockSize;
+  for (size_t B = 0; B != NumBlocks; ++B) {
+    Impl.Accumulate(Acc, s + B * HashBulkBlockSize, HashBulkStripesPerBlock,
+                    Keys.Keys);
+    Impl.Scramble(Acc, Keys.Keys + HashBulkStripesPerBlock);
+  }
+  // Whole stripes of the last block, not counting the final one, which is
+  // always the last 64 bytes even if that overlaps the stripe before it.
+  size_t Rest = length - NumBlocks * HashBulkBlockSize;
+  Impl.Accumulate(Acc, s + NumBlocks * HashBulkBlockSize,
+                  (Rest - 1) / HashBulkStripeSize, Keys.Keys);
+  Impl.Accumulate(Acc, s + length - HashBulkStripeSize, 1,
+                  Keys.Keys + HashBulkLastStripeKeys);
+
+  uint64_t Result = length * k1;
+  for (unsigned I = 0; I != 4; ++I)
+    Result += hash_16_bytes(Acc[2 * I] ^ Keys.Keys[2 * I + 1],
+                            Acc[2 * I + 1] ^ Keys.Keys[2 * I + 2]);
+  return hash_16_bytes(shift_mix(Result), seed ^ length);
+}
+
+} // namespace detail
+} // namespace hashing
+} // namespace akj
+
+//===----------------------------------------------------------------------===//
+// Batch hashing
+//===----------------------------------------------------------------------===//
+
+#if defined(__GNUC__) || defined(__clang__)
+# define AKJ_HASH_PREFETCH(p) __builtin_prefetch(p)
+#elif AKJ_HASH_X86
+# define AKJ_HASH_PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+# define AKJ_HASH_PREFETCH(p) ((void)0)
+#endif
+
+void akj::hash_values(cArrayRef<cStringRef> Keys,
+                      cMutableArrayRef<hash_code> Out) {
+  using namespace hashing::detail;
+  assert(Out.size() >= Keys.size() && "output array too small");
+  const cStringRef *K = Keys.data();
+  hash_code *O = Out.data();
+  const size_t N = Keys.size();
+  const uint64_t Seed = get_execution_seed();
+
+  // Keys are hashed four at a time, and the data of the keys eight positions
+  // ahead is prefetched so that it is (hopefully) in cache when it's reached.
+  const size_t Group = 4, Ahead = 8;
+  for (size_t I = 0; I != N && I != Ahead; ++I)
+    AKJ_HASH_PREFETCH(K[I].data());
+
+  size_t I = 0;
+  for (; I + Group <= N; I += Group) {
+    if (I + Ahead + Group <= N)
+      for (size_t J = 0; J != Group; ++J)
+        AKJ_HASH_PREFETCH(K[I + Ahead + J].data());
+    // Load all four keys before storing any hash; otherwise the compiler
+    // has to assume a store to Out may change the next key.
+    const char *S0 = K[I].data(), *S1 = K[I + 1].data();
+    const char *S2 = K[I + 2].data(), *S3 = K[I + 3].data();
+    size_t L0 = K[I].size(), L1 = K[I + 1].size();
+    size_t L2 = K[I + 2].size(), L3 = K[I + 3].size();
+    uint64_t H0 = hash_contiguous(S0, L0, Seed);
+    uint64_t H1 = hash_contiguous(S1, L1, Seed);
+    uint64_t H2 = hash_contiguous(S2, L2, Seed);
+    uint64_t H3 = hash_contiguous(S3, L3, Seed);
+    O[I] = hash_code(H0);
+    O[I + 1] = hash_code(H1);
+    O[I + 2] = hash_code(H2);
+    O[I + 3] = hash_code(H3);
+  }
+  for (; I != N; ++I)
+    O[I] = hash_code(hash_contiguous(K[I].data(), K[I].size(), Seed));
+}
@@ -43,7 +43,9 @@
 
 #pragma once
 
+#include "ArrayRef.hpp"
 #include "STLExtras.hpp"
+#include "StringRef.hpp"
 #include <stdint.h>
 #include "SwapByteOrder.hpp"
 #include "TypeTraits.hpp"
@@ -80,15 +82,17 @@ public:
   hash_code() {}
 
   /// \brief Form a hash code directly from a numerical value.
-  hash_code(size_t value) : value(value) {}
+  AKJ_CONSTEXPR hash_code(size_t value) : value(value) {}
 
   /// \brief Convert the hash code to its numerical value for use.
-  /*explicit*/ operator size_t() const { return value; }
+  /*explicit*/ AKJ_CONSTEXPR operator size_t() const { return value; }
 
-  friend bool operator==(const hash_code &lhs, const hash_code &rhs) {
+  friend AKJ_CONSTEXPR bool operator==(const hash_code &lhs,
+                                       const hash_code &rhs) {
     return lhs.value == rhs.value;
   }
-  friend bool operator!=(const hash_code &lhs, const hash_code &rhs) {
+  friend AKJ_CONSTEXPR bool operator!=(const hash_code &lhs,
+                                       const hash_code &rhs) {
     return lhs.value != rhs.value;
   }
 
@@ -96,6 +100,44 @@ public:
   friend size_t hash_value(const hash_code &code) { return code.value; }
 };
 
+/// \brief An opaque object representing a 128-bit hash code.
+///
+/// This is the wide counterpart of hash_code, for uses such as content
+/// addressed caches where a 64-bit hash collides too often to trust a match
+/// without comparing the data. The low half is the hash_code the same data
+/// would get from the 64-bit functions. Like hash_code, the value is not
+/// stable across executions unless the seed is fixed.
+class hash_code128 {
+  uint64_t low, high;
+
+public:
+  /// \brief Default construct a hash_code128.
+  /// Note that this leaves the value uninitialized.
+  hash_code128() {}
+
+  /// \brief Form a hash code directly from its two halves.
+  hash_code128(uint64_t low, uint64_t high) : low(low), high(high) {}
+
+  uint64_t getLow() const { return low; }
+  uint64_t getHigh() const { return high; }
+
+  friend bool operator==(const hash_code128 &lhs, const hash_code128 &rhs) {
+    return lhs.low == rhs.low && lhs.high == rhs.high;
+  }
+  friend bool operator!=(const hash_code128 &lhs, const hash_code128 &rhs) {
+    return !(lhs == rhs);
+  }
+  /// \brief Order hash codes, so that they can key sorted containers.
+  friend bool operator<(const hash_code128 &lhs, const hash_code128 &rhs) {
+    return lhs.high != rhs.high ? lhs.high < rhs.high : lhs.low < rhs.low;
+  }
+
+  /// \brief Allow a hash_code128 to be directly run through hash_value.
+  friend size_t hash_value(const hash_code128 &code) {
+    return size_t(code.low);
+  }
+};
+
 /// \brief Compute a hash_code for any integer value.
 ///
 /// Note that this function is intended to compute the same hash_code for
@@ -313,8 +355,44 @@ struct hash_state {
     return hash_16_bytes(hash_16_bytes(h3, h5) + shift_mix(h1) * k1 + h2,
                          hash_16_bytes(h4, h6) + shift_mix(length) * k1 + h0);
   }
+
+  /// \brief Compute the high half of the 128-bit hash code, whose low half
+  /// is finalize(). The state holds far more than 128 bits, so the two are
+  /// drawn from it independently.
+  uint64_t finalize_high(size_t length) {
+    return hash_16_bytes(hash_16_bytes(h0 + k3, h4) + shift_mix(h6) * k0 + h5,
+                         hash_16_bytes(h1, h2 ^ k2) +
+                             shift_mix(length ^ k1) * k0 + h3);
+  }
 };
 
+/// \brief Derive the seed for the high half of a 128-bit hash of a short
+/// input, which is the short hash run a second time.
+inline uint64_t get_high_seed(uint64_t seed) {
+  return shift_mix(seed ^ k1) * k0;
+}
+
+/// \brief Finish a hash of at most 64 bytes, for either width of hash code.
+inline hash_code finish_short(const char *s, size_t length, uint64_t seed,
+                              hash_code *) {
+  return hash_short(s, length, seed);
+}
+inline hash_code128 finish_short(const char *s, size_t length, uint64_t seed,
+                                 hash_code128 *) {
+  return hash_code128(hash_short(s, length, seed),
+                      hash_short(s, length, get_high_seed(seed)));
+}
+
+/// \brief Finish a hash that went through hash_state, for either width of
+/// hash code.
+inline hash_code finish_state(hash_state &state, size_t length, hash_code *) {
+  return state.finalize(length);
+}
+inline hash_code128 finish_state(hash_state &state, size_t length,
+                                 hash_code128 *) {
+  return hash_code128(state.finalize(length), state.finalize_high(length));
+}
+
 
 /// \brief A global, fixed seed-override variable.
 ///
@@ -323,6 +401,9 @@ struct hash_state {
 /// set or read this variable.
 extern size_t fixed_seed_override;
 
+/// \brief The seed used when no fixed seed override is set.
+const uint64_t seed_prime = 0xff51afd7ed558ccdULL;
+
 inline size_t get_execution_seed() {
   // FIXME: This needs to be a per-execution seed. This is just a placeholder
   // implementation. Switching to a per-execution seed is likely to flush out
@@ -330,7 +411,6 @@ inline size_t get_execution_seed() {
   //
   // However, if there is a fixed seed override set the first time this is
   // called, return that instead of the per-execution seed.
-  const uint64_t seed_prime = 0xff51afd7ed558ccdULL;
   static size_t seed = fixed_seed_override ? fixed_seed_override
                                            : (size_t)seed_prime;
   return seed;
@@ -440,6 +520,29 @@ hash_code hash_combine_range_impl(InputIteratorT first, InputIteratorT last) {
   return state.finalize(length);
 }
 
+/// \brief Hash a contiguous byte sequence with an explicit seed.
+///
+/// This is the algorithm behind hash_combine_range for pointers to hashable
+/// data, which passes the execution seed.
+inline uint64_t hash_contiguous(const char *s_begin, size_t length,
+                                uint64_t seed) {
+  if (length <= 64)
+    return hash_short(s_begin, length, seed);
+
+  const char *s_end = s_begin + length;
+  const char *s_aligned_end = s_begin + (length & ~63);
+  hash_state state = state.create(s_begin, seed);
+  s_begin += 64;
+  while (s_begin != s_aligned_end) {
+    state.mix(s_begin);
+    s_begin += 64;
+  }
+  if (length & 63)
+    state.mix(s_end - 64);
+
+  return state.finalize(length);
+}
+
 /// \brief Implement the combining of integral values into a hash_code.
 ///
 /// This overload is selected when the value type of the iterator is integral
@@ -451,13 +554,19 @@ hash_code hash_combine_range_impl(InputIteratorT first, InputIteratorT last) {
 template <typename ValueT>
 typename enable_if<is_hashable_data<ValueT>, hash_code>::type
 hash_combine_range_impl(ValueT *first, ValueT *last) {
-  const size_t seed = get_execution_seed();
   const char *s_begin = reinterpret_cast<const char *>(first);
   const char *s_end = reinterpret_cast<const char *>(last);
-  const size_t length = std::distance(s_begin, s_end);
+  return hash_contiguous(s_begin, std::distance(s_begin, s_end),
+                         get_execution_seed());
+}
+
+/// \brief Hash a contiguous byte sequence into a 128-bit hash code.
+inline hash_code128 hash_contiguous128(const char *s_begin, size_t length,
+                                       uint64_t seed) {
   if (length <= 64)
-    return hash_short(s_begin, length, seed);
+    return finish_short(s_begin, length, seed, (hash_code128 *)0);
 
+  const char *s_end = s_begin + length;
   const char *s_aligned_end = s_begin + (length & ~63);
   hash_state state = state.create(s_begin, seed);
   s_begin += 64;
@@ -468,13 +577,97 @@ hash_combine_range_impl(ValueT *first, ValueT *last) {
   if (length & 63)
     state.mix(s_end - 64);
 
-  return state.finalize(length);
+  return finish_state(state, length, (hash_code128 *)0);
 }
 
+/// \brief Implement hash_combine_range128 over an arbitrary sequence. See
+/// hash_combine_range_impl.
+template <typename InputIteratorT>
+hash_code128 hash_combine_range128_impl(InputIteratorT first,
+                                        InputIteratorT last) {
+  const size_t seed = get_execution_seed();
+  char buffer[64], *buffer_ptr = buffer;
+  char *const buffer_end = buffer_ptr + array_lengthof(buffer);
+  while (first != last && store_and_advance(buffer_ptr, buffer_end,
+                                            get_hashable_data(*first)))
+    ++first;
+  if (first == last)
+    return finish_short(buffer, buffer_ptr - buffer, seed, (hash_code128 *)0);
+  assert(buffer_ptr == buffer_end);
+
+  hash_state state = state.create(buffer, seed);
+  size_t length = 64;
+  while (first != last) {
+    buffer_ptr = buffer;
+    while (first != last && store_and_advance(buffer_ptr, buffer_end,
+                                              get_hashable_data(*first)))
+      ++first;
+    std::rotate(buffer, buffer_ptr, buffer_end);
+    state.mix(buffer);
+    length += buffer_ptr - buffer;
+  }
+
+  return finish_state(state, length, (hash_code128 *)0);
+}
+
+/// \brief Implement hash_combine_range128 over contiguous hashable data.
+template <typename ValueT>
+typename enable_if<is_hashable_data<ValueT>, hash_code128>::type
+hash_combine_range128_impl(ValueT *first, ValueT *last) {
+  const char *s_begin = reinterpret_cast<const char *>(first);
+  const char *s_end = reinterpret_cast<const char *>(last);
+  return hash_contiguous128(s_begin, std::distance(s_begin, s_end),
+                            get_execution_seed());
+}
+
+/// \brief The length above which hash_bulk switches to the wide algorithm.
+const size_t hash_bulk_threshold = 1024;
+
+/// \brief Hash a byte sequence longer than hash_bulk_threshold with eight
+/// independent lanes of state, using AVX2 or SSE2 when the processor has
+/// them. Every code path produces the same value.
+uint64_t hash_bulk_long(const char *s, size_t length, uint64_t seed);
+
 } // namespace detail
 } // namespace hashing
 
 
+/// \brief Compute a hash_code for a large block of bytes, such as the
+/// contents of a file.
+///
+/// Given the execution seed, inputs of up to
+/// hashing::detail::hash_bulk_threshold bytes hash exactly like
+/// hash_value(cStringRef). Longer ones go through a separate algorithm
+/// whose state is split into eight lanes that are updated independently, so
+/// that SIMD units can work on all of them at once. That is usually faster
+/// on long inputs (about twice as fast in benchmarks/HashBenchmark.cpp),
+/// but gives different values than hash_value for them, so the two must not
+/// be mixed for the same data.
+inline hash_code hash_bulk(cStringRef Data, uint64_t Seed) {
+  if (Data.size() <= ::akj::hashing::detail::hash_bulk_threshold)
+    return ::akj::hashing::detail::hash_contiguous(Data.data(), Data.size(),
+                                                   Seed);
+  return ::akj::hashing::detail::hash_bulk_long(Data.data(), Data.size(),
+                                                Seed);
+}
+
+/// \brief Compute a hash_code for a large block of bytes with the execution
+/// seed. See hash_bulk(cStringRef, uint64_t); a fixed Seed there gives values
+/// that don't depend on set_fixed_execution_hash_seed.
+inline hash_code hash_bulk(cStringRef Data) {
+  return hash_bulk(Data, ::akj::hashing::detail::get_execution_seed());
+}
+
+/// \brief Compute hash_value(Keys[i]) into Out[i] for every key.
+///
+/// Out must have room for Keys.size() values. Several keys are hashed per
+/// loop iteration and the bytes of later keys are prefetched, so when the
+/// key data isn't in cache the loads for one key overlap the arithmetic of
+/// the others. Use this when hashing many keys at once, e.g. to fill or probe
+/// a hash table in batches.
+void hash_values(cArrayRef<cStringRef> Keys, cMutableArrayRef<hash_code> Out);
+
+
 /// \brief Compute a hash_code for a sequence of values.
 ///
 /// This hashes a sequence of values. It produces the same hash_code as
@@ -486,6 +679,22 @@ hash_code hash_combine_range(InputIteratorT first, InputIteratorT last) {
   return ::akj::hashing::detail::hash_combine_range_impl(first, last);
 }
 
+/// \brief Compute a 128-bit hash_code128 for a sequence of values.
+///
+/// This is hash_combine_range with a wider result, and it produces the same
+/// value as 'hash_combine128(a, b, c, ...)'. The low half equals what
+/// hash_combine_range returns for the same sequence.
+template <typename InputIteratorT>
+hash_code128 hash_combine_range128(InputIteratorT first, InputIteratorT last) {
+  return ::akj::hashing::detail::hash_combine_range128_impl(first, last);
+}
+
+/// \brief Compute a 128-bit hash_code128 for a string's bytes, whose low half
+/// is hash_value(S).
+inline hash_code128 hash_value128(cStringRef S) {
+  return hash_combine_range128(S.begin(), S.end());
+}
+
 
 // Implementation details for hash_combine.
 namespace hashing {
@@ -498,6 +707,7 @@ namespace detail {
 /// recursive combining of arguments used in hash_combine. It is particularly
 /// useful at minimizing the code in the recursive calls to ease the pain
 /// caused by a lack of variadic functions.
+template <typename ResultT = hash_code>
 struct hash_combine_recursive_helper {
   char buffer[64];
   hash_state state;
@@ -559,7 +769,7 @@ public:
   /// This function recurses through each argument, combining that argument
   /// into a single hash.
   template <typename T, typename ...Ts>
-  hash_code combine(size_t length, char *buffer_ptr, char *buffer_end,
+  ResultT combine(size_t length, char *buffer_ptr, char *buffer_end,
                     const T &arg, const Ts &...args) {
     buffer_ptr = combine_data(length, buffer_ptr, buffer_end, get_hashable_data(arg));
 
@@ -573,40 +783,40 @@ public:
 
   template <typename T1, typename T2, typename T3, typename T4, typename T5,
             typename T6>
-  hash_code combine(size_t length, char *buffer_ptr, char *buffer_end,
+  ResultT combine(size_t length, char *buffer_ptr, char *buffer_end,
                     const T1 &arg1, const T2 &arg2, const T3 &arg3,
                     const T4 &arg4, const T5 &arg5, const T6 &arg6) {
     buffer_ptr = combine_data(length, buffer_ptr, buffer_end, get_hashable_data(arg1));
     return combine(length, buffer_ptr, buffer_end, arg2, arg3, arg4, arg5, arg6);
   }
   template <typename T1, typename T2, typename T3, typename T4, typename T5>
-  hash_code combine(size_t length, char *buffer_ptr, char *buffer_end,
+  ResultT combine(size_t length, char *buffer_ptr, char *buffer_end,
                     const T1 &arg1, const T2 &arg2, const T3 &arg3,
                     const T4 &arg4, const T5 &arg5) {
     buffer_ptr = combine_data(length, buffer_ptr, buffer_end, get_hashable_data(arg1));
     return combine(length, buffer_ptr, buffer_end, arg2, arg3, arg4, arg5);
   }
   template <typename T1, typename T2, typename T3, typename T4>
-  hash_code combine(size_t length, char *buffer_ptr, char *buffer_end,
+  ResultT combine(size_t length, char *buffer_ptr, char *buffer_end,
                     const T1 &arg1, const T2 &arg2, const T3 &arg3,
                     const T4 &arg4) {
     buffer_ptr = combine_data(length, buffer_ptr, buffer_end, get_hashable_data(arg1));
     return combine(length, buffer_ptr, buffer_end, arg2, arg3, arg4);
   }
   template <typename T1, typename T2, typename T3>
-  hash_code combine(size_t length, char *buffer_ptr, char *buffer_end,
+  ResultT combine(size_t length, char *buffer_ptr, char *buffer_end,
                     const T1 &arg1, const T2 &arg2, const T3 &arg3) {
     buffer_ptr = combine_data(length, buffer_ptr, buffer_end, get_hashable_data(arg1));
     return combine(length, buffer_ptr, buffer_end, arg2, arg3);
   }
   template <typename T1, typename T2>
-  hash_code combine(size_t length, char *buffer_ptr, char *buffer_end,
+  ResultT combine(size_t length, char *buffer_ptr, char *buffer_end,
                     const T1 &arg1, const T2 &arg2) {
     buffer_ptr = combine_data(length, buffer_ptr, buffer_end, get_hashable_data(arg1));
     return combine(length, buffer_ptr, buffer_end, arg2);
   }
   template <typename T1>
-  hash_code combine(size_t length, char *buffer_ptr, char *buffer_end,
+  ResultT combine(size_t length, char *buffer_ptr, char *buffer_end,
                     const T1 &arg1) {
     buffer_ptr = combine_data(length, buffer_ptr, buffer_end, get_hashable_data(arg1));
     return combine(length, buffer_ptr, buffer_end);
@@ -619,11 +829,11 @@ public:
   /// The base case when combining arguments recursively is reached when all
   /// arguments have been handled. It flushes the remaining buffer and
   /// constructs a hash_code.
-  hash_code combine(size_t length, char *buffer_ptr, char *buffer_end) {
+  ResultT combine(size_t length, char *buffer_ptr, char *buffer_end) {
     // Check whether the entire set of values fit in the buffer. If so, we'll
     // use the optimized short hashing routine and skip state entirely.
     if (length == 0)
-      return hash_short(buffer, buffer_ptr - buffer, seed);
+      return finish_short(buffer, buffer_ptr - buffer, seed, (ResultT *)0);
 
     // Mix the final buffer, rotating it if we did a partial fill in order to
     // simulate doing a mix of the last 64-bytes. That is how the algorithm
@@ -635,7 +845,7 @@ public:
     state.mix(buffer);
     length += buffer_ptr - buffer;
 
-    return state.finalize(length);
+    return finish_state(state, length, (ResultT *)0);
   }
 };
 
@@ -658,7 +868,7 @@ public:
 /// *not* call this routine, they should instead call 'hash_value'.
 template <typename ...Ts> hash_code hash_combine(const Ts &...args) {
   // Recursively hash each argument using a helper class.
-  ::akj::hashing::detail::hash_combine_recursive_helper helper;
+  ::akj::hashing::detail::hash_combine_recursive_helper<> helper;
   return helper.combine(0, helper.buffer, helper.buffer + 64, args...);
 }
 
@@ -671,43 +881,185 @@ template <typename T1, typename T2, typename T3, typename T4, typename T5,
           typename T6>
 hash_code hash_combine(const T1 &arg1, const T2 &arg2, const T3 &arg3,
                        const T4 &arg4, const T5 &arg5, const T6 &arg6) {
-  ::akj::hashing::detail::hash_combine_recursive_helper helper;
+  ::akj::hashing::detail::hash_combine_recursive_helper<> helper;
   return helper.combine(0, helper.buffer, helper.buffer + 64,
                         arg1, arg2, arg3, arg4, arg5, arg6);
 }
 template <typename T1, typename T2, typename T3, typename T4, typename T5>
 hash_code hash_combine(const T1 &arg1, const T2 &arg2, const T3 &arg3,
                        const T4 &arg4, const T5 &arg5) {
-  ::akj::hashing::detail::hash_combine_recursive_helper helper;
+  ::akj::hashing::detail::hash_combine_recursive_helper<> helper;
   return helper.combine(0, helper.buffer, helper.buffer + 64,
                         arg1, arg2, arg3, arg4, arg5);
 }
 template <typename T1, typename T2, typename T3, typename T4>
 hash_code hash_combine(const T1 &arg1, const T2 &arg2, const T3 &arg3,
                        const T4 &arg4) {
-  ::akj::hashing::detail::hash_combine_recursive_helper helper;
+  ::akj::hashing::detail::hash_combine_recursive_helper<> helper;
   return helper.combine(0, helper.buffer, helper.buffer + 64,
                         arg1, arg2, arg3, arg4);
 }
 template <typename T1, typename T2, typename T3>
 hash_code hash_combine(const T1 &arg1, const T2 &arg2, const T3 &arg3) {
-  ::akj::hashing::detail::hash_combine_recursive_helper helper;
+  ::akj::hashing::detail::hash_combine_recursive_helper<> helper;
   return helper.combine(0, helper.buffer, helper.buffer + 64, arg1, arg2, arg3);
 }
 template <typename T1, typename T2>
 hash_code hash_combine(const T1 &arg1, const T2 &arg2) {
-  ::akj::hashing::detail::hash_combine_recursive_helper helper;
+  ::akj::hashing::detail::hash_combine_recursive_helper<> helper;
   return helper.combine(0, helper.buffer, helper.buffer + 64, arg1, arg2);
 }
 template <typename T1>
 hash_code hash_combine(const T1 &arg1) {
-  ::akj::hashing::detail::hash_combine_recursive_helper helper;
+  ::akj::hashing::detail::hash_combine_recursive_helper<> helper;
+  return helper.combine(0, helper.buffer, helper.buffer + 64, arg1);
+}
+
+#endif
+
+
+#if __has_feature(__cxx_variadic_templates__)
+
+/// \brief Combine values into a single 128-bit hash_code128.
+///
+/// This is hash_combine with a wider result. The low half equals what
+/// hash_combine returns for the same arguments.
+template <typename ...Ts> hash_code128 hash_combine128(const Ts &...args) {
+  ::akj::hashing::detail::hash_combine_recursive_helper<hash_code128> helper;
+  return helper.combine(0, helper.buffer, helper.buffer + 64, args...);
+}
+
+#else
+
+template <typename T1, typename T2, typename T3, typename T4, typename T5,
+          typename T6>
+hash_code128 hash_combine128(const T1 &arg1, const T2 &arg2, const T3 &arg3,
+                             const T4 &arg4, const T5 &arg5, const T6 &arg6) {
+  ::akj::hashing::detail::hash_combine_recursive_helper<hash_code128> helper;
+  return helper.combine(0, helper.buffer, helper.buffer + 64,
+                        arg1, arg2, arg3, arg4, arg5, arg6);
+}
+template <typename T1, typename T2, typename T3, typename T4, typename T5>
+hash_code128 hash_combine128(const T1 &arg1, const T2 &arg2, const T3 &arg3,
+                             const T4 &arg4, const T5 &arg5) {
+  ::akj::hashing::detail::hash_combine_recursive_helper<hash_code128> helper;
+  return helper.combine(0, helper.buffer, helper.buffer + 64,
+                        arg1, arg2, arg3, arg4, arg5);
+}
+template <typename T1, typename T2, typename T3, typename T4>
+hash_code128 hash_combine128(const T1 &arg1, const T2 &arg2, const T3 &arg3,
+                             const T4 &arg4) {
+  ::akj::hashing::detail::hash_combine_recursive_helper<hash_code128> helper;
+  return helper.combine(0, helper.buffer, helper.buffer + 64,
+                        arg1, arg2, arg3, arg4);
+}
+template <typename T1, typename T2, typename T3>
+hash_code128 hash_combine128(const T1 &arg1, const T2 &arg2, const T3 &arg3) {
+  ::akj::hashing::detail::hash_combine_recursive_helper<hash_code128> helper;
+  return helper.combine(0, helper.buffer, helper.buffer + 64, arg1, arg2, arg3);
+}
+template <typename T1, typename T2>
+hash_code128 hash_combine128(const T1 &arg1, const T2 &arg2) {
+  ::akj::hashing::detail::hash_combine_recursive_helper<hash_code128> helper;
+  return helper.combine(0, helper.buffer, helper.buffer + 64, arg1, arg2);
+}
+template <typename T1>
+hash_code128 hash_combine128(const T1 &arg1) {
+  ::akj::hashing::detail::hash_combine_recursive_helper<hash_code128> helper;
   return helper.combine(0, helper.buffer, helper.buffer + 64, arg1);
 }
 
 #endif
 
 
+/// \brief Incrementally compute the hash_code of a byte sequence.
+///
+/// Feeding the bytes of a sequence to update() in any number of pieces and
+/// then calling final() produces the same hash_code as hashing the whole
+/// sequence at once with hash_value(cStringRef) or hash_combine_range over
+/// its chars. This allows hashing data that arrives in chunks, such as from a
+/// DataStreamer or a list of MemoryBuffers, without concatenating it first.
+///
+/// Whole 64-byte chunks are mixed straight from the caller's memory; only the
+/// last chunk of each update() is copied, because the final mix may need to
+/// look back at it.
+class incremental_hash {
+  /// The bytes of the chunk being filled, at the front, followed by the rest
+  /// of the last chunk that was mixed. Rotated, this is the last 64 bytes.
+  char buffer[64];
+  ::akj::hashing::detail::hash_state state;
+  uint64_t seed;
+  uint64_t length;
+
+  void mix_chunk(const char *s, uint64_t offset) {
+    // The first chunk initializes the state. It is mixed before we know
+    // whether more input follows, but final() only uses the state if so.
+    if (offset == 0)
+      state = state.create(s, seed);
+    else
+      state.mix(s);
+  }
+
+public:
+  incremental_hash()
+    : seed(::akj::hashing::detail::get_execution_seed()), length(0) {}
+
+  /// \brief Append Data to the sequence being hashed.
+  void update(cStringRef Data) {
+    const char *s = Data.data();
+    size_t n = Data.size();
+    if (n == 0)
+      return;
+    size_t fill = size_t(length & 63);
+    uint64_t offset = length - fill;
+    length += n;
+
+    // Top up the chunk left over from the last call.
+    if (fill != 0) {
+      size_t take = std::min<size_t>(64 - fill, n);
+      memcpy(buffer + fill, s, take);
+      s += take;
+      n -= take;
+      if (fill + take != 64)
+        return;
+      mix_chunk(buffer, offset);
+      offset += 64;
+    }
+
+    const char *last = 0;
+    while (n >= 64) {
+      mix_chunk(s, offset);
+      last = s;
+      s += 64;
+      n -= 64;
+      offset += 64;
+    }
+    if (last)
+      memcpy(buffer, last, 64);
+    memcpy(buffer, s, n);
+  }
+
+  /// \brief Return the hash_code of everything passed to update() so far.
+  /// More data may still be appended afterwards.
+  hash_code final() const {
+    using namespace ::akj::hashing::detail;
+    if (length <= 64)
+      return hash_short(buffer, size_t(length), seed);
+
+    hash_state result = state;
+    size_t fill = size_t(length & 63);
+    if (fill != 0) {
+      // Mix the last 64 bytes of the input, like hash_combine_range does.
+      char tail[64];
+      memcpy(tail, buffer + fill, 64 - fill);
+      memcpy(tail + 64 - fill, buffer, fill);
+      result.mix(tail);
+    }
+    return result.finalize(size_t(length));
+  }
+};
+
+
 // Implementation details for implementations of hash_value overloads provided
 // here.
 namespace hashing {
@@ -758,4 +1110,231 @@ hash_code hash_value(const std::basic_string<T> &arg) {
   return hash_combine_range(arg.begin(), arg.end());
 }
 
+// Compile-time versions of the byte sequence hash. Each function restates one
+// of the routines above as a single return statement, as C++11 constexpr
+// requires, with the sequential updates of the originals threaded through
+// nested calls.
+namespace hashing {
+namespace detail {
+
+AKJ_CONSTEXPR inline uint64_t ct_byte(const char *p, size_t i) {
+  return static_cast<uint8_t>(p[i]);
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_fetch32(const char *p) {
+  return ct_byte(p, 0) | ct_byte(p, 1) << 8 | ct_byte(p, 2) << 16 |
+         ct_byte(p, 3) << 24;
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_fetch64(const char *p) {
+  return ct_fetch32(p) | ct_fetch32(p + 4) << 32;
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_rotate(uint64_t val, size_t shift) {
+  return shift == 0 ? val : ((val >> shift) | (val << (64 - shift)));
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_shift_mix(uint64_t val) {
+  return val ^ (val >> 47);
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_16_bytes(uint64_t low, uint64_t high) {
+  return ct_shift_mix((high ^ ct_shift_mix((low ^ high) *
+                                           0x9ddfea08eb382d69ULL)) *
+                      0x9ddfea08eb382d69ULL) * 0x9ddfea08eb382d69ULL;
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_1to3_bytes(const char *s, size_t len,
+                                                 uint64_t seed) {
+  return ct_shift_mix(
+             uint64_t(uint32_t(ct_byte(s, 0) + (ct_byte(s, len >> 1) << 8))) *
+                 k2 ^
+             uint64_t(uint32_t(len + (ct_byte(s, len - 1) << 2))) * k3 ^
+             seed) * k2;
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_4to8_bytes(const char *s, size_t len,
+                                                 uint64_t seed) {
+  return ct_hash_16_bytes(len + (ct_fetch32(s) << 3),
+                          seed ^ ct_fetch32(s + len - 4));
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_9to16_bytes(const char *s, size_t len,
+                                                  uint64_t seed) {
+  return ct_hash_16_bytes(seed ^ ct_fetch64(s),
+                          ct_rotate(ct_fetch64(s + len - 8) + len, len)) ^
+         ct_fetch64(s + len - 8);
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_17to32_mix(uint64_t a, uint64_t b,
+                                                 uint64_t c, uint64_t d,
+                                                 size_t len, uint64_t seed) {
+  return ct_hash_16_bytes(ct_rotate(a - b, 43) + ct_rotate(c ^ seed, 30) + d,
+                          a + ct_rotate(b ^ k3, 20) - c + len + seed);
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_17to32_bytes(const char *s, size_t len,
+                                                   uint64_t seed) {
+  return ct_hash_17to32_mix(ct_fetch64(s) * k1, ct_fetch64(s + 8),
+                            ct_fetch64(s + len - 8) * k2,
+                            ct_fetch64(s + len - 16) * k0, len, seed);
+}
+
+/// \brief A pair of 64-bit values, for returning two results at once.
+struct ct_pair {
+  uint64_t first, second;
+  AKJ_CONSTEXPR ct_pair(uint64_t first, uint64_t second)
+    : first(first), second(second) {}
+};
+
+AKJ_CONSTEXPR inline ct_pair ct_hash_33to64_half_mix(uint64_t a0, uint64_t z,
+                                                     uint64_t a1,
+                                                     uint64_t a2) {
+  return ct_pair(a2 + z, ct_rotate(a0 + z, 52) + ct_rotate(a2, 31) +
+                             ct_rotate(a0, 37) + ct_rotate(a1, 7));
+}
+
+// One half of hash_33to64_bytes: a0 is the first value of 'a', and x and y
+// are the words added to it in turn. Returns the (vf, vs) or (wf, ws) pair.
+AKJ_CONSTEXPR inline ct_pair ct_hash_33to64_half(uint64_t a0, uint64_t z,
+                                                 uint64_t x, uint64_t y) {
+  return ct_hash_33to64_half_mix(a0, z, a0 + x, a0 + x + y);
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_33to64_final(ct_pair v, ct_pair w,
+                                                   uint64_t seed) {
+  return ct_shift_mix((seed ^ (ct_shift_mix((v.first + w.second) * k2 +
+                                            (w.first + v.second) * k0) *
+                               k0)) + v.second) * k2;
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_33to64_bytes(const char *s, size_t len,
+                                                   uint64_t seed) {
+  return ct_hash_33to64_final(
+      ct_hash_33to64_half(ct_fetch64(s) +
+                              (len + ct_fetch64(s + len - 16)) * k0,
+                          ct_fetch64(s + 24), ct_fetch64(s + 8),
+                          ct_fetch64(s + 16)),
+      ct_hash_33to64_half(ct_fetch64(s + 16) + ct_fetch64(s + len - 32),
+                          ct_fetch64(s + len - 8), ct_fetch64(s + len - 24),
+                          ct_fetch64(s + len - 16)),
+      seed);
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_short(const char *s, size_t length,
+                                            uint64_t seed) {
+  return length >= 4 && length <= 8 ? ct_hash_4to8_bytes(s, length, seed)
+       : length > 8 && length <= 16 ? ct_hash_9to16_bytes(s, length, seed)
+       : length > 16 && length <= 32 ? ct_hash_17to32_bytes(s, length, seed)
+       : length > 32 ? ct_hash_33to64_bytes(s, length, seed)
+       : length != 0 ? ct_hash_1to3_bytes(s, length, seed)
+       : k2 ^ seed;
+}
+
+/// \brief The compile-time counterpart of hash_state.
+struct ct_state {
+  uint64_t h0, h1, h2, h3, h4, h5, h6;
+  AKJ_CONSTEXPR ct_state(uint64_t h0, uint64_t h1, uint64_t h2, uint64_t h3,
+                         uint64_t h4, uint64_t h5, uint64_t h6)
+    : h0(h0), h1(h1), h2(h2), h3(h3), h4(h4), h5(h5), h6(h6) {}
+};
+
+// hash_state::mix_32_bytes, with 'a' already advanced by the first word.
+AKJ_CONSTEXPR inline ct_pair ct_mix_32_bytes(const char *s, uint64_t a,
+                                             uint64_t b) {
+  return ct_pair(a + ct_fetch64(s + 8) + ct_fetch64(s + 16) +
+                     ct_fetch64(s + 24),
+                 ct_rotate(b + a + ct_fetch64(s + 24), 21) +
+                     ct_rotate(a + ct_fetch64(s + 8) + ct_fetch64(s + 16),
+                               44) + a);
+}
+
+AKJ_CONSTEXPR inline ct_state ct_mix_finish(uint64_t n0, uint64_t n1,
+                                            uint64_t n2, ct_pair m34,
+                                            ct_pair m56) {
+  // The final swap of h0 and h2 is folded in here.
+  return ct_state(n2, n1, n0, m34.first, m34.second, m56.first, m56.second);
+}
+
+/// \brief The second half of hash_state::mix, where n0, n1 and n2 are the
+/// new h0, h1 and h2 and the rest are the old values.
+AKJ_CONSTEXPR inline ct_state ct_mix_with(const char *s, uint64_t n0,
+                                          uint64_t n1, uint64_t n2,
+                                          uint64_t h4, uint64_t h5,
+                                          uint64_t h6) {
+  return ct_mix_finish(n0, n1, n2,
+                       ct_mix_32_bytes(s, h4 * k1 + ct_fetch64(s), n0 + h5),
+                       ct_mix_32_bytes(s + 32, n2 + h6 + ct_fetch64(s + 32),
+                                       n1 + ct_fetch64(s + 16)));
+}
+
+/// \brief hash_state::mix.
+AKJ_CONSTEXPR inline ct_state ct_mix(const char *s, const ct_state &h) {
+  return ct_mix_with(s,
+                     ct_rotate(h.h0 + h.h1 + h.h3 + ct_fetch64(s + 8), 37) *
+                         k1 ^ h.h6,
+                     ct_rotate(h.h1 + h.h4 + ct_fetch64(s + 48), 42) * k1 +
+                         h.h3 + ct_fetch64(s + 40),
+                     ct_rotate(h.h2 + h.h5, 33) * k1, h.h4, h.h5, h.h6);
+}
+
+AKJ_CONSTEXPR inline ct_state ct_create(const char *s, uint64_t seed) {
+  return ct_mix(s, ct_state(0, seed, ct_hash_16_bytes(seed, k1),
+                            ct_rotate(seed ^ k1, 49), seed * k1,
+                            ct_shift_mix(seed),
+                            ct_hash_16_bytes(seed * k1, ct_shift_mix(seed))));
+}
+
+AKJ_CONSTEXPR inline ct_state ct_mix_chunks(const char *s, size_t count,
+                                            const ct_state &h) {
+  return count == 0 ? h : ct_mix_chunks(s + 64, count - 1, ct_mix(s, h));
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_finalize(const ct_state &h, size_t length) {
+  return ct_hash_16_bytes(ct_hash_16_bytes(h.h3, h.h5) +
+                              ct_shift_mix(h.h1) * k1 + h.h2,
+                          ct_hash_16_bytes(h.h4, h.h6) +
+                              ct_shift_mix(length) * k1 + h.h0);
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_long(const char *s, size_t length,
+                                           const ct_state &h) {
+  return ct_finalize((length & 63) ? ct_mix(s + length - 64, h) : h, length);
+}
+
+AKJ_CONSTEXPR inline uint64_t ct_hash_contiguous(const char *s, size_t length,
+                                                 uint64_t seed) {
+  return length <= 64
+             ? ct_hash_short(s, length, seed)
+             : ct_hash_long(s, length,
+                            ct_mix_chunks(s + 64, (length >> 6) - 1,
+                                          ct_create(s, seed)));
+}
+
+} // namespace detail
+} // namespace hashing
+
+/// \brief Compute hash_value(cStringRef(S, Length)) at compile time.
+///
+/// The result is the same value hash_value returns at run time, so it can be
+/// used for case labels and static tables keyed on string hashes. This holds
+/// as long as set_fixed_execution_hash_seed is never called. Every 64 bytes
+/// of input is one level of constexpr recursion, so keep constant keys well
+/// under the compiler's recursion limit (usually 512 levels, 32 KB).
+AKJ_CONSTEXPR inline hash_code hash_string_constexpr(const char *S,
+                                                     size_t Length) {
+  return hash_code(size_t(::akj::hashing::detail::ct_hash_contiguous(
+      S, Length, uint64_t(size_t(::akj::hashing::detail::seed_prime)))));
+}
+
+/// \brief Compute the hash_value of a string literal at compile time.
+/// \code
+///   switch (hash_value(Key)) {
+///   case hash_literal("begin"): ...
+/// \endcode
+template <size_t N>
+AKJ_CONSTEXPR inline hash_code hash_literal(const char (&S)[N]) {
+  return hash_string_constexpr(S, N - 1);
+}
+
 } // namespace akj
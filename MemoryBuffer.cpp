@@ -12,6 +12,7 @@
 
 #include "MemoryBuffer.hpp"
 
+#include "CompressedStream.hpp"
 #include "OwningPtr.hpp"
 #include "SmallString.hpp"
 #include "ErrnoToString.hpp"
@@ -100,6 +101,12 @@ public:
   virtual BufferKind getBufferKind() const AKJ_OVERRIDE {
     return MemoryBuffer_Malloc;
   }
+
+  void truncate(size_t NewSize) {
+    char *Start = const_cast<char *>(getBufferStart());
+    Start[NewSize] = 0;
+    init(Start, Start + NewSize, true);
+  }
 };
 }
 
@@ -135,6 +142,10 @@ MemoryBuffer *MemoryBuffer::getNewUninitMemBuffer(size_t Size,
   size_t AlignedStringLen =
     RoundUpToAlignment(sizeof(MemoryBufferMem) + BufferName.size() + 1,
                        sizeof(void*)); // TODO: Is sizeof(void*) enough?
+  // A size this close to the top of the address space can't be allocated,
+  // and would wrap around below.
+  if (Size >= ~size_t(0) - AlignedStringLen)
+    return 0;
   size_t RealLen = AlignedStringLen + Size + 1;
   char *Mem = static_cast<char*>(operator new(RealLen, std::nothrow));
   if (!Mem) return 0;
@@ -149,6 +160,13 @@ MemoryBuffer *MemoryBuffer::getNewUninitMemBuffer(size_t Size,
   return new (Mem) MemoryBufferMem(cStringRef(Buf, Size), true);
 }
 
+/// truncateNewMemBuffer - Shrink a buffer from getNewUninitMemBuffer in place.
+void MemoryBuffer::truncateNewMemBuffer(MemoryBuffer *Buffer, size_t NewSize) {
+  assert(Buffer->getBufferKind() == MemoryBuffer_Malloc &&
+         NewSize <= Buffer->getBufferSize() && "Invalid buffer truncation!");
+  static_cast<MemoryBufferMem *>(Buffer)->truncate(NewSize);
+}
+
 /// getNewMemBuffer - Allocate a new MemoryBuffer of the specified size that
 /// is completely initialized to zeros.  Note that the caller should
 /// initialize the memory allocated by this method.  The memory is owned by
@@ -251,6 +269,52 @@ error_code MemoryBuffer::getFile(const Twine& Filename,
 }
 
 
+/// looksLikeZlib - Whether Data starts with a zlib header: a deflate method
+/// byte with a window of at most 32 KB, and a flag byte without a preset
+/// dictionary that makes the pair a multiple of 31. Plain text matches now
+/// and then ("x^", "80" and "HK" all do), so this is no reason to reject a
+/// file that doesn't inflate.
+static bool looksLikeZlib(cStringRef Data) {
+  if (Data.size() < 2)
+    return false;
+  unsigned char CMF = Data[0], FLG = Data[1];
+  return (CMF & 0x0F) == 8 && (CMF >> 4) <= 7 && !(FLG & 0x20) &&
+         ((CMF << 8) | FLG) % 31 == 0;
+}
+
+error_code MemoryBuffer::getUncompressedFile(const Twine &Filename,
+                                             OwningPtr<MemoryBuffer> &result,
+                                             bool RequiresNullTerminator) {
+  cSmallVector<char, 256> PathBuf;
+  cStringRef NTFilename = Filename.toNullTerminatedStringRef(PathBuf);
+  OwningPtr<MemoryBuffer> File;
+  if (error_code ec = getFile(NTFilename.data(), File, -1,
+                              RequiresNullTerminator))
+    return ec;
+
+  sys::fs::file_magic Magic = sys::fs::identify_magic(File->getBuffer());
+  if (Magic == sys::fs::file_magic::unknown && looksLikeZlib(File->getBuffer()))
+    Magic = sys::fs::file_magic::zlib_compressed;
+  if (!Magic.is_compressed()) {
+    result.swap(File);
+    return error_code::success();
+  }
+
+  switch (uncompressBuffer(File->getBuffer(), Magic, result, NTFilename)) {
+    case zlib::StatusOK:
+      return error_code::success();
+    case zlib::StatusOutOfMemory:
+      return make_error_code(errc::not_enough_memory);
+    default:
+      // The zlib magic number is weak enough to show up in plain files.
+      if (Magic == sys::fs::file_magic::zlib_compressed) {
+        result.swap(File);
+        return error_code::success();
+      }
+      return make_error_code(errc::illegal_byte_sequence);
+  }
+}
+
 error_code MemoryBuffer::getFile(cStringRef Filename,
                                  OwningPtr<MemoryBuffer> &result,
                                  int64_t FileSize,
@@ -73,6 +73,17 @@ public:
 	static error_code getFile(const Twine& Filename, OwningPtr<MemoryBuffer> &result,
 														int64_t FileSize = -1,
 														bool RequiresNullTerminator = true);
+  /// getUncompressedFile - Like getFile, but if the file holds gzip, zlib,
+  /// LZ4 frame or block container compressed data (as told by
+  /// sys::fs::identify_magic, or for zlib, which identify_magic leaves alone,
+  /// by its two byte header), return the uncompressed contents instead,
+  /// decoded straight into a buffer from getNewUninitMemBuffer whenever the
+  /// format records its uncompressed size. A file that merely looks like a
+  /// zlib stream but doesn't decode as one is returned as it is.
+  static error_code getUncompressedFile(const Twine &Filename,
+                                        OwningPtr<MemoryBuffer> &result,
+                                        bool RequiresNullTerminator = true);
+
   /// Given an already-open file descriptor, map some slice of it into a
   /// MemoryBuffer. The slice is specified by an \p Offset and \p MapSize.
   /// Since this is in the middle of a file, the buffer is not null terminated.
@@ -112,6 +123,13 @@ public:
   static MemoryBuffer *getNewUninitMemBuffer(size_t Size,
                                              cStringRef BufferName = "");
 
+  /// truncateNewMemBuffer - Shrink a buffer that was returned by
+  /// getNewUninitMemBuffer or getNewMemBuffer to its first NewSize bytes and
+  /// null terminate it again. The memory is not reallocated, so this lets a
+  /// producer that only knows an upper bound of its output size write into
+  /// the final buffer directly.
+  static void truncateNewMemBuffer(MemoryBuffer *Buffer, size_t NewSize);
+
   /// getSTDIN - Read all of stdin into a file buffer, and return it.
   /// If an error occurs, this returns null and sets ec.
   static error_code getSTDIN(OwningPtr<MemoryBuffer> &result);
@@ -0,0 +1,63 @@
+//===-- akjParallel.hpp - Simple data parallel helpers -----------*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines parallel_for, a minimal fork/join helper for running
+// independent pieces of work (compressing blocks, hashing chunks, ...) on all
+// available cores.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+namespace akj {
+
+/// hardware_threads - Return the number of threads that can run concurrently,
+/// or 1 if that can't be determined.
+inline unsigned hardware_threads() {
+  unsigned Count = std::thread::hardware_concurrency();
+  return Count ? Count : 1;
+}
+
+/// parallel_for - Call Fn(I) for every I in [0, Count), spread over up to
+/// NumThreads threads (all hardware threads if NumThreads is 0), and return
+/// once every call has finished. Indices are handed out in increasing order
+/// as threads become free, so uneven work balances itself. The calling thread
+/// does its share of the work, and nothing is spawned when there is only one
+/// index or one thread.
+template<typename FnT>
+void parallel_for(size_t Count, FnT Fn, unsigned NumThreads = 0) {
+  if (NumThreads == 0)
+    NumThreads = hardware_threads();
+  if (NumThreads > Count)
+    NumThreads = unsigned(Count);
+  if (NumThreads <= 1) {
+    for (size_t I = 0; I != Count; ++I)
+      Fn(I);
+    return;
+  }
+
+  std::atomic<size_t> Next(0);
+  auto Worker = [&]() {
+    for (size_t I = Next++; I < Count; I = Next++)
+      Fn(I);
+  };
+  std::vector<std::thread> Threads;
+  Threads.reserve(NumThreads - 1);
+  for (unsigned T = 1; T != NumThreads; ++T)
+    Threads.push_back(std::thread(Worker));
+  Worker();
+  for (size_t T = 0, E = Threads.size(); T != E; ++T)
+    Threads[T].join();
+}
+
+} // End of namespace akj
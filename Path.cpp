@@ -14,6 +14,8 @@
 #include "Endian.hpp"
 #include "FileSystem.hpp"
 #include "FatalError.hpp"
+#include "Hashing.hpp"
+#include "Parallel.hpp"
 #include <cctype>
 #include <cstdio>
 #include <cstring>
@@ -951,9 +953,30 @@ error_code has_magic(const Twine &path, const Twine &magic, bool &result) {
         return file_magic::coff_object;
       break;
 
+    case 0x1F:
+      if (Magic[1] == char(0x8B) && Magic[2] == 0x08) // gzip, deflate method
+        return file_magic::gzip_compressed;
+      break;
+
+    case 0x04: // 0x184D2204 little endian
+      if (Magic[1] == 0x22 && Magic[2] == 0x4D && Magic[3] == 0x18)
+        return file_magic::lz4_frame;
+      break;
+
+    case 'A':
+      if (Magic[1] == 'K' && Magic[2] == 'J' && Magic[3] == 'Z')
+        return file_magic::block_compressed;
+      break;
+
     default:
       break;
   }
+
+  // LZ4 skippable frames (0x184D2A50 to 0x184D2A5F) may precede the data.
+  if (((unsigned char)Magic[0] & 0xF0) == 0x50 && Magic[1] == 0x2A &&
+      Magic[2] == 0x4D && Magic[3] == 0x18)
+    return file_magic::lz4_frame;
+
   return file_magic::unknown;
 }
 
@@ -1010,6 +1033,149 @@ error_code directory_entry::status(file_status &result) const {
   return fs::status(Path, result);
 }
 
+namespace {
+// Digests must not depend on the execution seed.
+const uint64_t DigestSeed = 0x6a09e667f3bcc908ULL;
+
+/// digestChunk - Return the hash of one chunk of a file_digest. This is
+/// hash_bulk, but keeps all 64 bits on hosts where size_t is smaller.
+uint64_t digestChunk(const char *Data, size_t Length) {
+  using namespace hashing::detail;
+  if (Length <= hash_bulk_threshold)
+    return hash_contiguous(Data, Length, DigestSeed);
+  return hash_bulk_long(Data, Length, DigestSeed);
+}
+
+/// digestTree - Combine chunk hashes pairwise, level by level, until one is
+/// left. The last hash of a level with an odd number of them moves up
+/// unchanged.
+uint64_t digestTree(std::vector<uint64_t> Level) {
+  if (Level.empty())
+    return DigestSeed;
+  while (Level.size() > 1) {
+    size_t Half = Level.size() / 2;
+    for (size_t I = 0; I != Half; ++I)
+      Level[I] = hashing::detail::hash_16_bytes(Level[2 * I],
+                                                Level[2 * I + 1]);
+    if (Level.size() & 1)
+      Level[Half++] = Level.back();
+    Level.resize(Half);
+  }
+  return Level[0];
+}
+} // end unnamed namespace
+
+file_digest::file_digest(uint64_t ChunkSize)
+  : ChunkSize(ChunkSize), Size(0), AnyStale(false), Valid(false), Digest(0),
+    Rehashed(0) {
+  assert(ChunkSize != 0 && "chunks can't be empty");
+  uint64_t Align = mapped_file_region::alignment();
+  this->ChunkSize = (ChunkSize + Align - 1) / Align * Align;
+}
+
+void file_digest::clear() {
+  Size = 0;
+  ModTime = TimeValue();
+  ChunkHashes.clear();
+  Stale.clear();
+  AnyStale = false;
+  Valid = false;
+  Digest = 0;
+}
+
+void file_digest::invalidate(uint64_t Offset, uint64_t Length) {
+  if (Length == 0)
+    return;
+  uint64_t First = Offset / ChunkSize;
+  uint64_t Last = (Offset + Length - 1) / ChunkSize;
+  // Chunks that don't exist yet are hashed anyway.
+  for (uint64_t I = First; I <= Last && I < Stale.size(); ++I) {
+    Stale[I] = true;
+    AnyStale = true;
+  }
+}
+
+error_code file_digest::update(const Twine &path, unsigned NumThreads) {
+  int FD;
+  if (error_code EC = openFileForRead(path, FD)) {
+    clear();
+    return EC;
+  }
+  error_code EC = update(FD, NumThreads);
+  ::close(FD);
+  return EC;
+}
+
+error_code file_digest::update(int FD, unsigned NumThreads) {
+  Rehashed = 0;
+  file_status Status;
+  if (error_code EC = status(FD, Status)) {
+    clear();
+    return EC;
+  }
+  uint64_t NewSize = Status.getSize();
+  TimeValue NewModTime = Status.getLastModificationTime();
+  bool Changed = NewSize != Size || NewModTime != ModTime;
+  if (Valid && !Changed && !AnyStale)
+    return error_code::success();
+
+  // Without a hint of what changed, everything has to be hashed again.
+  size_t OldChunks = ChunkHashes.size();
+  if (!Valid || (Changed && !AnyStale))
+    Stale.assign(OldChunks, true);
+
+  size_t NewChunks = size_t((NewSize + ChunkSize - 1) / ChunkSize);
+  // A chunk that grew or shrank has to be hashed again too. That can only be
+  // the old last chunk or the new one.
+  if (NewSize != Size) {
+    if (OldChunks && Size % ChunkSize)
+      Stale[OldChunks - 1] = true;
+    if (NewChunks && NewChunks <= OldChunks && NewSize % ChunkSize)
+      Stale[NewChunks - 1] = true;
+  }
+  ChunkHashes.resize(NewChunks);
+  Stale.resize(NewChunks, true);
+
+  std::vector<size_t> Work;
+  for (size_t I = 0; I != NewChunks; ++I)
+    if (Stale[I])
+      Work.push_back(I);
+
+  std::vector<error_code> Errors(Work.size());
+  parallel_for(Work.size(), [&](size_t W) {
+    uint64_t Offset = Work[W] * ChunkSize;
+    uint64_t Length = std::min(ChunkSize, NewSize - Offset);
+    mapped_file_region Region(FD, false, mapped_file_region::readonly,
+                              Length, Offset, Errors[W]);
+    if (!Errors[W])
+      ChunkHashes[Work[W]] = digestChunk(Region.const_data(), size_t(Length));
+  }, NumThreads);
+
+  for (size_t W = 0; W != Errors.size(); ++W)
+    if (Errors[W]) {
+      clear();
+      return Errors[W];
+    }
+
+  Size = NewSize;
+  ModTime = NewModTime;
+  Stale.assign(NewChunks, false);
+  AnyStale = false;
+  Valid = true;
+  Rehashed = Work.size();
+  Digest = hashing::detail::hash_16_bytes(digestTree(ChunkHashes), Size);
+  return error_code::success();
+}
+
+error_code digest_file(const Twine &path, uint64_t &result,
+                       unsigned NumThreads) {
+  file_digest D;
+  if (error_code EC = D.update(path, NumThreads))
+    return EC;
+  result = D.digest();
+  return error_code::success();
+}
+
 } // end namespace fs
 } // end namespace sys
 } // end namespace akj
@@ -0,0 +1,73 @@
+//===-- StringPool.cpp - Interned string pool -------------------------------===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the StringPool class.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StringPool.hpp"
+#include "RawOstream.hpp"
+
+namespace akj {
+
+StringPool::StringPool()
+  : NumRequests(0), BytesRequested(0), BytesInterned(0) {}
+
+StringPool::~StringPool() {}
+
+PooledStringRef StringPool::intern(cStringRef Str) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  ++NumRequests;
+  BytesRequested += Str.size();
+
+  unsigned OldSize = Strings.size();
+  StringMapEntry<char> &Entry = Strings.GetOrCreateValue(Str);
+  if (Strings.size() != OldSize)
+    BytesInterned += Str.size();
+  return PooledStringRef(&Entry);
+}
+
+PooledStringRef StringPool::lookup(cStringRef Str) const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  StringMap<char>::const_iterator I = Strings.find(Str);
+  if (I == Strings.end())
+    return PooledStringRef();
+  return PooledStringRef(&*I);
+}
+
+size_t StringPool::size() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Strings.size();
+}
+
+size_t StringPool::getNumRequests() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return NumRequests;
+}
+
+size_t StringPool::getBytesSaved() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return BytesRequested - BytesInterned;
+}
+
+size_t StringPool::getTotalMemory() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Strings.getAllocator().getTotalMemory();
+}
+
+void StringPool::PrintStats() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  errs() << "\nNumber of interned strings: " << Strings.size() << '\n'
+         << "Number of intern requests: " << NumRequests << '\n'
+         << "Bytes interned: " << BytesInterned << '\n'
+         << "Bytes saved: " << (BytesRequested - BytesInterned)
+         << " (duplicate strings not copied)\n";
+  Strings.getAllocator().PrintStats();
+}
+
+} // end namespace akj
@@ -0,0 +1,115 @@
+//===-- akjStringPool.hpp - Interned string pool -----------------*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares StringPool, a thread-safe interning table. Each distinct
+// string is copied once into the pool's BumpPtrAllocator, and every request
+// for it returns the same PooledStringRef. Two handles from one pool are equal
+// exactly when their pointers are, so comparing interned strings never looks
+// at the characters. Handles stay valid until the pool is destroyed.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "Hashing.hpp"
+#include "StringMap.hpp"
+#include "StringRef.hpp"
+#include <mutex>
+#include <stddef.h>
+
+namespace akj {
+
+class StringPool;
+
+/// PooledStringRef - A handle to a string interned in a StringPool. It is the
+/// size of a pointer and compares, orders and hashes by that pointer. A
+/// default constructed handle is null and refers to no string.
+class PooledStringRef {
+  typedef StringMapEntry<char> EntryTy;
+  const EntryTy *Entry;
+
+  friend class StringPool;
+  explicit PooledStringRef(const EntryTy *E) : Entry(E) {}
+
+public:
+  PooledStringRef() : Entry(0) {}
+
+  bool isNull() const { return Entry == 0; }
+
+  /// str - The interned characters.
+  cStringRef str() const {
+    assert(Entry && "Can't get the string of a null handle!");
+    return Entry->getKey();
+  }
+
+  /// data - The interned characters, which are always null terminated.
+  const char *data() const { return str().data(); }
+
+  size_t size() const { return str().size(); }
+
+  /// getOpaqueValue - The pointer that identifies this string in its pool.
+  const void *getOpaqueValue() const { return Entry; }
+
+  bool operator==(PooledStringRef RHS) const { return Entry == RHS.Entry; }
+  bool operator!=(PooledStringRef RHS) const { return Entry != RHS.Entry; }
+
+  /// operator< - Order handles by address. This is stable for the life of
+  /// the pool but has nothing to do with the order of the characters.
+  bool operator<(PooledStringRef RHS) const { return Entry < RHS.Entry; }
+
+  friend hash_code hash_value(PooledStringRef S) {
+    return hash_value(S.Entry);
+  }
+};
+
+/// StringPool - Interns strings. All members may be called from several
+/// threads at once.
+class StringPool {
+  mutable std::mutex Lock;
+  StringMap<char> Strings;
+
+  // Statistics, guarded by Lock.
+  size_t NumRequests;
+  size_t BytesRequested;
+  size_t BytesInterned;
+
+  StringPool(const StringPool &) AKJ_DELETED_FUNCTION;
+  void operator=(const StringPool &) AKJ_DELETED_FUNCTION;
+
+public:
+  StringPool();
+  ~StringPool();
+
+  /// intern - Return the handle for Str, copying it into the pool if this is
+  /// the first time it has been seen.
+  PooledStringRef intern(cStringRef Str);
+
+  /// lookup - Return the handle for Str if it has been interned, or a null
+  /// handle if not. The pool is not changed.
+  PooledStringRef lookup(cStringRef Str) const;
+
+  /// size - The number of distinct strings in the pool.
+  size_t size() const;
+
+  bool empty() const { return size() == 0; }
+
+  /// getNumRequests - The number of calls to intern.
+  size_t getNumRequests() const;
+
+  /// getBytesSaved - The number of characters passed to intern that were not
+  /// copied because the string was already in the pool.
+  size_t getBytesSaved() const;
+
+  /// getTotalMemory - The number of bytes the pool has allocated for its
+  /// strings, not counting the hash table.
+  size_t getTotalMemory() const;
+
+  void PrintStats() const;
+};
+
+} // end namespace akj
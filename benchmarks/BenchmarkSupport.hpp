@@ -0,0 +1,132 @@
+//===-- BenchmarkSupport.hpp - Helpers shared by the benchmarks -*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// The pieces every benchmark in this directory needs: a random number
+// generator that gives the same inputs on every machine, and parsing for the
+// options they have in common.
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "../RawOstream.hpp"
+#include "../StringRef.hpp"
+#include <cstdlib>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace akj {
+namespace bench {
+
+/// Random - xorshift64*, so that the inputs are the same on every machine.
+/// It also meets the requirements of a uniform random bit generator, so it
+/// can drive std::shuffle.
+class Random {
+  uint64_t State;
+
+public:
+  typedef uint64_t result_type;
+
+  explicit Random(uint64_t Seed) : State(Seed) {}
+
+  static constexpr uint64_t min() { return 0; }
+  static constexpr uint64_t max() { return ~uint64_t(0); }
+  uint64_t operator()() { return next(); }
+
+  uint64_t next() {
+    State ^= State >> 12;
+    State ^= State << 25;
+    State ^= State >> 27;
+    return State * 2685821657736338717ULL;
+  }
+
+  /// nextSkewed - Return a number below Limit, small ones far more often.
+  size_t nextSkewed(size_t Limit) {
+    uint64_t R = next();
+    return size_t((R >> 32) % (1 + (R & 0xffffffff) % Limit));
+  }
+};
+
+/// OutputFormat - What -format= selects: a table for people, or one record
+/// per line or object for scripts.
+enum OutputFormat {
+  FormatText,
+  FormatCSV,
+  FormatJSON
+};
+
+/// parseFormat - Parse the value of -format=, reporting a bad one on errs().
+inline bool parseFormat(cStringRef Value, OutputFormat &Format) {
+  if (Value == "text")
+    Format = FormatText;
+  else if (Value == "csv")
+    Format = FormatCSV;
+  else if (Value == "json")
+    Format = FormatJSON;
+  else {
+    errs() << "error: unknown format '" << Value << "'\n";
+    return false;
+  }
+  return true;
+}
+
+/// parseCount - Parse a count with an optional k or m suffix. Counts below
+/// Min are rejected.
+inline bool parseCount(cStringRef Str, size_t &Count, size_t Min = 1) {
+  uint64_t Scale = 1;
+  if (Str.endswith("k") || Str.endswith("K"))
+    Scale = 1024;
+  else if (Str.endswith("m") || Str.endswith("M"))
+    Scale = 1024 * 1024;
+  if (Scale != 1)
+    Str = Str.drop_back(1);
+  uint64_t Value;
+  if (Str.getAsInteger(10, Value) || Value > ~uint64_t(0) / Scale)
+    return false;
+  Value *= Scale;
+  if (Value == 0 || Value < Min || Value != size_t(Value))
+    return false;
+  Count = size_t(Value);
+  return true;
+}
+
+/// parseCountList - Parse a comma separated list of counts, as parseCount
+/// does, into Counts. What names the counts in the error for a bad one.
+inline bool parseCountList(cStringRef Str, std::vector<size_t> &Counts,
+                           const char *What, size_t Min = 1) {
+  Counts.clear();
+  while (!Str.empty()) {
+    std::pair<cStringRef, cStringRef> Split = Str.split(',');
+    size_t Count;
+    if (!parseCount(Split.first, Count, Min)) {
+      errs() << "error: bad " << What << " '" << Split.first << "'\n";
+      return false;
+    }
+    Counts.push_back(Count);
+    Str = Split.second;
+  }
+  return true;
+}
+
+/// parseSeconds - Parse the value of -min-time=.
+inline bool parseSeconds(cStringRef Value, double &Seconds) {
+  char *End;
+  std::string Str = Value.str();
+  double Result = strtod(Str.c_str(), &End);
+  if (Str.empty() || *End || !(Result >= 0)) {
+    errs() << "error: bad time '" << Value << "'\n";
+    return false;
+  }
+  Seconds = Result;
+  return true;
+}
+
+} // end namespace bench
+} // end namespace akj
@@ -0,0 +1,513 @@
+//===-- CompressionBenchmark.cpp - Compression codec benchmarks -*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures compression and decompression throughput, compression ratio and
+// heap allocations of every codec and level in Compression.hpp and
+// BlockCompression.hpp, over a corpus of synthetic inputs and any files named
+// on the command line, each cut to several sizes.
+//
+// Like the library itself this is a single translation unit; build it with
+//   g++ -std=c++11 -O2 benchmarks/CompressionBenchmark.cpp -lz -lpthread
+//
+// Usage: CompressionBenchmark [options] [files...]
+//   -format=text|csv|json  output format (text)
+//   -sizes=N,N,...         input sizes, with an optional k or m suffix
+//                          (4k,64k,1m,8m)
+//   -min-time=SECONDS      time to spend on each measurement (0.2)
+//   -codec=NAME            only run codecs whose name contains NAME
+//   -no-synthetic          only benchmark the files
+//
+// The csv and json formats print one record per input and codec, with the
+// same fields, so that runs can be diffed or fed to a regression tracker.
+// Allocations count calls to operator new; memory zlib gets from malloc on
+// its own is not included.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../build-all.cpp"
+#include "BenchmarkSupport.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace akj;
+using namespace akj::bench;
+
+static std::atomic<uint64_t> NumAllocations(0);
+
+void *operator new(size_t Size) {
+  ++NumAllocations;
+  if (void *P = malloc(Size ? Size : 1))
+    return P;
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t Size) {
+  return operator new(Size);
+}
+
+void *operator new(size_t Size, const std::nothrow_t &) throw() {
+  ++NumAllocations;
+  return malloc(Size ? Size : 1);
+}
+
+void *operator new[](size_t Size, const std::nothrow_t &Tag) throw() {
+  return operator new(Size, Tag);
+}
+
+// Every form of operator delete is replaced along with operator new, so
+// that nothing allocated here reaches the library's delete or the reverse.
+// release is kept out of line so that the compiler doesn't see free()
+// meeting a pointer from operator new.
+static AKJ_ATTRIBUTE_NOINLINE void release(void *P) { free(P); }
+
+void operator delete(void *P) throw() { release(P); }
+void operator delete[](void *P) throw() { release(P); }
+void operator delete(void *P, const std::nothrow_t &) throw() { release(P); }
+void operator delete[](void *P, const std::nothrow_t &) throw() { release(P); }
+#if defined(__cpp_sized_deallocation)
+void operator delete(void *P, size_t) throw() { release(P); }
+void operator delete[](void *P, size_t) throw() { release(P); }
+#endif
+
+namespace {
+
+struct Options {
+  OutputFormat Format;
+  std::vector<size_t> Sizes;
+  double MinTime;
+  std::string CodecFilter;
+  bool Synthetic;
+  std::vector<std::string> Files;
+
+  Options() : Format(FormatText), MinTime(0.2), Synthetic(true) {}
+};
+
+/// Input - One entry of the corpus.
+struct Input {
+  std::string Name;
+  std::string Data;
+};
+
+/// Codec - A way of compressing a buffer. Compress and Uncompress return the
+/// size they produced, or 0 on failure. Out has room for Bound bytes.
+struct Codec {
+  const char *Name;
+  const char *Level;
+  size_t (*Bound)(size_t Size);
+  size_t (*Compress)(cStringRef In, char *Out, size_t OutSize);
+  size_t (*Uncompress)(cStringRef In, char *Out, size_t OutSize);
+};
+
+struct Result {
+  size_t CompressedSize;
+  double CompressMBs;
+  double UncompressMBs;
+  double CompressAllocs;
+  double UncompressAllocs;
+  bool RoundTrips;
+};
+
+//===----------------------------------------------------------------------===//
+// Codecs
+//===----------------------------------------------------------------------===//
+
+template <zlib::CompressionLevel Level>
+size_t zlibCompress(cStringRef In, char *Out, size_t OutSize) {
+  size_t Size;
+  if (zlib::compress(In, cMutableArrayRef<char>(Out, OutSize), Size, Level) !=
+      zlib::StatusOK)
+    return 0;
+  return Size;
+}
+
+size_t zlibUncompress(cStringRef In, char *Out, size_t OutSize) {
+  size_t Size;
+  if (zlib::uncompress(In, cMutableArrayRef<char>(Out, OutSize), Size) !=
+      zlib::StatusOK)
+    return 0;
+  return Size;
+}
+
+size_t lz4Compress(cStringRef In, char *Out, size_t OutSize) {
+  int Size = lz4::compress(In, cMutableArrayRef<char>(Out, OutSize));
+  return Size < 0 ? 0 : size_t(Size);
+}
+
+size_t lz4Uncompress(cStringRef In, char *Out, size_t OutSize) {
+  int Size = lz4::uncompress(In, cMutableArrayRef<char>(Out, OutSize));
+  return Size < 0 ? 0 : size_t(Size);
+}
+
+size_t lz4Bound(size_t Size) {
+  return lz4::compressBound(Size);
+}
+
+size_t zlibBound(size_t Size) {
+  return zlib::compressBound(Size);
+}
+
+template <zlib::CompressionLevel Level>
+size_t adaptiveCompress(cStringRef In, char *Out, size_t OutSize) {
+  size_t Size;
+  if (adaptive::compress(In, cMutableArrayRef<char>(Out, OutSize), Size,
+                         Level) != zlib::StatusOK)
+    return 0;
+  return Size;
+}
+
+size_t adaptiveUncompress(cStringRef In, char *Out, size_t OutSize) {
+  size_t Size;
+  if (adaptive::uncompress(In, cMutableArrayRef<char>(Out, OutSize), Size) !=
+      zlib::StatusOK)
+    return 0;
+  return Size;
+}
+
+size_t adaptiveBound(size_t Size) {
+  return adaptive::compressBound(Size);
+}
+
+// The block container API only produces MemoryBuffers, so the copy into Out
+// is part of what gets measured. It is small next to the compression.
+template <blocks::Codec C, zlib::CompressionLevel Level>
+size_t blocksCompress(cStringRef In, char *Out, size_t OutSize) {
+  OwningPtr<MemoryBuffer> Buf;
+  if (blocks::compress(In, Buf, C, Level) != zlib::StatusOK ||
+      Buf->getBufferSize() > OutSize)
+    return 0;
+  memcpy(Out, Buf->getBufferStart(), Buf->getBufferSize());
+  return Buf->getBufferSize();
+}
+
+size_t blocksUncompress(cStringRef In, char *Out, size_t OutSize) {
+  OwningPtr<MemoryBuffer> Buf;
+  if (blocks::uncompress(In, Buf) != zlib::StatusOK ||
+      Buf->getBufferSize() > OutSize)
+    return 0;
+  memcpy(Out, Buf->getBufferStart(), Buf->getBufferSize());
+  return Buf->getBufferSize();
+}
+
+size_t blocksBound(size_t Size) {
+  size_t NumBlocks = (Size + blocks::DefaultBlockSize - 1) /
+                     blocks::DefaultBlockSize;
+  return blocks::getContainerHeaderSize(NumBlocks) + Size;
+}
+
+const Codec Codecs[] = {
+  { "lz4", "-", lz4Bound, lz4Compress, lz4Uncompress },
+  { "zlib", "speed", zlibBound, zlibCompress<zlib::BestSpeedCompression>,
+    zlibUncompress },
+  { "zlib", "default", zlibBound, zlibCompress<zlib::DefaultCompression>,
+    zlibUncompress },
+  { "zlib", "size", zlibBound, zlibCompress<zlib::BestSizeCompression>,
+    zlibUncompress },
+  { "adaptive", "speed", adaptiveBound,
+    adaptiveCompress<zlib::BestSpeedCompression>, adaptiveUncompress },
+  { "adaptive", "default", adaptiveBound,
+    adaptiveCompress<zlib::DefaultCompression>, adaptiveUncompress },
+  { "blocks-lz4", "-", blocksBound,
+    blocksCompress<blocks::CodecLZ4, zlib::DefaultCompression>,
+    blocksUncompress },
+  { "blocks-zlib", "default", blocksBound,
+    blocksCompress<blocks::CodecZlib, zlib::DefaultCompression>,
+    blocksUncompress },
+};
+
+//===----------------------------------------------------------------------===//
+// Corpus
+//===----------------------------------------------------------------------===//
+
+const char *const Words[] = {
+  "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "was",
+  "with", "be", "by", "on", "not", "he", "this", "are", "or", "his", "from",
+  "at", "which", "but", "have", "an", "had", "they", "you", "were", "their",
+  "one", "all", "we", "can", "her", "has", "there", "been", "if", "more",
+  "when", "will", "would", "who", "so", "no", "compression", "buffer",
+  "stream", "block", "dictionary", "window", "literal", "match", "offset"
+};
+
+std::string makeRandom(size_t Size) {
+  Random R(1);
+  std::string S(Size, 0);
+  for (size_t I = 0; I != Size; ++I)
+    S[I] = char(R.next() >> 56);
+  return S;
+}
+
+std::string makeText(size_t Size) {
+  Random R(2);
+  std::string S;
+  S.reserve(Size + 16);
+  const size_t NumWords = sizeof(Words) / sizeof(Words[0]);
+  while (S.size() < Size) {
+    S += Words[R.nextSkewed(NumWords)];
+    S += R.next() % 12 == 0 ? ".\n" : " ";
+  }
+  S.resize(Size);
+  return S;
+}
+
+std::string makeRecords(size_t Size) {
+  Random R(3);
+  std::string S;
+  S.reserve(Size + 128);
+  for (unsigned Id = 0; S.size() < Size; ++Id) {
+    S += "{\"id\":" + std::to_string(Id) +
+         ",\"user\":\"user" + std::to_string(R.nextSkewed(1000)) +
+         "\",\"score\":" + std::to_string(R.next() % 100000) +
+         ",\"tag\":\"" + Words[R.nextSkewed(20)] + "\"}\n";
+  }
+  S.resize(Size);
+  return S;
+}
+
+std::string makeIntegers(size_t Size) {
+  Random R(4);
+  std::string S(Size, 0);
+  uint32_t Value = 1000000;
+  for (size_t I = 0; I + 4 <= Size; I += 4) {
+    Value += uint32_t(R.next() % 64);
+    support::endian::write<uint32_t, support::little, support::unaligned>(
+        &S[I], Value);
+  }
+  return S;
+}
+
+std::string makeSizeName(size_t Size) {
+  if (Size % (1024 * 1024) == 0)
+    return std::to_string(Size / (1024 * 1024)) + "m";
+  if (Size % 1024 == 0)
+    return std::to_string(Size / 1024) + "k";
+  return std::to_string(Size);
+}
+
+bool buildCorpus(const Options &Opts, std::vector<Input> &Corpus) {
+  if (Opts.Synthetic) {
+    for (size_t I = 0, E = Opts.Sizes.size(); I != E; ++I) {
+      size_t Size = Opts.Sizes[I];
+      std::string Suffix = "/" + makeSizeName(Size);
+      Input Entries[] = {
+        { "zeros" + Suffix, std::string(Size, 0) },
+        { "random" + Suffix, makeRandom(Size) },
+        { "text" + Suffix, makeText(Size) },
+        { "records" + Suffix, makeRecords(Size) },
+        { "integers" + Suffix, makeIntegers(Size) },
+      };
+      Corpus.insert(Corpus.end(), Entries, Entries + 5);
+    }
+  }
+
+  for (size_t I = 0, E = Opts.Files.size(); I != E; ++I) {
+    OwningPtr<MemoryBuffer> Buf;
+    if (error_code EC = MemoryBuffer::getFile(Opts.Files[I].c_str(), Buf)) {
+      errs() << "error: can't read '" << Opts.Files[I] << "': "
+             << EC.message() << "\n";
+      return false;
+    }
+    cStringRef Data = Buf->getBuffer();
+    // Every size that is smaller than the file, then the whole file.
+    for (size_t J = 0, JE = Opts.Sizes.size(); J != JE; ++J) {
+      if (Opts.Sizes[J] >= Data.size())
+        continue;
+      Input Entry = { Opts.Files[I] + "/" + makeSizeName(Opts.Sizes[J]),
+                      Data.substr(0, Opts.Sizes[J]).str() };
+      Corpus.push_back(Entry);
+    }
+    Input Entry = { Opts.Files[I], Data.str() };
+    Corpus.push_back(Entry);
+  }
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Measurement
+//===----------------------------------------------------------------------===//
+
+typedef std::chrono::steady_clock Clock;
+
+/// measure - Run Fn until MinTime seconds have passed, at least twice with the
+/// first run as a warm up, and return the average seconds and allocations of
+/// the measured runs.
+template <typename FnTy>
+void measure(double MinTime, FnTy Fn, double &Seconds, double &Allocations) {
+  Fn();
+  unsigned Runs = 0;
+  uint64_t AllocationsBefore = NumAllocations;
+  Clock::time_point Start = Clock::now();
+  double Elapsed;
+  do {
+    Fn();
+    ++Runs;
+    Elapsed = std::chrono::duration<double>(Clock::now() - Start).count();
+  } while (Elapsed < MinTime);
+  Seconds = Elapsed / Runs;
+  Allocations = double(NumAllocations - AllocationsBefore) / Runs;
+}
+
+Result runCodec(const Codec &C, cStringRef Data, double MinTime) {
+  Result R;
+  std::vector<char> Compressed(C.Bound(Data.size()) + 1);
+  std::vector<char> Uncompressed(Data.size() + 1);
+  double Seconds;
+
+  measure(MinTime, [&] {
+    R.CompressedSize = C.Compress(Data, Compressed.data(), Compressed.size());
+  }, Seconds, R.CompressAllocs);
+  R.CompressMBs = Data.size() / Seconds / 1e6;
+
+  cStringRef Packed(Compressed.data(), R.CompressedSize);
+  size_t UncompressedSize = 0;
+  measure(MinTime, [&] {
+    UncompressedSize = C.Uncompress(Packed, Uncompressed.data(),
+                                    Uncompressed.size());
+  }, Seconds, R.UncompressAllocs);
+  R.UncompressMBs = Data.size() / Seconds / 1e6;
+
+  R.RoundTrips = (R.CompressedSize != 0 || Data.empty()) &&
+                 UncompressedSize == Data.size() &&
+                 cStringRef(Uncompressed.data(), UncompressedSize) == Data;
+  return R;
+}
+
+//===----------------------------------------------------------------------===//
+// Output
+//===----------------------------------------------------------------------===//
+
+void printHeader(raw_ostream &OS, OutputFormat Format) {
+  switch (Format) {
+  case FormatText: {
+    const char *const C[] = { "input", "codec", "level", "size", "compressed",
+                              "ratio", "comp MB/s", "dec MB/s", "comp new",
+                              "dec new" };
+    OS << format("%-28s %-12s %-8s", C[0], C[1], C[2])
+       << format(" %12s %12s %8s", C[3], C[4], C[5])
+       << format(" %10s %10s %9s %9s ok\n", C[6], C[7], C[8], C[9]);
+    break;
+  }
+  case FormatCSV:
+    OS << "input,codec,level,size,compressed_size,ratio,compress_mb_s,"
+          "uncompress_mb_s,compress_allocs,uncompress_allocs,ok\n";
+    break;
+  case FormatJSON:
+    OS << "[\n";
+    break;
+  }
+}
+
+void printResult(raw_ostream &OS, OutputFormat Format, bool First,
+                 const Input &In, const Codec &C, const Result &R) {
+  double Ratio = R.CompressedSize ? double(In.Data.size()) / R.CompressedSize
+                                  : 0.0;
+  switch (Format) {
+  case FormatText:
+    OS << format("%-28s %-12s %-8s", In.Name.c_str(), C.Name, C.Level)
+       << format(" %12llu %12llu %8.3f", (unsigned long long)In.Data.size(),
+                 (unsigned long long)R.CompressedSize, Ratio)
+       << format(" %10.1f %10.1f %9.1f %9.1f", R.CompressMBs,
+                 R.UncompressMBs, R.CompressAllocs, R.UncompressAllocs)
+       << (R.RoundTrips ? " yes\n" : " NO\n");
+    break;
+  case FormatCSV:
+    OS << '"';
+    OS.write_escaped(In.Name);
+    OS << "\"," << C.Name << ',' << C.Level << ',' << In.Data.size() << ','
+       << R.CompressedSize << ','
+       << format("%.4f,%.2f,%.2f,%.2f,%.2f,", Ratio, R.CompressMBs,
+                 R.UncompressMBs, R.CompressAllocs, R.UncompressAllocs)
+       << (R.RoundTrips ? "1" : "0") << '\n';
+    break;
+  case FormatJSON:
+    OS << (First ? "  {" : ",\n  {") << "\"input\": \"";
+    OS.write_escaped(In.Name);
+    OS << "\", \"codec\": \"" << C.Name << "\", \"level\": \"" << C.Level
+       << "\", \"size\": " << In.Data.size()
+       << ", \"compressed_size\": " << R.CompressedSize
+       << format(", \"ratio\": %.4f, \"compress_mb_s\": %.2f", Ratio,
+                 R.CompressMBs)
+       << format(", \"uncompress_mb_s\": %.2f, \"compress_allocs\": %.2f",
+                 R.UncompressMBs, R.CompressAllocs)
+       << format(", \"uncompress_allocs\": %.2f", R.UncompressAllocs)
+       << ", \"ok\": " << (R.RoundTrips ? "true" : "false") << "}";
+    break;
+  }
+  OS.flush();
+}
+
+void printFooter(raw_ostream &OS, OutputFormat Format) {
+  if (Format == FormatJSON)
+    OS << "\n]\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Command line
+//===----------------------------------------------------------------------===//
+
+bool parseOptions(int argc, char **argv, Options &Opts) {
+  for (int I = 1; I < argc; ++I) {
+    cStringRef Arg(argv[I]);
+    if (Arg.startswith("-format=")) {
+      if (!parseFormat(Arg.substr(8), Opts.Format))
+        return false;
+    } else if (Arg.startswith("-sizes=")) {
+      if (!parseCountList(Arg.substr(7), Opts.Sizes, "size"))
+        return false;
+    } else if (Arg.startswith("-min-time=")) {
+      if (!parseSeconds(Arg.substr(10), Opts.MinTime))
+        return false;
+    } else if (Arg.startswith("-codec=")) {
+      Opts.CodecFilter = Arg.substr(7);
+    } else if (Arg == "-no-synthetic") {
+      Opts.Synthetic = false;
+    } else if (Arg.startswith("-")) {
+      errs() << "error: unknown option '" << Arg << "'\n";
+      return false;
+    } else {
+      Opts.Files.push_back(Arg);
+    }
+  }
+  if (Opts.Sizes.empty()) {
+    size_t Defaults[] = { 4 * 1024, 64 * 1024, 1024 * 1024, 8 * 1024 * 1024 };
+    Opts.Sizes.assign(Defaults, Defaults + 4);
+  }
+  return true;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+  Options Opts;
+  if (!parseOptions(argc, argv, Opts))
+    return 2;
+
+  std::vector<Input> Corpus;
+  if (!buildCorpus(Opts, Corpus))
+    return 2;
+
+  raw_ostream &OS = outs();
+  printHeader(OS, Opts.Format);
+  bool First = true;
+  bool AllRoundTrip = true;
+  for (size_t I = 0, E = Corpus.size(); I != E; ++I) {
+    for (size_t J = 0; J != sizeof(Codecs) / sizeof(Codecs[0]); ++J) {
+      const Codec &C = Codecs[J];
+      if (cStringRef(C.Name).find(Opts.CodecFilter) == cStringRef::npos)
+        continue;
+      Result R = runCodec(C, Corpus[I].Data, Opts.MinTime);
+      AllRoundTrip &= R.RoundTrips;
+      printResult(OS, Opts.Format, First, Corpus[I], C, R);
+      First = false;
+    }
+  }
+  printFooter(OS, Opts.Format);
+  return AllRoundTrip ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+//===-- ConcurrentMapBenchmark.cpp - Concurrent map scaling -----*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures how lookups and inserts scale with the number of threads, for a
+// ConcurrentHashMap and for a FlatHashMap behind a single mutex, the way a
+// shared table is protected without it.
+//
+// The map is filled with the keys first. Each thread then performs the same
+// number of operations on random keys, twice as many keys as are in the map
+// so that half of the lookups miss; the given percentage of operations are
+// lookups and the rest are insert_or_get, half of them of absent keys, or
+// erase. Throughput is the total number of operations per second of wall
+// time, and speedup is relative to the same map on one thread.
+//
+// Like the library itself this is a single translation unit; build it with
+//   g++ -std=c++11 -O2 benchmarks/ConcurrentMapBenchmark.cpp -lz -lpthread
+//
+// Usage: ConcurrentMapBenchmark [options]
+//   -threads=N,N,...       thread counts (1, 2, 4, ... up to the number of
+//                          hardware threads)
+//   -reads=PERCENT         percentage of operations that are lookups (95)
+//   -keys=N                keys in the map, with an optional k or m suffix
+//                          (1m)
+//   -ops=N                 operations per thread, with an optional k or m
+//                          suffix (2m)
+//
+//===----------------------------------------------------------------------===//
+
+#include "../build-all.cpp"
+#include "../ConcurrentHashMap.hpp"
+#include "BenchmarkSupport.hpp"
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+using namespace akj;
+using namespace akj::bench;
+
+namespace {
+
+struct Options {
+  std::vector<unsigned> Threads;
+  unsigned ReadPercent;
+  size_t NumKeys;
+  size_t NumOps;
+
+  Options() : ReadPercent(95), NumKeys(1024 * 1024), NumOps(2 * 1024 * 1024) {}
+};
+
+/// LockedMap - A FlatHashMap that takes one mutex around every operation,
+/// with the interface of ConcurrentHashMap.
+class LockedMap {
+  mutable std::mutex Lock;
+  FlatHashMap<uint64_t, uint64_t> Map;
+
+public:
+  bool find(uint64_t Key, uint64_t &Result) const {
+    std::lock_guard<std::mutex> Guard(Lock);
+    FlatHashMap<uint64_t, uint64_t>::const_iterator I = Map.find(Key);
+    if (I == Map.end())
+      return false;
+    Result = I->second;
+    return true;
+  }
+
+  std::pair<uint64_t, bool> insert_or_get(uint64_t Key, uint64_t Value) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    std::pair<FlatHashMap<uint64_t, uint64_t>::iterator, bool> R =
+        Map.insert(std::make_pair(Key, Value));
+    return std::make_pair(R.first->second, R.second);
+  }
+
+  bool erase(uint64_t Key) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    return Map.erase(Key);
+  }
+};
+
+/// Sink - Keeps the results of lookups alive.
+volatile uint64_t Sink;
+
+/// measure - Run Opts.NumOps operations on each of NumThreads threads and
+/// return the total number of operations per second.
+template<typename MapT>
+double measure(MapT &Map, unsigned NumThreads, const Options &Opts) {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point Start = Clock::now();
+  parallel_for(NumThreads, [&](size_t T) {
+    Random Rand(T + 1);
+    uint64_t Found = 0;
+    for (size_t I = 0; I != Opts.NumOps; ++I) {
+      uint64_t R = Rand.next();
+      uint64_t Key = (R >> 8) % (2 * Opts.NumKeys);
+      if ((R & 0xFF) * 100 < Opts.ReadPercent * 256) {
+        uint64_t Value;
+        Found += Map.find(Key, Value);
+      } else if (R & 0x100) {
+        Found += Map.insert_or_get(Key, Key).first;
+      } else {
+        Found += Map.erase(Key);
+      }
+    }
+    Sink = Found;
+  }, NumThreads);
+  double Seconds = std::chrono::duration<double>(Clock::now() - Start).count();
+  return double(Opts.NumOps) * NumThreads / Seconds;
+}
+
+template<typename MapT>
+void runMap(const char *Name, const Options &Opts) {
+  double Base = 0;
+  for (size_t I = 0, E = Opts.Threads.size(); I != E; ++I) {
+    MapT Map;
+    for (size_t K = 0; K != Opts.NumKeys; ++K)
+      Map.insert_or_get(K * 2, K * 2);
+    double Rate = measure(Map, Opts.Threads[I], Opts);
+    if (I == 0)
+      Base = Rate / Opts.Threads[0];
+    outs() << format("%-20s %8u ", Name, Opts.Threads[I])
+           << format("%12.2f %8.2f\n", Rate / 1e6, Rate / Base);
+  }
+}
+
+bool parseOptions(int argc, char **argv, Options &Opts) {
+  for (int I = 1; I < argc; ++I) {
+    cStringRef Arg(argv[I]);
+    if (Arg.startswith("-threads=")) {
+      cSmallVector<cStringRef, 8> Parts;
+      Arg.substr(9).split(Parts, ",");
+      for (size_t J = 0, E = Parts.size(); J != E; ++J) {
+        unsigned Count;
+        if (Parts[J].getAsInteger(10, Count) || Count == 0) {
+          errs() << "error: bad thread count '" << Parts[J] << "'\n";
+          return false;
+        }
+        Opts.Threads.push_back(Count);
+      }
+    } else if (Arg.startswith("-reads=")) {
+      if (Arg.substr(7).getAsInteger(10, Opts.ReadPercent) ||
+          Opts.ReadPercent > 100) {
+        errs() << "error: bad read percentage '" << Arg.substr(7) << "'\n";
+        return false;
+      }
+    } else if (Arg.startswith("-keys=")) {
+      if (!parseCount(Arg.substr(6), Opts.NumKeys)) {
+        errs() << "error: bad key count '" << Arg.substr(6) << "'\n";
+        return false;
+      }
+    } else if (Arg.startswith("-ops=")) {
+      if (!parseCount(Arg.substr(5), Opts.NumOps)) {
+        errs() << "error: bad operation count '" << Arg.substr(5) << "'\n";
+        return false;
+      }
+    } else {
+      errs() << "error: unknown option '" << Arg << "'\n";
+      return false;
+    }
+  }
+  if (Opts.Threads.empty()) {
+    unsigned Max = hardware_threads();
+    for (unsigned T = 1; T < Max; T *= 2)
+      Opts.Threads.push_back(T);
+    Opts.Threads.push_back(Max);
+  }
+  return true;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+  Options Opts;
+  if (!parseOptions(argc, argv, Opts))
+    return 2;
+
+  const char *Map = "map", *Threads = "threads", *Rate = "Mops/s",
+             *Speedup = "speedup";
+  outs() << format("%u%% lookups, %zu keys, ", Opts.ReadPercent, Opts.NumKeys)
+         << format("%zu operations per thread\n", Opts.NumOps)
+         << format("%-20s %8s %12s %8s\n", Map, Threads, Rate, Speedup);
+  runMap<LockedMap>("mutex+FlatHashMap", Opts);
+  runMap<ConcurrentHashMap<uint64_t, uint64_t> >("ConcurrentHashMap", Opts);
+  return 0;
+}
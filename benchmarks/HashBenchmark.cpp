@@ -0,0 +1,601 @@
+//===-- HashBenchmark.cpp - Hashing speed and quality benchmarks -*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures the speed and the statistical quality of the hash functions in
+// Hashing.hpp.
+//
+//   - Speed: time per hash, cycles per hash and cycles per byte of
+//     hash_value, hash_bulk and hash_value128 for input sizes that hit each
+//     of the short paths (1-3, 4-8, 9-16, 17-32 and 33-64 bytes), the long
+//     path and the bulk path. Cycles are read from the time stamp counter on
+//     x86, which ticks at a fixed rate that may differ from the core clock.
+//   - Distribution: hashes of structured key sets (file paths, decimal
+//     strings, log lines, integers, strided integers, pointers and
+//     hash_combine pairs) are put in power of two buckets by their low bits,
+//     as a hash table would, and by their high bits. The chi-square of the
+//     bucket counts is printed as a z-score, which is within a few units of
+//     0 for a uniform hash. Collisions of the full hash and of its low 32
+//     bits are counted; the expected number of 32-bit collisions is printed
+//     next to them.
+//   - Avalanche: for each path, how many output bits change, on average,
+//     when one input bit is flipped (ideally half), and the largest bias of
+//     any output bit away from changing half the time.
+//
+// Like the library itself this is a single translation unit; build it with
+//   g++ -std=c++11 -O2 benchmarks/HashBenchmark.cpp -lz -lpthread
+//
+// Usage: HashBenchmark [options]
+//   -format=text|csv|json  output format (text)
+//   -min-time=SECONDS      time to spend on each speed measurement (0.2)
+//   -keys=N                keys per distribution test, with an optional k
+//                          or m suffix (1m)
+//   -no-speed              skip the speed measurements
+//   -no-quality            skip the distribution and avalanche tests
+//
+//===----------------------------------------------------------------------===//
+
+#include "../build-all.cpp"
+#include "BenchmarkSupport.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+# define HAVE_CYCLE_COUNTER 1
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# else
+#  include <x86intrin.h>
+# endif
+#else
+# define HAVE_CYCLE_COUNTER 0
+#endif
+
+using namespace akj;
+using namespace akj::bench;
+
+namespace {
+
+struct Options {
+  OutputFormat Format;
+  double MinTime;
+  size_t NumKeys;
+  bool Speed;
+  bool Quality;
+
+  Options()
+    : Format(FormatText), MinTime(0.2), NumKeys(1024 * 1024), Speed(true),
+      Quality(true) {}
+};
+
+/// pathName - Return the name of the code path that hashes Size bytes.
+const char *pathName(size_t Size, bool Bulk) {
+  if (Size == 0)
+    return "empty";
+  if (Size <= 3)
+    return "1to3";
+  if (Size <= 8)
+    return "4to8";
+  if (Size <= 16)
+    return "9to16";
+  if (Size <= 32)
+    return "17to32";
+  if (Size <= 64)
+    return "33to64";
+  if (Bulk && Size > hashing::detail::hash_bulk_threshold)
+    return "bulk";
+  return "long";
+}
+
+//===----------------------------------------------------------------------===//
+// Speed
+//===----------------------------------------------------------------------===//
+
+typedef std::chrono::steady_clock Clock;
+
+uint64_t readCycles() {
+#if HAVE_CYCLE_COUNTER
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/// Hasher - One of the functions whose speed is measured.
+struct Hasher {
+  const char *Name;
+  uint64_t (*Hash)(cStringRef Data);
+  bool Bulk;
+};
+
+uint64_t hashValue(cStringRef Data) {
+  return hash_value(Data);
+}
+
+uint64_t hashBulk(cStringRef Data) {
+  return hash_bulk(Data);
+}
+
+uint64_t hashValue128(cStringRef Data) {
+  hash_code128 H = hash_value128(Data);
+  return H.getLow() ^ H.getHigh();
+}
+
+const Hasher Hashers[] = {
+  { "hash_value", hashValue, false },
+  { "hash_bulk", hashBulk, true },
+  { "hash_value128", hashValue128, false },
+};
+
+const size_t SpeedSizes[] = {
+  1, 3, 4, 8, 12, 16, 24, 32, 48, 64, 100, 256, 1024, 4096, 65536, 1048576
+};
+
+struct SpeedResult {
+  size_t Size;
+  double NsPerHash;
+  double CyclesPerHash;
+};
+
+/// measureSpeed - Hash inputs of Size bytes until MinTime seconds have
+/// passed. Short inputs are taken from different offsets of a small buffer,
+/// a batch at a time, so that the loop measures throughput with the data in
+/// cache rather than the latency of a single hash.
+SpeedResult measureSpeed(const Hasher &H, size_t Size, double MinTime) {
+  const size_t Window = 4096;
+  const size_t Batch = Size <= 4096 ? 256 : 1;
+  std::string Buffer(Size + Window, 0);
+  Random R(Size);
+  for (size_t I = 0; I != Buffer.size(); ++I)
+    Buffer[I] = char(R.next() >> 56);
+  const char *Data = Buffer.data();
+
+  uint64_t Sink = 0;
+  size_t Offset = 0;
+  // Warm up.
+  for (size_t I = 0; I != Batch; ++I)
+    Sink += H.Hash(cStringRef(Data + (I * 67) % Window, Size));
+
+  uint64_t Hashes = 0;
+  uint64_t StartCycles = readCycles();
+  Clock::time_point Start = Clock::now();
+  double Elapsed;
+  do {
+    for (size_t I = 0; I != Batch; ++I) {
+      Offset = (Offset + 67) % Window;
+      Sink += H.Hash(cStringRef(Data + Offset, Size));
+    }
+    Hashes += Batch;
+    Elapsed = std::chrono::duration<double>(Clock::now() - Start).count();
+  } while (Elapsed < MinTime);
+  uint64_t Cycles = readCycles() - StartCycles;
+
+  // Keep the hashes alive without printing them.
+  if (Sink == 42)
+    errs() << "";
+
+  SpeedResult Result;
+  Result.Size = Size;
+  Result.NsPerHash = Elapsed * 1e9 / Hashes;
+  Result.CyclesPerHash = HAVE_CYCLE_COUNTER ? double(Cycles) / Hashes : 0.0;
+  return Result;
+}
+
+//===----------------------------------------------------------------------===//
+// Distribution
+//===----------------------------------------------------------------------===//
+
+/// KeySet - A named set of structured keys. Fill stores the hash of key I
+/// in Hashes[I] for every I.
+struct KeySet {
+  const char *Name;
+  void (*Fill)(std::vector<uint64_t> &Hashes);
+};
+
+void fillPaths(std::vector<uint64_t> &Hashes) {
+  const char *const Dirs[] = { "src", "include", "lib", "test", "tools",
+                               "docs", "third_party" };
+  const char *const Exts[] = { ".cpp", ".hpp", ".c", ".h", ".txt" };
+  SmallString<128> Path;
+  for (size_t I = 0, E = Hashes.size(); I != E; ++I) {
+    Path.clear();
+    raw_svector_ostream OS(Path);
+    OS << "/home/build/" << Dirs[I % 7] << "/module" << (I / 7) % 113
+       << "/file" << I << Exts[I % 5];
+    Hashes[I] = hash_value(OS.str());
+  }
+}
+
+void fillDecimals(std::vector<uint64_t> &Hashes) {
+  for (size_t I = 0, E = Hashes.size(); I != E; ++I) {
+    std::string S = std::to_string(I);
+    Hashes[I] = hash_value(cStringRef(S));
+  }
+}
+
+void fillLogLines(std::vector<uint64_t> &Hashes) {
+  std::string Line = "2014-01-01 00:00:00 INFO request served in 12 ms, "
+                     "status 200, bytes 4096, request id ";
+  size_t Prefix = Line.size();
+  for (size_t I = 0, E = Hashes.size(); I != E; ++I) {
+    Line.resize(Prefix);
+    Line += std::to_string(I);
+    Hashes[I] = hash_value(cStringRef(Line));
+  }
+}
+
+void fillIntegers(std::vector<uint64_t> &Hashes) {
+  for (size_t I = 0, E = Hashes.size(); I != E; ++I)
+    Hashes[I] = hash_value(uint64_t(I));
+}
+
+void fillStridedIntegers(std::vector<uint64_t> &Hashes) {
+  for (size_t I = 0, E = Hashes.size(); I != E; ++I)
+    Hashes[I] = hash_value(uint64_t(I) << 20);
+}
+
+void fillPointers(std::vector<uint64_t> &Hashes) {
+  // Addresses of consecutive 16 byte objects, like nodes from an allocator.
+  static const char Base[16] = { 0 };
+  for (size_t I = 0, E = Hashes.size(); I != E; ++I)
+    Hashes[I] = hash_value(reinterpret_cast<const void *>(
+        reinterpret_cast<uintptr_t>(Base) + I * 16));
+}
+
+void fillPairs(std::vector<uint64_t> &Hashes) {
+  for (size_t I = 0, E = Hashes.size(); I != E; ++I)
+    Hashes[I] = hash_combine(unsigned(I % 1024), unsigned(I / 1024));
+}
+
+const KeySet KeySets[] = {
+  { "paths", fillPaths },
+  { "decimal-strings", fillDecimals },
+  { "log-lines", fillLogLines },
+  { "integers", fillIntegers },
+  { "strided-integers", fillStridedIntegers },
+  { "pointers", fillPointers },
+  { "hash_combine-pairs", fillPairs },
+};
+
+struct DistributionResult {
+  size_t NumKeys;
+  unsigned BucketBits;
+  double LowZ;
+  double HighZ;
+  size_t Collisions64;
+  size_t Collisions32;
+  double Expected32;
+};
+
+/// chiSquareZ - Put Keys into 2^Bits buckets by the bits of each key starting
+/// at Shift and return how far the chi-square of the bucket counts is from
+/// its mean, in standard deviations.
+double chiSquareZ(const std::vector<uint64_t> &Keys, unsigned Bits,
+                  unsigned Shift) {
+  size_t NumBuckets = size_t(1) << Bits;
+  std::vector<uint32_t> Counts(NumBuckets);
+  for (size_t I = 0, E = Keys.size(); I != E; ++I)
+    ++Counts[(Keys[I] >> Shift) & (NumBuckets - 1)];
+  double Expected = double(Keys.size()) / NumBuckets;
+  double ChiSquare = 0;
+  for (size_t I = 0; I != NumBuckets; ++I) {
+    double D = Counts[I] - Expected;
+    ChiSquare += D * D / Expected;
+  }
+  double Freedom = double(NumBuckets - 1);
+  return (ChiSquare - Freedom) / std::sqrt(2 * Freedom);
+}
+
+/// countDuplicates - Return how many elements of the sorted Keys are equal to
+/// the one before.
+size_t countDuplicates(const std::vector<uint64_t> &Keys) {
+  size_t Count = 0;
+  for (size_t I = 1, E = Keys.size(); I < E; ++I)
+    Count += Keys[I] == Keys[I - 1];
+  return Count;
+}
+
+DistributionResult measureDistribution(const KeySet &Set, size_t NumKeys) {
+  std::vector<uint64_t> Hashes(NumKeys);
+  Set.Fill(Hashes);
+
+  // Four keys per bucket on average, so that the chi-square is meaningful.
+  unsigned Bits = 1;
+  while ((size_t(1) << (Bits + 2)) < NumKeys)
+    ++Bits;
+  // hash_code is a size_t, so a 32-bit host has no high half to look at.
+  unsigned HashBits = unsigned(sizeof(size_t) * 8);
+
+  DistributionResult Result;
+  Result.NumKeys = NumKeys;
+  Result.BucketBits = Bits;
+  Result.LowZ = chiSquareZ(Hashes, Bits, 0);
+  Result.HighZ = chiSquareZ(Hashes, Bits, HashBits - Bits);
+
+  std::vector<uint64_t> Sorted(Hashes);
+  std::sort(Sorted.begin(), Sorted.end());
+  Result.Collisions64 = countDuplicates(Sorted);
+  for (size_t I = 0; I != NumKeys; ++I)
+    Sorted[I] = Hashes[I] & 0xffffffff;
+  std::sort(Sorted.begin(), Sorted.end());
+  Result.Collisions32 = countDuplicates(Sorted);
+  Result.Expected32 = double(NumKeys) * (NumKeys - 1) / 2 / 4294967296.0;
+  return Result;
+}
+
+//===----------------------------------------------------------------------===//
+// Avalanche
+//===----------------------------------------------------------------------===//
+
+const size_t AvalancheSizes[] = { 2, 6, 12, 24, 48, 100, 4096 };
+
+struct AvalancheResult {
+  size_t Size;
+  const char *Path;
+  double MeanFlipped;
+  double WorstBias;
+};
+
+/// measureAvalanche - Flip single bits of random inputs of Size bytes and
+/// count which output bits of the hash change. Inputs longer than 64 bytes
+/// only have bits in their first and last 32 bytes flipped, which is where
+/// the long paths are most likely to be weak.
+AvalancheResult measureAvalanche(size_t Size) {
+  const unsigned Samples = 100;
+  const unsigned OutputBits = unsigned(sizeof(size_t) * 8);
+  bool Bulk = Size > hashing::detail::hash_bulk_threshold;
+  Random R(Size * 7919);
+
+  std::vector<size_t> InputBits;
+  for (size_t Bit = 0; Bit != Size * 8; ++Bit)
+    if (Size <= 64 || Bit < 256 || Bit >= Size * 8 - 256)
+      InputBits.push_back(Bit);
+
+  std::vector<uint64_t> Flips(OutputBits);
+  uint64_t Trials = 0, TotalFlipped = 0;
+  std::string Input(Size, 0);
+  for (unsigned S = 0; S != Samples; ++S) {
+    for (size_t I = 0; I != Size; ++I)
+      Input[I] = char(R.next() >> 56);
+    uint64_t Base = Bulk ? hash_bulk(Input) : hash_value(cStringRef(Input));
+    for (size_t I = 0, E = InputBits.size(); I != E; ++I) {
+      size_t Bit = InputBits[I];
+      Input[Bit / 8] ^= char(1 << (Bit % 8));
+      uint64_t H = Bulk ? hash_bulk(Input) : hash_value(cStringRef(Input));
+      Input[Bit / 8] ^= char(1 << (Bit % 8));
+      uint64_t Diff = Base ^ H;
+      for (unsigned O = 0; O != OutputBits; ++O)
+        Flips[O] += (Diff >> O) & 1;
+      TotalFlipped += CountPopulation_64(Diff);
+      ++Trials;
+    }
+  }
+
+  AvalancheResult Result;
+  Result.Size = Size;
+  Result.Path = pathName(Size, Bulk);
+  Result.MeanFlipped = double(TotalFlipped) / Trials;
+  Result.WorstBias = 0;
+  for (unsigned O = 0; O != OutputBits; ++O)
+    Result.WorstBias = std::max(Result.WorstBias,
+                                std::fabs(double(Flips[O]) / Trials - 0.5));
+  return Result;
+}
+
+//===----------------------------------------------------------------------===//
+// Output
+//===----------------------------------------------------------------------===//
+
+/// Report - Prints the three tables. In csv each table has its own header
+/// and they are separated by blank lines; in json they are arrays under
+/// "speed", "distribution" and "avalanche".
+class Report {
+  raw_ostream &OS;
+  OutputFormat Format;
+  bool FirstTable;
+  bool FirstRow;
+
+  void beginTable(const char *Name) {
+    if (Format == FormatJSON)
+      OS << (FirstTable ? "{\n" : "\n  ],\n") << "  \"" << Name << "\": [";
+    else if (!FirstTable)
+      OS << "\n";
+    FirstTable = false;
+    FirstRow = true;
+  }
+
+  void beginRow() {
+    if (Format == FormatJSON)
+      OS << (FirstRow ? "\n    {" : ",\n    {");
+    FirstRow = false;
+  }
+
+public:
+  Report(raw_ostream &OS, OutputFormat Format)
+    : OS(OS), Format(Format), FirstTable(true), FirstRow(true) {}
+
+  void beginSpeed() {
+    beginTable("speed");
+    const char *const C[] = { "function", "path", "size", "ns/hash",
+                              "cycles/hash", "cycles/byte", "MB/s" };
+    if (Format == FormatText)
+      OS << format("%-14s %-7s %9s", C[0], C[1], C[2])
+         << format(" %10s %12s %12s %10s\n", C[3], C[4], C[5], C[6]);
+    else if (Format == FormatCSV)
+      OS << "function,path,size,ns_per_hash,cycles_per_hash,"
+            "cycles_per_byte,mb_s\n";
+  }
+
+  void speed(const Hasher &H, const SpeedResult &R) {
+    const char *Path = pathName(R.Size, H.Bulk);
+    double PerByte = R.CyclesPerHash / R.Size;
+    double MBs = R.Size / R.NsPerHash * 1e3;
+    beginRow();
+    switch (Format) {
+    case FormatText:
+      OS << format("%-14s %-7s %9llu", H.Name, Path,
+                   (unsigned long long)R.Size)
+         << format(" %10.2f %12.1f %12.3f %10.0f\n", R.NsPerHash,
+                   R.CyclesPerHash, PerByte, MBs);
+      break;
+    case FormatCSV:
+      OS << H.Name << ',' << Path << ',' << R.Size << ','
+         << format("%.3f,%.2f,%.4f,%.1f\n", R.NsPerHash, R.CyclesPerHash,
+                   PerByte, MBs);
+      break;
+    case FormatJSON:
+      OS << "\"function\": \"" << H.Name << "\", \"path\": \"" << Path
+         << "\", \"size\": " << R.Size
+         << format(", \"ns_per_hash\": %.3f, \"cycles_per_hash\": %.2f",
+                   R.NsPerHash, R.CyclesPerHash)
+         << format(", \"cycles_per_byte\": %.4f, \"mb_s\": %.1f}", PerByte,
+                   MBs);
+      break;
+    }
+    OS.flush();
+  }
+
+  void beginDistribution() {
+    beginTable("distribution");
+    const char *const C[] = { "keys", "count", "buckets", "z(low)", "z(high)",
+                              "coll64", "coll32", "expected32" };
+    if (Format == FormatText)
+      OS << format("%-20s %9s %8s", C[0], C[1], C[2])
+         << format(" %9s %9s %7s", C[3], C[4], C[5])
+         << format(" %7s %10s\n", C[6], C[7]);
+    else if (Format == FormatCSV)
+      OS << "keys,count,bucket_bits,z_low,z_high,collisions64,collisions32,"
+            "expected32\n";
+  }
+
+  void distribution(const KeySet &Set, const DistributionResult &R) {
+    const char *Buckets = "2^";
+    beginRow();
+    switch (Format) {
+    case FormatText:
+      OS << format("%-20s %9llu %6s%-2u", Set.Name,
+                   (unsigned long long)R.NumKeys, Buckets, R.BucketBits)
+         << format(" %9.2f %9.2f %7llu", R.LowZ, R.HighZ,
+                   (unsigned long long)R.Collisions64)
+         << format(" %7llu %10.1f\n", (unsigned long long)R.Collisions32,
+                   R.Expected32);
+      break;
+    case FormatCSV:
+      OS << Set.Name << ',' << R.NumKeys << ',' << R.BucketBits << ','
+         << format("%.3f,%.3f,", R.LowZ, R.HighZ) << R.Collisions64 << ','
+         << R.Collisions32 << ',' << format("%.2f\n", R.Expected32);
+      break;
+    case FormatJSON:
+      OS << "\"keys\": \"" << Set.Name << "\", \"count\": " << R.NumKeys
+         << ", \"bucket_bits\": " << R.BucketBits
+         << format(", \"z_low\": %.3f, \"z_high\": %.3f", R.LowZ, R.HighZ)
+         << ", \"collisions64\": " << R.Collisions64
+         << ", \"collisions32\": " << R.Collisions32
+         << format(", \"expected32\": %.2f}", R.Expected32);
+      break;
+    }
+    OS.flush();
+  }
+
+  void beginAvalanche() {
+    beginTable("avalanche");
+    const char *const C[] = { "path", "size", "bits flipped", "worst bias" };
+    if (Format == FormatText)
+      OS << format("%-7s %9s %13s %11s\n", C[0], C[1], C[2], C[3]);
+    else if (Format == FormatCSV)
+      OS << "path,size,mean_bits_flipped,worst_bias\n";
+  }
+
+  void avalanche(const AvalancheResult &R) {
+    beginRow();
+    switch (Format) {
+    case FormatText:
+      OS << format("%-7s %9llu %13.3f %11.4f\n", R.Path,
+                   (unsigned long long)R.Size, R.MeanFlipped, R.WorstBias);
+      break;
+    case FormatCSV:
+      OS << R.Path << ',' << R.Size << ','
+         << format("%.4f,%.5f\n", R.MeanFlipped, R.WorstBias);
+      break;
+    case FormatJSON:
+      OS << "\"path\": \"" << R.Path << "\", \"size\": " << R.Size
+         << format(", \"mean_bits_flipped\": %.4f, \"worst_bias\": %.5f}",
+                   R.MeanFlipped, R.WorstBias);
+      break;
+    }
+    OS.flush();
+  }
+
+  void finish() {
+    if (Format == FormatJSON)
+      OS << (FirstTable ? "{\n}\n" : "\n  ]\n}\n");
+  }
+};
+
+//===----------------------------------------------------------------------===//
+// Command line
+//===----------------------------------------------------------------------===//
+
+bool parseOptions(int argc, char **argv, Options &Opts) {
+  for (int I = 1; I < argc; ++I) {
+    cStringRef Arg(argv[I]);
+    if (Arg.startswith("-format=")) {
+      if (!parseFormat(Arg.substr(8), Opts.Format))
+        return false;
+    } else if (Arg.startswith("-min-time=")) {
+      if (!parseSeconds(Arg.substr(10), Opts.MinTime))
+        return false;
+    } else if (Arg.startswith("-keys=")) {
+      // The distribution tests need a few keys per bucket.
+      if (!parseCount(Arg.substr(6), Opts.NumKeys, 16)) {
+        errs() << "error: bad key count '" << Arg.substr(6) << "'\n";
+        return false;
+      }
+    } else if (Arg == "-no-speed") {
+      Opts.Speed = false;
+    } else if (Arg == "-no-quality") {
+      Opts.Quality = false;
+    } else {
+      errs() << "error: unknown option '" << Arg << "'\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+  Options Opts;
+  if (!parseOptions(argc, argv, Opts))
+    return 2;
+
+  Report Out(outs(), Opts.Format);
+  if (Opts.Speed) {
+    Out.beginSpeed();
+    for (size_t I = 0; I != sizeof(Hashers) / sizeof(Hashers[0]); ++I)
+      for (size_t J = 0; J != sizeof(SpeedSizes) / sizeof(SpeedSizes[0]); ++J)
+        Out.speed(Hashers[I],
+                  measureSpeed(Hashers[I], SpeedSizes[J], Opts.MinTime));
+  }
+  if (Opts.Quality) {
+    Out.beginDistribution();
+    for (size_t I = 0; I != sizeof(KeySets) / sizeof(KeySets[0]); ++I)
+      Out.distribution(KeySets[I],
+                       measureDistribution(KeySets[I], Opts.NumKeys));
+    Out.beginAvalanche();
+    for (size_t I = 0; I != sizeof(AvalancheSizes) / sizeof(AvalancheSizes[0]);
+         ++I)
+      Out.avalanche(measureAvalanche(AvalancheSizes[I]));
+  }
+  Out.finish();
+  return 0;
+}
@@ -0,0 +1,310 @@
+//===-- HashSetBenchmark.cpp - Hash set lookup benchmarks -------*- C++ -*-===//
+//
+//                        part of the akj support library
+//
+// Distributed under the University of Illinois Open Source License.
+//
+//===----------------------------------------------------------------------===//
+//
+// Compares FlatHashSet with the containers it can replace, on the same keys.
+//
+//   - Nodes: uniquing nodes profiled by two integers, with a FoldingSet
+//     (FindNodeOrInsertPos and InsertNode) and with a FlatHashSet of node
+//     pointers using FoldingSetFlatHashInfo (find_as and insert_as). Both
+//     build a FoldingSetNodeID for every operation.
+//   - Integers: random 64-bit keys in a DenseSet and in a FlatHashSet.
+//
+// For each table size the number of keys is 7/8 of it, the highest load a
+// FlatHashSet of that capacity reaches; a DenseSet holding as many keys is
+// at most 3/4 full and so has twice the buckets. Times are per operation:
+// insert builds the whole set from empty (freeing it is included), hit looks
+// up every key in a shuffled order, and miss looks up keys that are absent.
+//
+// Like the library itself this is a single translation unit; build it with
+//   g++ -std=c++11 -O2 benchmarks/HashSetBenchmark.cpp -lz -lpthread
+//
+// Usage: HashSetBenchmark [options]
+//   -sizes=N,N,...         table sizes, with an optional k or m suffix
+//                          (1k,64k,1m,8m)
+//   -min-time=SECONDS      time to spend on each measurement (0.2)
+//
+//===----------------------------------------------------------------------===//
+
+#include "../build-all.cpp"
+#include "../DenseSet.hpp"
+#include "../FlatHashSet.hpp"
+#include "BenchmarkSupport.hpp"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace akj;
+using namespace akj::bench;
+
+namespace {
+
+struct Options {
+  std::vector<size_t> Sizes;
+  double MinTime;
+
+  Options() : MinTime(0.2) {}
+};
+
+/// BenchNode - A FoldingSet node identified by two integers.
+struct BenchNode : FoldingSetNode {
+  uint64_t A;
+  unsigned B;
+
+  BenchNode(uint64_t A, unsigned B) : A(A), B(B) {}
+
+  void Profile(FoldingSetNodeID &ID) const {
+    ID.AddInteger(A);
+    ID.AddInteger(B);
+  }
+};
+
+typedef FlatHashSet<BenchNode *, FoldingSetFlatHashInfo<BenchNode> >
+    FlatNodeSet;
+
+/// Timings - Nanoseconds per operation, and the memory of the filled table
+/// (0 if the container can't report it).
+struct Timings {
+  double Insert, Hit, Miss;
+  size_t Bytes;
+};
+
+/// timePerOp - Call Setup and then Run, which performs Ops operations, until
+/// Run has taken MinTime seconds in all, and return the nanoseconds per
+/// operation. Setup is not timed.
+template<typename FnT, typename SetupT>
+double timePerOp(size_t Ops, double MinTime, FnT Run, SetupT Setup) {
+  typedef std::chrono::steady_clock Clock;
+  size_t Reps = 0;
+  double Elapsed = 0;
+  do {
+    Setup();
+    Clock::time_point Start = Clock::now();
+    Run();
+    Elapsed += std::chrono::duration<double>(Clock::now() - Start).count();
+    ++Reps;
+  } while (Elapsed < MinTime);
+  return Elapsed * 1e9 / double(Reps * Ops);
+}
+
+template<typename FnT>
+double timePerOp(size_t Ops, double MinTime, FnT Run) {
+  return timePerOp(Ops, MinTime, Run, []() {});
+}
+
+/// Sink - Keeps the results of lookups alive.
+volatile size_t Sink;
+
+Timings benchFoldingSet(const std::vector<BenchNode *> &Nodes,
+                        const std::vector<BenchNode *> &Absent,
+                        double MinTime) {
+  // The set links its nodes through the nodes themselves, and destroying it
+  // leaves the links behind.
+  auto Unlink = [&]() {
+    for (size_t I = 0, E = Nodes.size(); I != E; ++I)
+      Nodes[I]->SetNextInBucket(0);
+  };
+
+  Timings T;
+  T.Insert = timePerOp(Nodes.size(), MinTime, [&]() {
+    FoldingSet<BenchNode> Set;
+    FoldingSetNodeID ID;
+    for (size_t I = 0, E = Nodes.size(); I != E; ++I) {
+      ID.clear();
+      Nodes[I]->Profile(ID);
+      void *InsertPos;
+      if (!Set.FindNodeOrInsertPos(ID, InsertPos))
+        Set.InsertNode(Nodes[I], InsertPos);
+    }
+    Sink = Set.size();
+  }, Unlink);
+
+  Unlink();
+  FoldingSet<BenchNode> Set;
+  for (size_t I = 0, E = Nodes.size(); I != E; ++I)
+    Set.InsertNode(Nodes[I]);
+  std::vector<BenchNode *> Shuffled(Nodes);
+  std::shuffle(Shuffled.begin(), Shuffled.end(), Random(Shuffled.size()));
+  auto Lookup = [&](const std::vector<BenchNode *> &Keys) {
+    FoldingSetNodeID ID;
+    size_t Found = 0;
+    for (size_t I = 0, E = Keys.size(); I != E; ++I) {
+      ID.clear();
+      Keys[I]->Profile(ID);
+      void *InsertPos;
+      Found += Set.FindNodeOrInsertPos(ID, InsertPos) != 0;
+    }
+    Sink = Found;
+  };
+  T.Hit = timePerOp(Shuffled.size(), MinTime, [&]() { Lookup(Shuffled); });
+  T.Miss = timePerOp(Absent.size(), MinTime, [&]() { Lookup(Absent); });
+  T.Bytes = 0;
+  return T;
+}
+
+Timings benchFlatNodeSet(const std::vector<BenchNode *> &Nodes,
+                         const std::vector<BenchNode *> &Absent,
+                         double MinTime) {
+  Timings T;
+  T.Insert = timePerOp(Nodes.size(), MinTime, [&]() {
+    FlatNodeSet Set;
+    FoldingSetNodeID ID;
+    for (size_t I = 0, E = Nodes.size(); I != E; ++I) {
+      ID.clear();
+      Nodes[I]->Profile(ID);
+      Set.insert_as(Nodes[I], ID);
+    }
+    Sink = Set.size();
+  });
+
+  FlatNodeSet Set;
+  Set.insert(Nodes.begin(), Nodes.end());
+  std::vector<BenchNode *> Shuffled(Nodes);
+  std::shuffle(Shuffled.begin(), Shuffled.end(), Random(Shuffled.size()));
+  auto Lookup = [&](const std::vector<BenchNode *> &Keys) {
+    FoldingSetNodeID ID;
+    size_t Found = 0;
+    for (size_t I = 0, E = Keys.size(); I != E; ++I) {
+      ID.clear();
+      Keys[I]->Profile(ID);
+      Found += Set.find_as(ID) != Set.end();
+    }
+    Sink = Found;
+  };
+  T.Hit = timePerOp(Shuffled.size(), MinTime, [&]() { Lookup(Shuffled); });
+  T.Miss = timePerOp(Absent.size(), MinTime, [&]() { Lookup(Absent); });
+  T.Bytes = Set.getMemorySize();
+  return T;
+}
+
+template<typename SetT>
+Timings benchIntegers(const std::vector<uint64_t> &Keys,
+                      const std::vector<uint64_t> &Absent, double MinTime) {
+  Timings T;
+  T.Insert = timePerOp(Keys.size(), MinTime, [&]() {
+    SetT Set;
+    for (size_t I = 0, E = Keys.size(); I != E; ++I)
+      Set.insert(Keys[I]);
+    Sink = Set.size();
+  });
+
+  SetT Set;
+  Set.insert(Keys.begin(), Keys.end());
+  std::vector<uint64_t> Shuffled(Keys);
+  std::shuffle(Shuffled.begin(), Shuffled.end(), Random(Shuffled.size()));
+  auto Lookup = [&](const std::vector<uint64_t> &Keys) {
+    size_t Found = 0;
+    for (size_t I = 0, E = Keys.size(); I != E; ++I)
+      Found += Set.count(Keys[I]);
+    Sink = Found;
+  };
+  T.Hit = timePerOp(Shuffled.size(), MinTime, [&]() { Lookup(Shuffled); });
+  T.Miss = timePerOp(Absent.size(), MinTime, [&]() { Lookup(Absent); });
+  T.Bytes = Set.getMemorySize();
+  return T;
+}
+
+void printHeader() {
+  const char *Size = "size", *Keys = "keys", *Container = "container";
+  const char *Insert = "insert ns", *Hit = "hit ns", *Miss = "miss ns",
+             *Bytes = "bytes/key";
+  outs() << format("%-8s %-10s %-18s ", Size, Keys, Container)
+         << format("%10s %10s %10s %10s\n", Insert, Hit, Miss, Bytes);
+}
+
+void printRow(size_t Size, size_t Keys, const char *Name, const Timings &T) {
+  outs() << format("%-8zu %-10zu %-18s ", Size, Keys, Name)
+         << format("%10.1f %10.1f %10.1f ", T.Insert, T.Hit, T.Miss);
+  const char *None = "-";
+  if (T.Bytes)
+    outs() << format("%10.1f\n", double(T.Bytes) / double(Keys));
+  else
+    outs() << format("%10s\n", None);
+}
+
+void runSize(size_t Size, double MinTime) {
+  size_t NumKeys = Size - Size / 8;
+  Random Rand(Size);
+
+  // Draw distinct keys, then as many more that are not among them.
+  FlatHashSet<uint64_t> Seen;
+  std::vector<uint64_t> Keys, Absent;
+  while (Keys.size() != NumKeys) {
+    uint64_t K = Rand.next();
+    if (Seen.insert(K).second)
+      Keys.push_back(K);
+  }
+  while (Absent.size() != NumKeys) {
+    uint64_t K = Rand.next();
+    if (Seen.insert(K).second)
+      Absent.push_back(K);
+  }
+
+  std::vector<BenchNode> NodeStore, AbsentStore;
+  NodeStore.reserve(NumKeys);
+  AbsentStore.reserve(NumKeys);
+  std::vector<BenchNode *> Nodes, AbsentNodes;
+  for (size_t I = 0; I != NumKeys; ++I) {
+    NodeStore.push_back(BenchNode(Keys[I] >> 8, unsigned(Keys[I] & 0xFF)));
+    AbsentStore.push_back(BenchNode(Absent[I] >> 8,
+                                    unsigned(Absent[I] & 0xFF)));
+    Nodes.push_back(&NodeStore.back());
+    AbsentNodes.push_back(&AbsentStore.back());
+  }
+
+  printRow(Size, NumKeys, "FoldingSet",
+           benchFoldingSet(Nodes, AbsentNodes, MinTime));
+  printRow(Size, NumKeys, "FlatHashSet<node*>",
+           benchFlatNodeSet(Nodes, AbsentNodes, MinTime));
+  printRow(Size, NumKeys, "DenseSet",
+           benchIntegers<DenseSet<uint64_t> >(Keys, Absent, MinTime));
+  printRow(Size, NumKeys, "FlatHashSet<u64>",
+           benchIntegers<FlatHashSet<uint64_t> >(Keys, Absent, MinTime));
+}
+
+bool parseOptions(int argc, char **argv, Options &Opts) {
+  for (int I = 1; I < argc; ++I) {
+    cStringRef Arg(argv[I]);
+    if (Arg.startswith("-sizes=")) {
+      if (!parseCountList(Arg.substr(7), Opts.Sizes, "table size", 16))
+        return false;
+      for (size_t J = 0, E = Opts.Sizes.size(); J != E; ++J) {
+        if (!isPowerOf2_64(Opts.Sizes[J])) {
+          errs() << "error: bad table size '" << Opts.Sizes[J]
+                 << "' (must be a power of two)\n";
+          return false;
+        }
+      }
+    } else if (Arg.startswith("-min-time=")) {
+      if (!parseSeconds(Arg.substr(10), Opts.MinTime))
+        return false;
+    } else {
+      errs() << "error: unknown option '" << Arg << "'\n";
+      return false;
+    }
+  }
+  if (Opts.Sizes.empty()) {
+    Opts.Sizes.push_back(1024);
+    Opts.Sizes.push_back(64 * 1024);
+    Opts.Sizes.push_back(1024 * 1024);
+    Opts.Sizes.push_back(8 * 1024 * 1024);
+  }
+  return true;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+  Options Opts;
+  if (!parseOptions(argc, argv, Opts))
+    return 2;
+
+  printHeader();
+  for (size_t I = 0, E = Opts.Sizes.size(); I != E; ++I)
+    runSize(Opts.Sizes[I], Opts.MinTime);
+  return 0;
+}
@@ -1,6 +1,10 @@
 #include "Allocator.cpp"
 #include "ArbPrecPInt.cpp"
+#include "BlockCompression.cpp"
+#include "CRC.cpp"
+#include "CompressedStream.cpp"
 #include "Compression.cpp"
+#include "CompressionFilters.cpp"
 #include "ConvertUTF.cpp"
 #include "DataStream.cpp"
 #include "ErrnoToString.cpp"
@@ -18,6 +22,8 @@
 #include "SmallVector.cpp"
 #include "StreamableMemoryObject.cpp"
 #include "StringExtras.cpp"
+#include "StringMap.cpp"
+#include "StringPool.cpp"
 #include "StringRef.cpp"
 #include "StringRefMemoryObject.cpp"
 #include "SystemError.cpp"